@@ -0,0 +1,66 @@
+#include "../config.h"
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * compile - Compile a text config
+ * @filename:	Text config path
+ *
+ * Delete the old compiled config first so it's always rebuilt
+ */
+static int compile(const std::string &filename)
+{
+	const auto compiled = filename + "c";
+	std::remove(compiled.c_str());
+
+	const config cfg(filename);
+	if (config::open_compiled(compiled) == nullptr) {
+		std::cerr << "Failed to write " << compiled << std::endl;
+		return 1;
+	}
+
+	std::cout << compiled << ": " << cfg.size() << " keys" << std::endl;
+	return 0;
+}
+
+/**
+ * dump - Print every key and value in a compiled config
+ * @filename:	Compiled config path
+ */
+static int dump(const std::string &filename)
+{
+	const auto cfg = config::open_compiled(filename);
+	if (cfg == nullptr) {
+		std::cerr << filename << " is missing or invalid" << std::endl;
+		return 1;
+	}
+
+	cfg->for_each("", [](
+		const char *name,
+		const size_t name_len,
+		const char *value)
+	{
+		std::cout.write(name, name_len);
+		std::cout << " \"" << value << "\"" << std::endl;
+	});
+
+	return 0;
+}
+
+/**
+ * main - Entry point
+ * @argc:	Command line argument count
+ * @argv:	Array of command line arguments
+ *
+ * cfg_compile [tgm3.cfg]	Compile to tgm3.cfgc
+ * cfg_compile -d [tgm3.cfgc]	Dump a compiled config
+ */
+int main(const int argc, const char *argv[])
+{
+	if (argc >= 2 && strcmp(argv[1], "-d") == 0)
+		return dump(argc >= 3 ? argv[2] : "tgm3.cfgc");
+
+	return compile(argc >= 2 ? argv[1] : "tgm3.cfg");
+}
\ No newline at end of file
@@ -1,76 +1,667 @@
 #include "config.h"
-#include <regex>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <climits>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Used to track what's being done with tokens
 struct parse_state {
 	bool needs_key = true;
-	std::vector<std::string> namespaces;
-	std::string last_token;
+
+	// Outer namespaces joined with dots, and the length of the prefix before
+	// each namespace was entered so it can be cut back on }
+	std::string prefix;
+	std::vector<size_t> prefix_lengths;
+
+	// Points into the file contents, valid for the whole parse
+	const char *last_token = "";
+	size_t last_token_len = 0;
+
+	// Reused to build full key names
+	std::string key;
+};
+
+/**
+ * slot_index - Scramble a key hash
+ * @hash:	Key hash
+ *
+ * The polynomial key hash has weak low bits, so mix it before it gets masked
+ * down to a table index
+ */
+uint32_t config::slot_index(uint32_t hash)
+{
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6B;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+/**
+ * insert - Add a keyvalue to the table
+ * @key:	Full key name
+ * @value:	Value string
+ * @len:	Value length
+ *
+ * Grow the table at half load, then probe linearly for either the existing
+ * key or an empty slot. Keys and values are interned into strings.
+ */
+void config::insert(const std::string &key, const char *value, const size_t len)
+{
+	if ((num_keys + 1) * 2 > slots.size()) {
+		std::vector<slot> old_slots(slots.size() != 0 ? slots.size() * 2 : 64);
+		old_slots.swap(slots);
+
+		const auto mask = slots.size() - 1;
+		for (const auto &old : old_slots) {
+			if (old.key == slot::empty)
+				continue;
+
+			auto idx = slot_index(old.hash) & mask;
+			while (slots[idx].key != slot::empty)
+				idx = (idx + 1) & mask;
+
+			slots[idx] = old;
+		}
+	}
+
+	const auto hash = hash_str(key.data(), key.length());
+	const auto mask = slots.size() - 1;
+	auto idx = slot_index(hash) & mask;
+
+	while (slots[idx].key != slot::empty) {
+		const auto &check = slots[idx];
+		if (check.hash == hash
+		 && check.key_len == key.length()
+		 && memcmp(&strings[check.key], key.data(), key.length()) == 0)
+			break;
+
+		idx = (idx + 1) & mask;
+	}
+
+	auto &entry = slots[idx];
+	if (entry.key == slot::empty) {
+		entry.hash = hash;
+		entry.key = (uint32_t)(strings.length());
+		entry.key_len = (uint32_t)(key.length());
+		strings.append(key.data(), key.length() + 1);
+		num_keys++;
+	}
+
+	entry.value = (uint32_t)(strings.length());
+	strings.append(value, len);
+	strings += '\0';
+}
+
+/**
+ * find - Look up a value
+ * @prefix:	Start of the key name, may be null if prefix_len is 0
+ * @prefix_len:	Length of prefix
+ * @name:	Rest of the key name
+ * @name_len:	Length of name
+ * @hash:	Hash of the full key name
+ *
+ * Probe from the hashed slot until the key or an empty slot is found. The key
+ * is compared in two parts so callers never have to concatenate it.
+ */
+const char *config::find(
+	const char *prefix,
+	const size_t prefix_len,
+	const char *name,
+	const size_t name_len,
+	const uint32_t hash
+) const {
+	if (num_slots == 0)
+		return nullptr;
+
+	const auto mask = num_slots - 1;
+	for (auto idx = slot_index(hash) & mask;
+	     slot_data[idx].key != slot::empty;
+	     idx = (idx + 1) & mask) {
+		const auto &check = slot_data[idx];
+		if (check.hash != hash || check.key_len != prefix_len + name_len)
+			continue;
+
+		// prefix is null for unprefixed lookups, memcmp can't be given that
+		const auto *key = &string_data[check.key];
+		if ((prefix_len == 0 || memcmp(key, prefix, prefix_len) == 0)
+		 && memcmp(key + prefix_len, name, name_len) == 0)
+			return &string_data[check.value];
+	}
+
+	return nullptr;
+}
+
+// Identifies the version of a text config a compiled one was built from
+struct file_stamp {
+	uint64_t size;
+	int64_t mtime;
+};
+
+// Compiled config layout: header, num_slots slots, then the strings
+struct compiled_header {
+	static const uint32_t current_version = 1;
+
+	char magic[4];
+	uint32_t version;
+
+	uint64_t source_size;
+	int64_t source_mtime;
+	uint32_t source_hash;
+
+	uint32_t num_keys;
+	uint32_t num_slots;
+	uint32_t strings_size;
 };
 
+static_assert(sizeof(compiled_header) == 40, "compiled_header has padding");
+
+static const char compiled_magic[4] = { 'C', 'F', 'G', 'C' };
+
+/**
+ * get_file_stamp - Get the size and modification time of a file
+ * @path:	File path
+ * @stamp:	Output
+ *
+ * Use the full resolution of the mtime so saving twice in the same second
+ * still invalidates the compiled config
+ */
+static bool get_file_stamp(const std::string &path, file_stamp *stamp)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &info))
+		return false;
+
+	stamp->size =
+		((uint64_t)(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+	stamp->mtime =
+		((int64_t)(info.ftLastWriteTime.dwHighDateTime) << 32) |
+		info.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+
+	stamp->size = (uint64_t)(info.st_size);
+	stamp->mtime =
+		(int64_t)(info.st_mtim.tv_sec) * 1000000000 +
+		info.st_mtim.tv_nsec;
+#endif
+	return true;
+}
+
+/**
+ * map_file - Map a whole file read only
+ * @path:	File path
+ * @size:	Output file size
+ *
+ * The mapping is released when the last copy of the returned pointer goes
+ * away. Return null on failure or if the file is empty.
+ */
+static std::shared_ptr<const void> map_file(const std::string &path, size_t *size)
+{
+#ifdef _WIN32
+	const auto file = CreateFile(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_DELETE,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	const auto section = CreateFileMapping(
+		file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	CloseHandle(file);
+	if (section == nullptr)
+		return nullptr;
+
+	const auto *view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(section);
+	if (view == nullptr)
+		return nullptr;
+
+	*size = (size_t)(file_size.QuadPart);
+	return std::shared_ptr<const void>(view, [](const void *view)
+	{
+		UnmapViewOfFile(view);
+	});
+#else
+	const auto fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	const auto file_size = (size_t)(info.st_size);
+	auto *view = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return nullptr;
+
+	*size = file_size;
+	return std::shared_ptr<const void>(view, [file_size](const void *view)
+	{
+		munmap((void*)(view), file_size);
+	});
+#endif
+}
+
+/**
+ * hash_bytes - Hash config file contents
+ * @data:	File contents
+ * @len:	Length of data
+ *
+ * Same hash as keys use, just not recursive
+ */
+uint32_t config::hash_bytes(const char *data, const size_t len)
+{
+	auto hash = 0u;
+	for (auto i = 0u; i < len; i++)
+		hash = hash * hash_mult + (unsigned char)(data[i]);
+
+	return hash;
+}
+
+/**
+ * map_compiled - Use a compiled config
+ * @path:		Compiled config path
+ * @stamp:		Required source size and mtime, may be null
+ * @source_hash:	Required source hash, may be null
+ *
+ * Map the file and check that its header matches this build and the given
+ * source, and that the table and every string it points at fit in the file.
+ * Lookups then read the mapped table directly without further checks.
+ */
+bool config::map_compiled(
+	const std::string &path,
+	const file_stamp *stamp,
+	const uint32_t *source_hash
+) {
+	size_t size;
+	auto view = map_file(path, &size);
+	if (view == nullptr || size < sizeof(compiled_header))
+		return false;
+
+	const auto *header = (const compiled_header*)(view.get());
+	if (memcmp(header->magic, compiled_magic, sizeof(compiled_magic)) != 0
+	 || header->version != compiled_header::current_version)
+		return false;
+
+	if (stamp != nullptr
+	 && (header->source_size != stamp->size
+	  || header->source_mtime != stamp->mtime))
+		return false;
+
+	if (source_hash != nullptr && header->source_hash != *source_hash)
+		return false;
+
+	// Slot count must be a power of 2 for the index mask
+	const auto slots_size = (uint64_t)(header->num_slots) * sizeof(slot);
+	if ((header->num_slots & (header->num_slots - 1)) != 0
+	 || sizeof(compiled_header) + slots_size + header->strings_size != size)
+		return false;
+
+	const auto *data = (const char*)(view.get()) + sizeof(compiled_header);
+	const auto *slots_in = (const slot*)(data);
+	const auto *strings_in = data + slots_size;
+	const auto strings_size = header->strings_size;
+
+	// Strings are read up to their terminator, so the block must end in one.
+	// Probing stops at an empty slot, so there must be one.
+	if (header->num_slots != 0
+	 && (strings_size == 0 || strings_in[strings_size - 1] != '\0'))
+		return false;
+
+	uint32_t used = 0;
+	for (auto i = 0u; i < header->num_slots; i++) {
+		const auto &entry = slots_in[i];
+		if (entry.key == slot::empty)
+			continue;
+
+		if (entry.key >= strings_size
+		 || entry.key_len >= strings_size - entry.key
+		 || strings_in[entry.key + entry.key_len] != '\0'
+		 || entry.value >= strings_size)
+			return false;
+
+		used++;
+	}
+
+	if (used != header->num_keys || (header->num_slots != 0 && used == header->num_slots))
+		return false;
+
+	slot_data = slots_in;
+	string_data = strings_in;
+	num_slots = header->num_slots;
+	num_keys = header->num_keys;
+	mapping = std::move(view);
+	return true;
+}
+
+/**
+ * restamp_compiled - Record a new source stamp in a compiled config
+ * @path:		Compiled config path
+ * @stamp:		New size and mtime of the source
+ * @source_hash:	Hash of the source contents
+ *
+ * For a source that was touched but not changed. The header is patched in
+ * place if the compiled config was built from the same contents, so later
+ * loads match on the stamp again instead of hashing the source every time.
+ * Fails harmlessly if another process has the file mapped.
+ */
+static void restamp_compiled(
+	const std::string &path,
+	const file_stamp &stamp,
+	const uint32_t source_hash
+) {
+	std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+	compiled_header header;
+	file.read((char*)(&header), sizeof(header));
+	if (!file.good()
+	 || memcmp(header.magic, compiled_magic, sizeof(compiled_magic)) != 0
+	 || header.version != compiled_header::current_version
+	 || header.source_hash != source_hash)
+		return;
+
+	header.source_size = stamp.size;
+	header.source_mtime = stamp.mtime;
+	file.seekp(0);
+	file.write((const char*)(&header), sizeof(header));
+}
+
+/**
+ * write_compiled - Save the parsed table
+ * @path:		Compiled config path
+ * @stamp:		Size and mtime of the source
+ * @source_hash:	Hash of the source contents
+ *
+ * Write to a temporary file and rename it over the old one so a reader never
+ * sees a partial file. This fails harmlessly if another process has the old
+ * one mapped.
+ */
+bool config::write_compiled(
+	const std::string &path,
+	const file_stamp &stamp,
+	const uint32_t source_hash
+) const {
+	compiled_header header;
+	memcpy(header.magic, compiled_magic, sizeof(compiled_magic));
+	header.version = compiled_header::current_version;
+	header.source_size = stamp.size;
+	header.source_mtime = stamp.mtime;
+	header.source_hash = source_hash;
+	header.num_keys = (uint32_t)(num_keys);
+	header.num_slots = (uint32_t)(num_slots);
+	header.strings_size = (uint32_t)(strings.size());
+
+	const auto temp_path = path + ".tmp";
+	{
+		std::ofstream output(temp_path, std::ios::binary);
+		output.write((const char*)(&header), sizeof(header));
+		output.write((const char*)(slot_data), num_slots * sizeof(slot));
+		output.write(strings.data(), strings.size());
+		if (output.fail())
+			return false;
+	}
+
+	std::remove(path.c_str());
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * parse_int - Convert a value to an int
+ * @value:	Value string or null
+ * @out:	Result
+ *
+ * Accepts the same formats as strtol with base 0, so hex keycodes work
+ */
+bool config::parse_int(const char *value, int *out)
+{
+	if (value == nullptr)
+		return false;
+
+	char *end;
+	errno = 0;
+	const auto result = strtol(value, &end, 0);
+	if (end == value || *end != '\0' || errno == ERANGE)
+		return false;
+
+	// long is 64 bits on Linux
+	if (result < INT_MIN || result > INT_MAX)
+		return false;
+
+	*out = (int)(result);
+	return true;
+}
+
+/**
+ * parse_float - Convert a value to a float
+ * @value:	Value string or null
+ * @out:	Result
+ */
+bool config::parse_float(const char *value, float *out)
+{
+	if (value == nullptr)
+		return false;
+
+	char *end;
+	errno = 0;
+	const auto result = strtof(value, &end);
+	if (end == value || *end != '\0' || errno == ERANGE)
+		return false;
+
+	*out = result;
+	return true;
+}
+
+/**
+ * parse_bool - Convert a value to a bool
+ * @value:	Value string or null
+ * @out:	Result
+ *
+ * Accepts true/True and false/False
+ */
+bool config::parse_bool(const char *value, bool *out)
+{
+	if (value == nullptr)
+		return false;
+
+	if (strcmp(value, "true") == 0 || strcmp(value, "True") == 0)
+		*out = true;
+	else if (strcmp(value, "false") == 0 || strcmp(value, "False") == 0)
+		*out = false;
+	else
+		return false;
+
+	return true;
+}
+
 /**
  * handle_token - Feed tokens into keyvalue map
- * @token:	Token string
+ * @token:	Token start, outer double quotes already removed
+ * @len:	Token length
  * @state:	Parser state
  *
  * Track namespaces, which tokens are keys and which are values and write them
- * to the keyvalue map prefixed by outer namespaces
+ * to the keyvalue table prefixed by outer namespaces
  */
-void config::handle_token(std::string token, parse_state *state)
+void config::handle_token(const char *token, const size_t len, parse_state *state)
 {
-	// Replace outer double quotes
-	if (token[0] == '"') {
-		token.replace(token.begin(), token.begin() + 1, "");
-		token.replace(token.end() - 1, token.end(), "");
-	}
-	if (token == "{") {
-		state->namespaces.push_back(state->last_token);
+	if (len == 1 && *token == '{') {
+		state->prefix_lengths.push_back(state->prefix.length());
+		state->prefix.append(state->last_token, state->last_token_len);
+		state->prefix += '.';
 		state->needs_key = true;
-	} else if (token == "}") {
-		state->namespaces.pop_back();
+	} else if (len == 1 && *token == '}') {
+		if (!state->prefix_lengths.empty()) {
+			state->prefix.resize(state->prefix_lengths.back());
+			state->prefix_lengths.pop_back();
+		}
 		state->needs_key = true;
 	} else if (state->needs_key = !state->needs_key) {
-		std::string prefix;
-		for(auto &i : state->namespaces)
-			prefix += i + ".";
-
-		kv_map[prefix + state->last_token] = token;
+		state->key = state->prefix;
+		state->key.append(state->last_token, state->last_token_len);
+		insert(state->key, token, len);
 	}
 	state->last_token = token;
+	state->last_token_len = len;
+}
+
+/**
+ * is_space - Whitespace test that doesn't depend on locale
+ * @c:	Character to test
+ */
+static bool is_space(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+/**
+ * parse - Parse config text
+ * @contents:	File contents
+ *
+ * Tokenize the file contents in a single pass. Comments are skipped, braces
+ * are always their own token and quoted strings may contain anything but a
+ * double quote. Tokens are passed to handle_token in place.
+ */
+void config::parse(const std::string &contents)
+{
+	parse_state state;
+
+	const auto *pos = contents.data();
+	const auto *end = pos + contents.size();
+
+	const auto comment_at = [end](const char *p)
+	{
+		return p[0] == '/' && p + 1 < end && (p[1] == '/' || p[1] == '*');
+	};
+
+	while (pos < end) {
+		if (is_space(*pos)) {
+			pos++;
+		} else if (comment_at(pos) && pos[1] == '/') {
+			// Single line comment, the newline gets skipped as whitespace
+			const auto *newline = (const char*)(memchr(pos, '\n', end - pos));
+			pos = newline != nullptr ? newline : end;
+		} else if (comment_at(pos)) {
+			// Multi line comment, an unterminated one runs to EOF
+			pos += 2;
+			while (pos + 1 < end && !(pos[0] == '*' && pos[1] == '/'))
+				pos++;
+
+			pos = pos + 1 < end ? pos + 2 : end;
+		} else if (*pos == '{' || *pos == '}') {
+			handle_token(pos, 1, &state);
+			pos++;
+		} else if (*pos == '"') {
+			const auto *start = ++pos;
+			const auto *quote = (const char*)(memchr(pos, '"', end - pos));
+			pos = quote != nullptr ? quote : end;
+			handle_token(start, pos - start, &state);
+
+			if (pos < end)
+				pos++;
+		} else {
+			const auto *start = pos;
+			while (pos < end
+			    && !is_space(*pos)
+			    && *pos != '{'
+			    && *pos != '}'
+			    && *pos != '"'
+			    && !comment_at(pos))
+				pos++;
+
+			handle_token(start, pos - start, &state);
+		}
+	}
 }
 
 /**
  * config::config - Read config file
  * @filename:	File path
  *
- * Use regexes to ignore comments and tokenize the file contents
+ * Use the compiled config if its recorded source size and mtime still match.
+ * Otherwise hash the text, which is still much cheaper than parsing it, to
+ * catch files that were only touched, and save their new stamp. Failing
+ * both, parse the text and write a new compiled config for next time.
  */
 config::config(const std::string &filename)
 {
-	std::ifstream file(filename);
+	const auto compiled = filename + "c";
+
+	file_stamp stamp;
+	const auto have_stamp = get_file_stamp(filename, &stamp);
+	if (have_stamp && map_compiled(compiled, &stamp, nullptr))
+		return;
+
+	std::ifstream file(filename, std::ios::binary);
 	std::ostringstream stream;
 	stream << file.rdbuf();
-	auto contents = stream.str();
+	const auto contents = stream.str();
 
-	parse_state state;
+	const auto source_hash = hash_bytes(contents.data(), contents.size());
+	if (have_stamp) {
+		restamp_compiled(compiled, stamp, source_hash);
+		if (map_compiled(compiled, nullptr, &source_hash))
+			return;
+	}
+
+	parse(contents);
+
+	string_data = strings.data();
+	slot_data = slots.data();
+	num_slots = slots.size();
+
+	if (have_stamp)
+		write_compiled(compiled, stamp, source_hash);
+}
+
+/**
+ * open_compiled - Load a compiled config without its source file
+ * @path:	Path of the compiled config
+ *
+ * Return null if the file is missing or invalid
+ */
+std::unique_ptr<config> config::open_compiled(const std::string &path)
+{
+	std::unique_ptr<config> cfg(new config());
+	if (!cfg->map_compiled(path, nullptr, nullptr))
+		return nullptr;
 
-	// Remove C++ style comments, both single and multi line
-	std::regex comments("(?:/\\*(?:[^*]|(?:\\*+[^*/]))*\\*+/)|(?://.*)");
-	contents = std::regex_replace(contents, comments, "");
-
-	// Loop through tokens
-	std::regex split("\\s+(?=(?:[^\\\"]*[\\\"][^\\\"]*[\\\"])*[^\\\"]*$)");
-	std::for_each(
-			std::sregex_token_iterator(
-					contents.begin(),
-					contents.end(),
-					split,
-					-1),
-			std::sregex_token_iterator(),
-			[this, &state](std::ssub_match token)
-			{
-				handle_token(token.str(), &state);
-			});
+	return cfg;
 }
\ No newline at end of file
@@ -1,8 +1,18 @@
 #pragma once
 
 #include <string>
-#include <map>
-#include <regex>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// VS2013 has no constexpr, keys made from literals are hashed at run time
+#if defined(_MSC_VER) && _MSC_VER < 1900 && !defined(__INTEL_COMPILER)
+#define CONFIG_CONSTEXPR
+#else
+#define CONFIG_CONSTEXPR constexpr
+#endif
 
 /*
  * Reads config files in the following format:
@@ -20,55 +30,244 @@
  * }
  * 
  * You can then access a key like "namespace.namespace2.key2".
+ *
+ * The parsed table is saved next to the file with a "c" appended to the
+ * name, e.g. tgm3.cfgc. As long as the text file isn't modified, later loads
+ * map that file and use it in place instead of parsing again.
  */
 class config {
-	std::map<std::string, std::string> kv_map;
+	// Multiplier for the key hash, which is a plain polynomial hash so the
+	// hash of "a.b" can be built from the hashes of "a." and "b"
+	static const uint32_t hash_mult = 0x01000193;
+
+	static CONFIG_CONSTEXPR uint32_t hash_str(
+		const char *str,
+		const size_t len,
+		const uint32_t hash = 0)
+	{
+		return len == 0 ? hash : hash_str(
+			str + 1,
+			len - 1,
+			hash * hash_mult + (unsigned char)(*str));
+	}
+
+	// hash_mult ^ len, used to append to an existing hash
+	static CONFIG_CONSTEXPR uint32_t hash_scale(const size_t len)
+	{
+		return len == 0 ? 1 : hash_mult * hash_scale(len - 1);
+	}
+
+public:
+	/*
+	 * Key name along with its hash. Keys made from string literals are
+	 * hashed at compile time where the compiler supports constexpr.
+	 */
+	class key {
+	public:
+		const char *str;
+		size_t len;
+		uint32_t hash;
+		uint32_t scale;
+
+		template<size_t N>
+		CONFIG_CONSTEXPR key(const char (&str)[N]) :
+			str(str),
+			len(N - 1),
+			hash(hash_str(str, N - 1)),
+			scale(hash_scale(N - 1))
+		{
+		}
+
+		key(const char *str, const size_t len) :
+			str(str),
+			len(len),
+			hash(hash_str(str, len)),
+			scale(hash_scale(len))
+		{
+		}
+
+		key(const std::string &str) : key(str.data(), str.length())
+		{
+		}
+	};
+
+private:
+	// Hash table entry, strings are stored as offsets into strings
+	struct slot {
+		static const uint32_t empty = ~0u;
+
+		uint32_t hash;
+		uint32_t key = empty;
+		uint32_t key_len;
+		uint32_t value;
+	};
+
+	// Interned null terminated keys and values, filled while parsing
+	std::string strings;
+
+	// Open addressed table, the size is always a power of 2
+	std::vector<slot> slots;
+	size_t num_keys = 0;
+
+	// What lookups read, either the two members above or a mapped compiled
+	// config file
+	const char *string_data = nullptr;
+	const slot *slot_data = nullptr;
+	size_t num_slots = 0;
+
+	// Keeps a compiled config mapped
+	std::shared_ptr<const void> mapping;
+
+	config() = default;
+
+	static uint32_t slot_index(uint32_t hash);
+	static uint32_t hash_bytes(const char *data, size_t len);
+
+	// Use a compiled config if it matches the given source size/mtime/hash
+	bool map_compiled(
+		const std::string &path,
+		const struct file_stamp *stamp,
+		const uint32_t *source_hash);
+
+	// Save the parsed table along with the source it came from
+	bool write_compiled(
+		const std::string &path,
+		const struct file_stamp &stamp,
+		uint32_t source_hash) const;
+
+	// Tokenize text into strings and slots
+	void parse(const std::string &contents);
+
+	// Store a value, replacing the old one if the key exists
+	void insert(const std::string &key, const char *value, size_t len);
+
+	// Return the value for prefix + name, or nullptr if it's not set
+	const char *find(
+		const char *prefix,
+		size_t prefix_len,
+		const char *name,
+		size_t name_len,
+		uint32_t hash) const;
+
+	const char *find(const key &name) const
+	{
+		return find(nullptr, 0, name.str, name.len, name.hash);
+	}
+
+	const char *find(const key &prefix, const key &name) const
+	{
+		return find(
+			prefix.str,
+			prefix.len,
+			name.str,
+			name.len,
+			prefix.hash * name.scale + name.hash);
+	}
 
 	// Handle a single token
-	void config::handle_token(std::string token, struct parse_state *state);
+	void handle_token(const char *token, size_t len, struct parse_state *state);
 
 public:
-	// Split the file into keyvalues
+	// Split the file into keyvalues, or use its compiled form if it's current
 	explicit config(const std::string &filename);
 
+	config(const config&) = delete;
+	config &operator=(const config&) = delete;
+
+	// Open a compiled config directly without checking its source
+	static std::unique_ptr<config> open_compiled(const std::string &path);
+
+	// Number of keys
+	size_t size() const
+	{
+		return num_keys;
+	}
+
 	/*
-	 * These functions get a value given a key name
-	 * TODO: Add error checking to prevent typo annoyance
+	 * Value conversion. These return false and leave out alone if value is
+	 * null or isn't entirely a valid value of the type.
 	 */
+	static bool parse_int(const char *value, int *out);
+	static bool parse_float(const char *value, float *out);
+	static bool parse_bool(const char *value, bool *out);
 
-	std::string value_str(const std::string &def, const std::string &key) const
+	/*
+	 * Call func(name, name_len, value) for every key that starts with
+	 * prefix, with name being the rest of the key.
+	 */
+	template<typename F>
+	void for_each(const key &prefix, F func) const
 	{
-		try {
-			return kv_map.at(key);
-		} catch(...) {
-			return def;
+		for (auto i = 0u; i < num_slots; i++) {
+			const auto &entry = slot_data[i];
+			if (entry.key == slot::empty || entry.key_len < prefix.len)
+				continue;
+
+			const auto *name = &string_data[entry.key];
+			if (strncmp(name, prefix.str, prefix.len) != 0)
+				continue;
+
+			func(
+				name + prefix.len,
+				entry.key_len - prefix.len,
+				&string_data[entry.value]);
 		}
 	}
 
-	int value_int(const int def, const std::string &key) const
+	/*
+	 * These functions get a value given a key name, or a key name relative
+	 * to a prefix such as "joystick.name.". A missing or malformed value
+	 * returns def. Use config_schema to get typos reported instead.
+	 */
+
+	std::string value_str(const std::string &def, const key &name) const
 	{
-		try {
-			return std::stoi(kv_map.at(key), nullptr, 0);
-		} catch(...) {
-			return def;
-		}
+		const auto *value = find(name);
+		return value != nullptr ? value : def;
 	}
 
-	float value_float(const float def, const std::string &key) const
+	std::string value_str(
+		const std::string &def,
+		const key &prefix,
+		const key &name) const
 	{
-		try {
-			return std::stof(kv_map.at(key));
-		} catch(...) {
-			return def;
-		}
+		const auto *value = find(prefix, name);
+		return value != nullptr ? value : def;
 	}
 
-	bool value_bool(const bool def, const std::string &key) const
+	int value_int(const int def, const key &name) const
 	{
-		try {
-			return kv_map.at(key) == "True" || kv_map.at(key) == "true";
-		} catch(...) {
-			return def;
-		}
+		int result;
+		return parse_int(find(name), &result) ? result : def;
+	}
+
+	int value_int(const int def, const key &prefix, const key &name) const
+	{
+		int result;
+		return parse_int(find(prefix, name), &result) ? result : def;
+	}
+
+	float value_float(const float def, const key &name) const
+	{
+		float result;
+		return parse_float(find(name), &result) ? result : def;
+	}
+
+	float value_float(const float def, const key &prefix, const key &name) const
+	{
+		float result;
+		return parse_float(find(prefix, name), &result) ? result : def;
+	}
+
+	bool value_bool(const bool def, const key &name) const
+	{
+		bool result;
+		return parse_bool(find(name), &result) ? result : def;
+	}
+
+	bool value_bool(const bool def, const key &prefix, const key &name) const
+	{
+		bool result;
+		return parse_bool(find(prefix, name), &result) ? result : def;
 	}
-};
+};
\ No newline at end of file
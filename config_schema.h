@@ -0,0 +1,229 @@
+#pragma once
+
+#include "config.h"
+#include <string>
+#include <vector>
+#include <initializer_list>
+
+/*
+ * Describes a settings struct in terms of the keys of one config namespace:
+ *
+ * struct settings {
+ *	int up;
+ *	bool invisible;
+ * };
+ *
+ * const config_schema<settings> schema("keyboard.", {
+ *	{ "up",        &settings::up,        'W'   },
+ *	{ "invisible", &settings::invisible, false },
+ * });
+ *
+ * An int field can also be given a null terminated list of names, in which
+ * case the value must be one of them and the field gets its index.
+ *
+ * bind then fills a settings struct in a single pass over the namespace,
+ * without any per-key allocation. Keys in the namespace that aren't part of
+ * the schema, and values that don't parse as their field's type, are added
+ * to a list of diagnostics instead of being silently ignored.
+ */
+template<typename T>
+class config_schema {
+public:
+	class field {
+		friend class config_schema;
+
+		enum class type {
+			integer,
+			decimal,
+			boolean,
+			string,
+			choice
+		};
+
+		config::key name;
+		type value_type;
+
+		union {
+			int T::*i;
+			float T::*f;
+			bool T::*b;
+			std::string T::*s;
+		} member;
+
+		union {
+			int i;
+			float f;
+			bool b;
+			const char *s;
+		} def;
+
+		const char *const *choices;
+
+	public:
+		field(const config::key &name, int T::*member, const int def) :
+			name(name), value_type(type::integer)
+		{
+			this->member.i = member;
+			this->def.i = def;
+		}
+
+		field(const config::key &name, float T::*member, const float def) :
+			name(name), value_type(type::decimal)
+		{
+			this->member.f = member;
+			this->def.f = def;
+		}
+
+		field(const config::key &name, bool T::*member, const bool def) :
+			name(name), value_type(type::boolean)
+		{
+			this->member.b = member;
+			this->def.b = def;
+		}
+
+		field(
+			const config::key &name,
+			std::string T::*member,
+			const char *def
+		) :
+			name(name), value_type(type::string)
+		{
+			this->member.s = member;
+			this->def.s = def;
+		}
+
+		field(
+			const config::key &name,
+			int T::*member,
+			const int def,
+			const char *const *choices
+		) :
+			name(name), value_type(type::choice), choices(choices)
+		{
+			this->member.i = member;
+			this->def.i = def;
+		}
+	};
+
+private:
+	config::key prefix;
+	std::vector<field> fields;
+
+	// Write the default value of a field
+	static void set_default(const field &f, T *out)
+	{
+		switch (f.value_type) {
+		case field::type::integer: out->*f.member.i = f.def.i; break;
+		case field::type::choice:  out->*f.member.i = f.def.i; break;
+		case field::type::decimal: out->*f.member.f = f.def.f; break;
+		case field::type::boolean: out->*f.member.b = f.def.b; break;
+		case field::type::string:  out->*f.member.s = f.def.s; break;
+		}
+	}
+
+	// Parse a value into a field, return false if it's malformed
+	static bool set_value(const field &f, const char *value, T *out)
+	{
+		switch (f.value_type) {
+		case field::type::integer:
+			return config::parse_int(value, &(out->*f.member.i));
+		case field::type::decimal:
+			return config::parse_float(value, &(out->*f.member.f));
+		case field::type::boolean:
+			return config::parse_bool(value, &(out->*f.member.b));
+		case field::type::string:
+			out->*f.member.s = value;
+			return true;
+		case field::type::choice:
+			for (auto i = 0; f.choices[i] != nullptr; i++) {
+				if (strcmp(f.choices[i], value) == 0) {
+					out->*f.member.i = i;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		return false;
+	}
+
+	static const char *type_name(const field &f)
+	{
+		switch (f.value_type) {
+		case field::type::integer: return "an integer";
+		case field::type::decimal: return "a number";
+		case field::type::boolean: return "true or false";
+		case field::type::choice:  return "a valid option";
+		default:                   return "a string";
+		}
+	}
+
+public:
+	// prefix is the namespace including the trailing dot, e.g. "keyboard."
+	config_schema(
+		const config::key &prefix,
+		const std::initializer_list<field> fields
+	) :
+		prefix(prefix), fields(fields)
+	{
+	}
+
+	/**
+	 * bind - Fill a settings struct from a config
+	 * @cfg:		Config object
+	 * @prefix:		Namespace to read, overriding the schema's own
+	 * @out:		Struct to fill
+	 * @diagnostics:	Unknown keys and bad values get appended here,
+	 *			may be null
+	 *
+	 * Set every field to its default, then walk the keys in the namespace
+	 * once and parse each into the field it names.
+	 */
+	void bind(
+		const config &cfg,
+		const config::key &prefix,
+		T *out,
+		std::vector<std::string> *diagnostics) const
+	{
+		for (const auto &f : fields)
+			set_default(f, out);
+
+		cfg.for_each(prefix, [&](
+			const char *name,
+			const size_t name_len,
+			const char *value)
+		{
+			for (const auto &f : fields) {
+				if (f.name.len != name_len
+				 || memcmp(f.name.str, name, name_len) != 0)
+					continue;
+
+				if (!set_value(f, value, out)) {
+					set_default(f, out);
+					if (diagnostics != nullptr) {
+						diagnostics->push_back(
+							std::string(prefix.str, prefix.len) +
+							f.name.str + ": \"" + value +
+							"\" is not " + type_name(f));
+					}
+				}
+
+				return;
+			}
+
+			if (diagnostics != nullptr) {
+				diagnostics->push_back(
+					std::string(prefix.str, prefix.len) +
+					std::string(name, name_len) + ": unknown key");
+			}
+		});
+	}
+
+	void bind(
+		const config &cfg,
+		T *out,
+		std::vector<std::string> *diagnostics) const
+	{
+		bind(cfg, prefix, out, diagnostics);
+	}
+};
\ No newline at end of file
@@ -1,10 +1,21 @@
+#include "../demo_format/demo_info.h"
+#include "../demo_format/demo_reader.h"
+#include "../demo_format/demo_split.h"
+#include "../demo_format/demo_writer.h"
+#include "../demo_format/button_codec.h"
+#include <chrono>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 const char *grades[] = {
 	"9", "8", "7", "6", "5", "4", "3", "2", "1",
@@ -37,41 +48,315 @@ void read_demo(const char *filename, std::insert_iterator<T> inserter)
 	std::string full_path("demos\\");
 	full_path += filename;
 
-	std::ifstream input(full_path);
+	std::ifstream input(full_path, std::ios::binary);
 
-	char target_version;
-	input.read(&target_version, 1);
+	std::vector<demo_game> games;
+	read_demo_info(input, &games);
 
 	auto game_num = 0;
-	while (true) {
+	for (const auto &game : games) {
 		demo_info info;
 		info.filename = filename;
 		info.game_num = game_num++;
+		info.frames_played = game.frames_played;
+		info.mode = game.mode;
+		info.level = game.level;
+		info.grade = game.grade;
+		info.start_frame = game.start_frame;
 
-		input.read(
-				(char*)(&info.frames_played),
-				sizeof(info.frames_played));
+		*inserter = info;
+	}
+}
 
-		if (input.eof())
-			break;
+static const char *stream_names[] = {
+	"buttons",
+	"rng_counts",
+	"rng_values",
+	"sram"
+};
 
-		input.read((char*)(&info.mode), sizeof(info.mode));
-		input.read((char*)(&info.level), sizeof(info.level));
-		input.read(&info.grade, 1);
-		input.read((char*)(&info.start_frame), sizeof(info.start_frame));
+/**
+ * dump_stream - Print one stream of a version 1 demo
+ * @reader:	Opened demo
+ * @stream:	Stream to print
+ *
+ * Only the stream's own chunks are read. Buttons are printed as 1p and 2p
+ * in hex, one frame per line.
+ */
+static void dump_stream(const demo_reader &reader, const demo_stream stream)
+{
+	demo_column column(reader, stream);
+	const auto count = reader.count(stream);
 
-		*inserter = info;
+	for (auto i = 0u; i < count; i++) {
+		if (stream == demo_stream::buttons) {
+			uint32_t state;
+			if (!column.read(&state))
+				break;
+
+			std::cout << i << std::hex << std::setfill('0')
+				<< " " << std::setw(4) << (state & 0xFFFF)
+				<< " " << std::setw(4) << (state >> 16)
+				<< std::dec << std::setfill(' ') << std::endl;
+		} else if (stream == demo_stream::sram) {
+			demo_sram_record record;
+			if (!column.read(&record))
+				break;
+
+			std::cout << i
+				<< " frame " << record.frame
+				<< " size " << record.size
+				<< (record.success ? " ok" : " failed") << std::endl;
+
+			if (record.success)
+				column.skip(record.size);
+		} else {
+			int32_t value;
+			if (!column.read(&value))
+				break;
+
+			std::cout << i << " " << value << std::endl;
+		}
+	}
+}
+
+/**
+ * dump_demo - Print the chunks or a stream of a version 1 demo
+ * @filename:	Demo path
+ * @what:	Stream name, or null for the chunk list
+ */
+static int dump_demo(const char *filename, const char *what)
+{
+	demo_reader reader;
+	if (!reader.open(filename)) {
+		std::cerr << filename << " isn't a version 1 demo" << std::endl;
+		return 1;
+	}
+
+	if (what == nullptr) {
+		if (!reader.complete())
+			std::cout << "no directory, recording was cut short" << std::endl;
+
+		for (const auto &entry : reader.chunk_list()) {
+			std::cout
+				<< stream_names[(int)(entry.chunk.stream)]
+				<< " " << entry.chunk.first
+				<< "+" << entry.chunk.count
+				<< " at " << entry.offset
+				<< ", " << entry.chunk.size << " bytes" << std::endl;
+		}
+
+		return 0;
 	}
+
+	for (auto i = 0; i < (int)(demo_stream::directory); i++) {
+		if (strcmp(what, stream_names[i]) == 0) {
+			dump_stream(reader, (demo_stream)(i));
+			return 0;
+		}
+	}
+
+	std::cerr << "Unknown stream " << what << std::endl;
+	return 1;
+}
+
+/**
+ * bench_codec - Time the button codec on the buttons of some demos
+ * @count:	Number of demos
+ * @filenames:	Version 1 demos
+ *
+ * Frames are encoded a chunk at a time like the recorder does. The ratio
+ * is against 4 bytes per frame, the size of version 0 button records.
+ */
+static int bench_codec(const int count, const char *const filenames[])
+{
+	std::vector<uint32_t> frames;
+	for (auto i = 0; i < count; i++) {
+		demo_reader reader;
+		if (!reader.open(filenames[i])) {
+			std::cerr << filenames[i] << " isn't a version 1 demo" << std::endl;
+			return 1;
+		}
+
+		demo_column column(reader, demo_stream::buttons);
+		const auto start = frames.size();
+		frames.resize(start + reader.count(demo_stream::buttons));
+		if (!column.read(frames.data() + start, (frames.size() - start) * 4)) {
+			std::cerr << filenames[i] << " is damaged" << std::endl;
+			return 1;
+		}
+	}
+
+	if (frames.empty()) {
+		std::cerr << "No frames" << std::endl;
+		return 1;
+	}
+
+	using clock = std::chrono::steady_clock;
+	const auto passes = 20;
+
+	// Encoded size of every chunk
+	std::vector<size_t> chunk_sizes;
+	std::vector<uint8_t> encoded;
+	encoded.reserve(frames.size() * 4);
+
+	const auto encode_start = clock::now();
+	for (auto pass = 0; pass < passes; pass++) {
+		chunk_sizes.clear();
+		encoded.clear();
+
+		button_encoder encoder;
+		auto chunk_start = encoded.size();
+		for (size_t i = 0; i < frames.size(); i++) {
+			encoder.add(frames[i], &encoded);
+			if ((i + 1) % demo_chunk_frames == 0 || i + 1 == frames.size()) {
+				encoder.finish(&encoded);
+				chunk_sizes.push_back(encoded.size() - chunk_start);
+				chunk_start = encoded.size();
+			}
+		}
+	}
+	const auto encode_time = clock::now() - encode_start;
+
+	std::vector<uint32_t> decoded(frames.size());
+	const auto decode_start = clock::now();
+	for (auto pass = 0; pass < passes; pass++) {
+		const auto *in = encoded.data();
+		auto *out = decoded.data();
+		auto left = frames.size();
+		for (const auto size : chunk_sizes) {
+			const auto chunk_frames = std::min<size_t>(left, demo_chunk_frames);
+			if (!decode_buttons(in, size, out, chunk_frames)) {
+				std::cerr << "Decoding failed" << std::endl;
+				return 1;
+			}
+
+			in += size;
+			out += chunk_frames;
+			left -= chunk_frames;
+		}
+	}
+	const auto decode_time = clock::now() - decode_start;
+
+	if (decoded != frames) {
+		std::cerr << "Decoded frames don't match" << std::endl;
+		return 1;
+	}
+
+	const auto total = (double)(frames.size()) * passes;
+	const auto encode_ns = std::chrono::duration<double, std::nano>(encode_time).count();
+	const auto decode_s = std::chrono::duration<double>(decode_time).count();
+
+	std::cout
+		<< frames.size() << " frames, "
+		<< frames.size() * 4 << " bytes raw, "
+		<< encoded.size() << " bytes encoded" << std::endl
+		<< "ratio " << frames.size() * 4. / encoded.size() << std::endl
+		<< "encode " << encode_ns / total << " ns/frame" << std::endl
+		<< "decode " << total * 4 / decode_s / 1e9 << " GB/s" << std::endl;
+
+	return 0;
+}
+
+// Swap a .dem path's extension for .inf
+static std::string info_name(const std::string &filename)
+{
+	const auto dot = filename.rfind('.');
+	return filename.substr(0, dot == std::string::npos ? filename.size() : dot) + ".inf";
+}
+
+/**
+ * split_demo - Copy one game of a session into a demo of its own
+ * @filename:	Version 1 session demo
+ * @game_num:	Game to copy, as listed in the session's .inf
+ * @out_filename:	New demo, its .inf goes next to it
+ *
+ * A demo always plays from boot, so the new one starts with the session's
+ * SRAM reads and every record up to the start of its first game. The
+ * chosen game's records follow, which picks up where that left off as
+ * long as both games were started the same way. The RNG is replayed from
+ * the demo either way, so for game 0 the copy is exact.
+ */
+static int split_demo(const char *filename, const int game_num, const char *out_filename)
+{
+	std::ifstream input(info_name(filename), std::ios::binary);
+	std::vector<demo_game> games;
+	if (read_demo_info(input, &games) < 1) {
+		std::cerr << filename << " has no version 1 .inf" << std::endl;
+		return 1;
+	}
+
+	if (game_num < 0 || game_num >= (int)(games.size())) {
+		std::cerr << "No game " << game_num << " in " << filename << std::endl;
+		return 1;
+	}
+
+	loaded_demo demo;
+	if (!load_demo(filename, &demo)) {
+		std::cerr << filename << " isn't a version 1 demo or is damaged" << std::endl;
+		return 1;
+	}
+
+	const auto &first = games[0];
+	const auto &game = games[game_num];
+
+	demo_game_index preamble;
+	demo_game copy;
+	if (!plan_split(demo, first, game, &preamble, &copy)) {
+		std::cerr << "Game " << game_num << " doesn't fit in " << filename << std::endl;
+		return 1;
+	}
+
+	if (game.mode != first.mode)
+		std::cerr << "Warning: game 0 was a different mode, playback may desync" << std::endl;
+
+	demo_writer output;
+	if (!output.open(out_filename)) {
+		std::cerr << "Couldn't create " << out_filename << std::endl;
+		return 1;
+	}
+
+	copy_range(demo, preamble, &output);
+	copy_range(demo, game.index, &output);
+	output.close();
+
+	std::ofstream out_info(info_name(out_filename), std::ios::binary);
+	out_info.write(&demo_info_version, 1);
+	write_demo_game(out_info, copy);
+
+	std::cout << "Game " << game_num << ": "
+		<< copy.index.end_frame << " frames, "
+		<< copy.index.end_rng << " RNG calls, "
+		<< copy.index.end_sram << " SRAM reads" << std::endl;
+
+	return out_info.good() ? 0 : 1;
 }
 
 /**
  * main - Entry point
+ * @argc:	Command line argument count
+ * @argv:	Array of command line arguments
+ *
+ * demo_dump			List the games in every demo
+ * demo_dump <file> [stream]	Print the chunks or a stream of a demo
+ * demo_dump bench <file>...	Time the button codec on some demos
+ * demo_dump split <file> <game> <out>	Copy one game into a demo of its own
  *
  * Loop over the demos directory with the disgusting Windows API and pass every
  * file in it to read_demo.
  */
-int main()
+int main(const int argc, const char *argv[])
 {
+	if (argc >= 3 && strcmp(argv[1], "bench") == 0)
+		return bench_codec(argc - 2, argv + 2);
+
+	if (argc == 5 && strcmp(argv[1], "split") == 0)
+		return split_demo(argv[2], atoi(argv[3]), argv[4]);
+
+	if (argc >= 2)
+		return dump_demo(argv[1], argc >= 3 ? argv[2] : nullptr);
+
+#ifdef _WIN32
 	std::vector<demo_info> demos;
 
 	WIN32_FIND_DATA find_data;
@@ -135,4 +420,8 @@ int main()
 
 	FindClose(find_handle);
 	return 0;
+#else
+	std::cerr << "demo_dump <file> [stream]" << std::endl;
+	return 1;
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,139 @@
+#include "background_writer.h"
+#include <chrono>
+#include <cstring>
+
+// How long the writer thread sleeps between drains
+static const std::chrono::milliseconds drain_interval(4);
+
+bool background_demo_writer::open(
+	const std::string &filename,
+	const settings &new_timing
+) {
+	if (!writer.open(filename))
+		return false;
+
+	ring.reset(new record[capacity]);
+	timing = new_timing;
+	stopping.store(false, std::memory_order_relaxed);
+	thread = std::thread(&background_demo_writer::run, this);
+
+	return true;
+}
+
+/**
+ * push - Queue a record for the writer thread
+ * @entry:	Record, data is owned by the ring from here on
+ *
+ * Recording thread only.
+ */
+void background_demo_writer::push(const record &entry)
+{
+	const auto next = head.load(std::memory_order_relaxed);
+	auto pending = next - tail.load(std::memory_order_acquire);
+
+	if (pending == capacity) {
+		counters.overflows++;
+		do {
+			std::this_thread::yield();
+			pending = next - tail.load(std::memory_order_acquire);
+		} while (pending == capacity);
+	}
+
+	if (pending + 1 > counters.max_pending)
+		counters.max_pending = pending + 1;
+
+	ring[next & (capacity - 1)] = entry;
+	head.store(next + 1, std::memory_order_release);
+}
+
+void background_demo_writer::add_sram(
+	const bool success,
+	const void *data,
+	const uint32_t size
+) {
+	// Only a few reads a session, copying them is fine
+	record entry = { record_type::sram_failed, size, nullptr };
+	if (success) {
+		entry.type = record_type::sram_ok;
+		entry.data = new char[size];
+		memcpy(entry.data, data, size);
+	}
+
+	push(entry);
+}
+
+// Hand every queued record to the demo_writer
+void background_demo_writer::drain()
+{
+	const auto end = head.load(std::memory_order_acquire);
+	auto next = tail.load(std::memory_order_relaxed);
+
+	for (; next != end; next++) {
+		auto &entry = ring[next & (capacity - 1)];
+		switch (entry.type) {
+		case record_type::frame:
+			writer.add_frame(entry.value);
+			break;
+
+		case record_type::random:
+			writer.add_random((int32_t)(entry.value));
+			break;
+
+		case record_type::sram_ok:
+			writer.add_sram(true, entry.data, entry.value);
+			delete[] entry.data;
+			entry.data = nullptr;
+			break;
+
+		case record_type::sram_failed:
+			writer.add_sram(false, nullptr, entry.value);
+			break;
+		}
+
+		tail.store(next + 1, std::memory_order_release);
+	}
+}
+
+/**
+ * run - Writer thread
+ *
+ * Drain the ring, then flush and sync when they're due.
+ */
+void background_demo_writer::run()
+{
+	using clock = std::chrono::steady_clock;
+	auto last_flush = clock::now();
+	auto last_sync = last_flush;
+
+	while (!stopping.load(std::memory_order_acquire)) {
+		drain();
+
+		const auto now = clock::now();
+		if (timing.sync_ms > 0
+		 && now - last_sync >= std::chrono::milliseconds(timing.sync_ms)) {
+			writer.flush(true);
+			last_sync = now;
+			last_flush = now;
+		} else if (timing.flush_ms > 0
+			&& now - last_flush >= std::chrono::milliseconds(timing.flush_ms)) {
+			writer.flush(false);
+			last_flush = now;
+		}
+
+		std::this_thread::sleep_for(drain_interval);
+	}
+}
+
+void background_demo_writer::close()
+{
+	if (!writer.is_open())
+		return;
+
+	if (thread.joinable()) {
+		stopping.store(true, std::memory_order_release);
+		thread.join();
+	}
+
+	drain();
+	writer.close();
+}
\ No newline at end of file
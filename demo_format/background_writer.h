@@ -0,0 +1,128 @@
+#pragma once
+
+#include "demo_writer.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+/*
+ * A demo_writer on a thread of its own, so the thread recording the demo
+ * never waits on the file. Records go through a single producer single
+ * consumer ring that the writer thread drains every few milliseconds,
+ * and the file gets its data in big batches.
+ *
+ * If the writer falls so far behind that the ring fills up, the recording
+ * thread waits for space rather than lose records, and the wait is
+ * counted so it can be reported.
+ */
+class background_demo_writer {
+public:
+	// Records the ring holds by default, several minutes of play
+	static const uint32_t default_capacity = 16384;
+
+	struct settings {
+		// How often buffered data is handed to the OS, 0 for only on close
+		int flush_ms;
+
+		// How often the OS is made to write it to disk, 0 for never
+		int sync_ms;
+	};
+
+	// Recording thread counters
+	struct stats {
+		// Times a record had to wait for space
+		uint32_t overflows = 0;
+
+		// Most records waiting at once
+		uint32_t max_pending = 0;
+	};
+
+private:
+	enum class record_type : uint32_t {
+		frame,
+		random,
+		sram_ok,
+		sram_failed
+	};
+
+	struct record {
+		record_type type;
+
+		// Buttons, RNG result or SRAM size
+		uint32_t value;
+
+		// Copy of the SRAM data, freed by the writer thread
+		char *data;
+	};
+
+	// Records pushed, written by the recording thread
+	std::atomic<uint32_t> head;
+	uint8_t pad0[60];
+
+	// Records written, written by the writer thread
+	std::atomic<uint32_t> tail;
+	uint8_t pad1[60];
+
+	// Records the ring holds, a power of two so indexes wrap with head
+	const uint32_t capacity;
+	std::unique_ptr<record[]> ring;
+
+	demo_writer writer;
+	settings timing = {};
+	std::thread thread;
+	std::atomic<bool> stopping;
+
+	stats counters;
+
+	void push(const record &entry);
+	void drain();
+	void run();
+
+public:
+	explicit background_demo_writer(const uint32_t capacity = default_capacity) :
+		head(0),
+		tail(0),
+		capacity(capacity),
+		stopping(false)
+	{
+	}
+
+	background_demo_writer(const background_demo_writer&) = delete;
+	background_demo_writer &operator=(const background_demo_writer&) = delete;
+
+	~background_demo_writer()
+	{
+		close();
+	}
+
+	// Create the file and start the writer thread, false on failure
+	bool open(const std::string &filename, const settings &new_timing);
+
+	void add_frame(uint32_t packed_buttons)
+	{
+		push({ record_type::frame, packed_buttons, nullptr });
+	}
+
+	void add_random(int32_t value)
+	{
+		push({ record_type::random, (uint32_t)(value), nullptr });
+	}
+
+	void add_sram(bool success, const void *data, uint32_t size);
+
+	/**
+	 * close - Stop the writer thread and finish the file
+	 *
+	 * Whatever the thread didn't get to is written from the calling
+	 * thread, which is also what happens if the thread is already gone
+	 * because the process is exiting.
+	 */
+	void close();
+
+	const stats &recording_stats() const
+	{
+		return counters;
+	}
+};
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "button_codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BUTTON_CODEC_SSE2
+#endif
+
+static void write_varint(uint32_t value, std::vector<uint8_t> *out)
+{
+	while (value >= 0x80) {
+		out->push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+
+	out->push_back((uint8_t)(value));
+}
+
+/**
+ * read_varint - Read a LEB128 value
+ * @data:	Position in the input, moved past the value
+ * @end:	End of the input
+ * @value:	Output
+ *
+ * Returns false if the input ends first or the value doesn't fit.
+ */
+static bool read_varint(const uint8_t **data, const uint8_t *end, uint32_t *value)
+{
+	uint32_t result = 0;
+	for (auto shift = 0; shift < 35; shift += 7) {
+		if (*data == end)
+			return false;
+
+		// The fifth byte only has room for the top 4 bits
+		const auto byte = *(*data)++;
+		if (shift == 28 && (byte & 0x70) != 0)
+			return false;
+
+		result |= (uint32_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void button_encoder::write_run(std::vector<uint8_t> *out)
+{
+	write_varint(current ^ previous, out);
+	write_varint(held - 1, out);
+	previous = current;
+}
+
+void button_encoder::finish(std::vector<uint8_t> *out)
+{
+	if (held != 0)
+		write_run(out);
+
+	current = 0;
+	previous = 0;
+	held = 0;
+}
+
+// Write word count times, runs are usually long enough for SIMD to pay off
+static void fill_run(uint32_t *out, const uint32_t word, size_t count)
+{
+#ifdef BUTTON_CODEC_SSE2
+	const auto words = _mm_set1_epi32((int)(word));
+	for (; count >= 4; count -= 4, out += 4)
+		_mm_storeu_si128((__m128i*)(out), words);
+#endif
+
+	for (; count != 0; count--)
+		*out++ = word;
+}
+
+bool decode_buttons(
+	const uint8_t *data,
+	const size_t size,
+	uint32_t *out,
+	size_t count
+) {
+	const auto *end = data + size;
+	uint32_t word = 0;
+
+	while (data != end) {
+		uint32_t delta;
+		uint32_t extra;
+		if (!read_varint(&data, end, &delta)
+		 || !read_varint(&data, end, &extra)
+		 || extra >= count)
+			return false;
+
+		word ^= delta;
+		fill_run(out, word, extra + 1);
+		out += extra + 1;
+		count -= extra + 1;
+	}
+
+	return count == 0;
+}
\ No newline at end of file
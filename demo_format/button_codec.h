@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Run length coding for packed button words, demo_encoding::runs. Buttons
+ * stay the same for most frames, so a stream is stored as runs: the XOR of
+ * the run's word with the previous run's word, then the run's length minus
+ * one, both as LEB128 varints. The word before the first run is 0.
+ *
+ * A frame that doesn't change anything costs nothing until its run ends,
+ * and a single button press or release costs 2 or 3 bytes.
+ */
+class button_encoder {
+	// Word of the run being built and the run before it
+	uint32_t current = 0;
+	uint32_t previous = 0;
+
+	// Frames in the run being built, 0 before the first word
+	uint32_t held = 0;
+
+	void write_run(std::vector<uint8_t> *out);
+
+public:
+	// Add a frame, a finished run gets appended to out
+	void add(const uint32_t word, std::vector<uint8_t> *out)
+	{
+		if (held != 0 && word == current) {
+			held++;
+			return;
+		}
+
+		if (held != 0)
+			write_run(out);
+
+		current = word;
+		held = 1;
+	}
+
+	// Append the run being built and start over from a 0 word
+	void finish(std::vector<uint8_t> *out);
+};
+
+/**
+ * decode_buttons - Decode runs into button words
+ * @data:	Encoded runs
+ * @size:	Size of data
+ * @out:	Output words
+ * @count:	Number of words expected
+ *
+ * Returns false if the runs don't add up to exactly count words.
+ */
+bool decode_buttons(const uint8_t *data, size_t size, uint32_t *out, size_t count);
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Demo file layout from version 1 on. Version 0 demos are a single stream
+ * of button words, RNG results and SRAM blobs in the order the game asked
+ * for them, which can only be parsed by running the game.
+ *
+ * Version 1 keeps each kind of record in a stream of its own. A file is a
+ * demo_header followed by chunks, each a demo_chunk and its payload, and
+ * the payloads of every chunk of a stream in file order make up that
+ * stream. Once recording ends a directory chunk listing every other chunk
+ * is appended, followed by a demo_trailer that points at it. A file cut
+ * short by a crash has no trailer, its chunks are found by walking them
+ * from the header instead.
+ *
+ * Little endian structs with explicit padding, which every target is.
+ */
+
+static const uint32_t demo_magic = 0x44334754; // "TG3D"
+static const uint32_t demo_trailer_magic = 0x45334754; // "TG3E"
+static const uint16_t demo_version = 1;
+
+// Frames in each full chunk of the per frame streams
+static const uint32_t demo_chunk_frames = 1024;
+
+// RNG results in each full chunk of rng_values
+static const uint32_t demo_chunk_calls = 1024;
+
+enum class demo_stream : uint16_t {
+	// uint32_t per frame, 1p in the low half and 2p in the high half,
+	// stored as runs
+	buttons,
+
+	// uint32_t per frame, RNG calls made since the previous frame's JVS
+	// poll. Calls after the last poll aren't counted anywhere.
+	rng_counts,
+
+	// int32_t per RNG call
+	rng_values,
+
+	// demo_sram_record per SRAM read, each followed by size bytes of data
+	// if it succeeded
+	sram,
+
+	// demo_directory_entry per chunk of the other streams
+	directory,
+
+	count
+};
+
+// How a chunk's payload is stored
+enum class demo_encoding : uint16_t {
+	raw,
+
+	// Button words run length coded, see button_codec.h
+	runs
+};
+
+struct demo_header {
+	uint32_t magic;
+	uint16_t version;
+
+	// Chunks start here, later versions may add fields before them
+	uint16_t header_size;
+};
+
+struct demo_chunk {
+	demo_stream stream;
+	demo_encoding encoding;
+
+	// Index of the chunk's first item in its stream, and item count. Items
+	// are frames, RNG calls, SRAM reads or directory entries.
+	uint32_t first;
+	uint32_t count;
+
+	// Payload bytes after this header
+	uint32_t size;
+};
+
+struct demo_directory_entry {
+	demo_chunk chunk;
+
+	// File offset of the payload
+	uint64_t offset;
+};
+
+struct demo_trailer {
+	uint32_t magic;
+	uint32_t pad;
+
+	// File offset of the directory chunk's header
+	uint64_t directory;
+};
+
+struct demo_sram_record {
+	// Frames recorded before the read
+	uint32_t frame;
+
+	// Size the game asked for
+	uint32_t size;
+
+	uint8_t success;
+	uint8_t pad[3];
+};
+
+static_assert(sizeof(demo_header) == 8, "demo_header has padding");
+static_assert(sizeof(demo_chunk) == 16, "demo_chunk has padding");
+static_assert(sizeof(demo_directory_entry) == 24, "demo_directory_entry has padding");
+static_assert(sizeof(demo_trailer) == 16, "demo_trailer has padding");
+static_assert(sizeof(demo_sram_record) == 12, "demo_sram_record has padding");
\ No newline at end of file
@@ -0,0 +1,39 @@
+#include "demo_info.h"
+
+int read_demo_info(std::istream &input, std::vector<demo_game> *games)
+{
+	char version;
+	if (!input.read(&version, 1))
+		return -1;
+
+	while (true) {
+		demo_game game = {};
+		input.read((char*)(&game.frames_played), sizeof(game.frames_played));
+		input.read((char*)(&game.mode), sizeof(game.mode));
+		input.read((char*)(&game.level), sizeof(game.level));
+		input.read(&game.grade, 1);
+		input.read((char*)(&game.start_frame), sizeof(game.start_frame));
+
+		if (version >= 1) {
+			input.read((char*)(&game.index), sizeof(game.index));
+			game.has_index = true;
+		}
+
+		if (!input.good())
+			break;
+
+		games->push_back(game);
+	}
+
+	return version;
+}
+
+void write_demo_game(std::ostream &output, const demo_game &game)
+{
+	output.write((char*)(&game.frames_played), sizeof(game.frames_played));
+	output.write((char*)(&game.mode), sizeof(game.mode));
+	output.write((char*)(&game.level), sizeof(game.level));
+	output.write(&game.grade, 1);
+	output.write((char*)(&game.start_frame), sizeof(game.start_frame));
+	output.write((const char*)(&game.index), sizeof(game.index));
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Info files list the games played in a demo. They start with a version
+ * byte followed by a record per game, written on game over. Records are
+ * packed with no padding:
+ *
+ * int frames_played, short mode, short level, char grade, int start_frame
+ *
+ * From version 1 on each record is followed by a demo_game_index.
+ */
+static const char demo_info_version = 1;
+
+/*
+ * Where a game starts and ends in each stream of its version 1 demo, as
+ * item indices. A start is the first item after the game's first frame
+ * began, an end is one past the game's last item. Byte offsets into a
+ * stream follow from these, the fixed size streams directly and the rest
+ * from their chunks.
+ */
+struct demo_game_index {
+	uint32_t start_frame;
+	uint32_t end_frame;
+	uint32_t start_rng;
+	uint32_t end_rng;
+	uint32_t start_sram;
+	uint32_t end_sram;
+};
+
+static_assert(sizeof(demo_game_index) == 24, "demo_game_index has padding");
+
+struct demo_game {
+	int frames_played;
+	short mode;
+	short level;
+	char grade;
+
+	// Game frame counter when the game started, not a demo frame
+	int start_frame;
+
+	bool has_index;
+	demo_game_index index;
+};
+
+/**
+ * read_demo_info - Read every game in an info file
+ * @input:	Info file opened in binary mode
+ * @games:	Output games
+ *
+ * Returns the file's version, or -1 if it's empty. A record cut short ends
+ * the list.
+ */
+int read_demo_info(std::istream &input, std::vector<demo_game> *games);
+
+// Append a game's record in the current version
+void write_demo_game(std::ostream &output, const demo_game &game);
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "demo_map.h"
+#include "button_codec.h"
+#include <algorithm>
+
+bool mapped_stream::read_slow(void *out, size_t size)
+{
+	auto *dest = (uint8_t*)(out);
+	while (size != 0) {
+		if (pos == end) {
+			if (next_span == spans.size())
+				return false;
+
+			pos = spans[next_span].begin;
+			end = spans[next_span].end;
+			next_span++;
+			continue;
+		}
+
+		const auto part = std::min(size, (size_t)(end - pos));
+		memcpy(dest, pos, part);
+		dest += part;
+		pos += part;
+		size -= part;
+	}
+
+	return true;
+}
+
+bool mapped_stream::skip(size_t size)
+{
+	while (size != 0) {
+		if (pos == end) {
+			if (next_span == spans.size())
+				return false;
+
+			pos = spans[next_span].begin;
+			end = spans[next_span].end;
+			next_span++;
+			continue;
+		}
+
+		const auto part = std::min(size, (size_t)(end - pos));
+		pos += part;
+		size -= part;
+	}
+
+	return true;
+}
+
+bool map_stream(
+	const mapped_file &file,
+	const demo_reader &reader,
+	const demo_stream stream,
+	std::vector<uint32_t> *decoded,
+	mapped_stream *out
+) {
+	// Sized up front so spans into it stay valid
+	size_t decoded_size = 0;
+	for (const auto &entry : reader.chunk_list()) {
+		if (entry.chunk.stream == stream
+		 && entry.chunk.encoding == demo_encoding::runs)
+			decoded_size += entry.chunk.count;
+	}
+
+	decoded->assign(decoded_size, 0);
+
+	auto *next_decoded = decoded->data();
+	for (const auto &entry : reader.chunk_list()) {
+		if (entry.chunk.stream != stream)
+			continue;
+
+		if (entry.offset + entry.chunk.size > file.size())
+			return false;
+
+		const auto *payload = file.data() + entry.offset;
+		switch (entry.chunk.encoding) {
+		case demo_encoding::raw:
+			out->add(payload, entry.chunk.size);
+			break;
+
+		case demo_encoding::runs:
+			if (!decode_buttons(payload, entry.chunk.size, next_decoded, entry.chunk.count))
+				return false;
+
+			out->add(
+				(const uint8_t*)(next_decoded),
+				entry.chunk.count * sizeof(uint32_t));
+
+			next_decoded += entry.chunk.count;
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+class win32_mapped_file : public mapped_file {
+	HANDLE file;
+	HANDLE section;
+	const uint8_t *view;
+	size_t length;
+
+public:
+	win32_mapped_file(
+		const HANDLE file,
+		const HANDLE section,
+		const uint8_t *view,
+		const size_t length
+	) :
+		file(file),
+		section(section),
+		view(view),
+		length(length)
+	{
+	}
+
+	~win32_mapped_file() override
+	{
+		UnmapViewOfFile(view);
+		CloseHandle(section);
+		CloseHandle(file);
+	}
+
+	const uint8_t *data() const override
+	{
+		return view;
+	}
+
+	size_t size() const override
+	{
+		return length;
+	}
+};
+
+std::unique_ptr<mapped_file> map_file(const std::string &filename)
+{
+	const auto file = CreateFile(
+		filename.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)
+	 || size.QuadPart == 0
+	 || (uint64_t)(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	const auto section = CreateFileMapping(
+		file,
+		nullptr,
+		PAGE_READONLY,
+		0,
+		0,
+		nullptr);
+
+	if (section == nullptr) {
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	const auto *view = (const uint8_t*)(MapViewOfFile(
+		section,
+		FILE_MAP_READ,
+		0,
+		0,
+		0));
+
+	if (view == nullptr) {
+		CloseHandle(section);
+		CloseHandle(file);
+		return nullptr;
+	}
+
+	return std::unique_ptr<mapped_file>(new win32_mapped_file(
+		file, section, view, (size_t)(size.QuadPart)));
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class posix_mapped_file : public mapped_file {
+	const uint8_t *view;
+	size_t length;
+
+public:
+	posix_mapped_file(const uint8_t *view, const size_t length) :
+		view(view),
+		length(length)
+	{
+	}
+
+	~posix_mapped_file() override
+	{
+		munmap((void*)(view), length);
+	}
+
+	const uint8_t *data() const override
+	{
+		return view;
+	}
+
+	size_t size() const override
+	{
+		return length;
+	}
+};
+
+std::unique_ptr<mapped_file> map_file(const std::string &filename)
+{
+	const auto fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return nullptr;
+
+	struct stat info;
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	const auto length = (size_t)(info.st_size);
+	auto *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (view == MAP_FAILED)
+		return nullptr;
+
+	madvise(view, length, MADV_SEQUENTIAL);
+
+	return std::unique_ptr<mapped_file>(
+		new posix_mapped_file((const uint8_t*)(view), length));
+}
+
+#endif
\ No newline at end of file
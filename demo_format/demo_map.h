@@ -0,0 +1,87 @@
+#pragma once
+
+#include "demo_reader.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read only view of a whole file
+class mapped_file {
+public:
+	virtual ~mapped_file() = default;
+
+	virtual const uint8_t *data() const = 0;
+	virtual size_t size() const = 0;
+};
+
+// Map a file into memory, null if it can't be opened or is empty
+std::unique_ptr<mapped_file> map_file(const std::string &filename);
+
+/*
+ * Records read straight out of memory, from a list of spans that follow
+ * each other. Reading within a span is a bounds check and a copy, the
+ * spans aren't owned.
+ */
+class mapped_stream {
+	struct span {
+		const uint8_t *begin;
+		const uint8_t *end;
+	};
+
+	std::vector<span> spans;
+	size_t next_span = 0;
+
+	const uint8_t *pos = nullptr;
+	const uint8_t *end = nullptr;
+
+	bool read_slow(void *out, size_t size);
+
+public:
+	// Append a span, before reading starts
+	void add(const uint8_t *data, size_t size)
+	{
+		spans.push_back({ data, data + size });
+	}
+
+	// Read the next size bytes, false if the stream ends first
+	bool read(void *out, const size_t size)
+	{
+		if ((size_t)(end - pos) < size)
+			return read_slow(out, size);
+
+		memcpy(out, pos, size);
+		pos += size;
+		return true;
+	}
+
+	template<typename T>
+	bool read(T *out)
+	{
+		return read(out, sizeof(T));
+	}
+
+	// Skip the next size bytes, false if the stream ends first
+	bool skip(size_t size);
+};
+
+/**
+ * map_stream - Set up a stream of a mapped version 1 demo
+ * @file:	Mapped demo
+ * @reader:	The same demo's chunks
+ * @stream:	Stream to read
+ * @decoded:	Storage for encoded chunks, must outlive out
+ * @out:	Empty stream to fill in
+ *
+ * Raw chunks are read in place. Encoded ones are decoded into decoded all
+ * at once, which is fast enough for button runs. Returns false if a chunk
+ * can't be decoded.
+ */
+bool map_stream(
+	const mapped_file &file,
+	const demo_reader &reader,
+	demo_stream stream,
+	std::vector<uint32_t> *decoded,
+	mapped_stream *out);
\ No newline at end of file
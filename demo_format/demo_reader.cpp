@@ -0,0 +1,233 @@
+#include "demo_reader.h"
+#include "button_codec.h"
+#include <algorithm>
+#include <cstring>
+
+bool demo_reader::is_demo(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	demo_header header = {};
+	file.read((char*)(&header), sizeof(header));
+	return file.good() && header.magic == demo_magic;
+}
+
+bool demo_reader::open(const std::string &filename)
+{
+	this->filename = filename;
+	chunks.clear();
+	has_directory = false;
+
+	std::ifstream file(filename, std::ios::binary);
+	demo_header header = {};
+	file.read((char*)(&header), sizeof(header));
+	if (!file.good()
+	 || header.magic != demo_magic
+	 || header.version < 1
+	 || header.header_size < sizeof(header))
+		return false;
+
+	file.seekg(0, std::ios::end);
+	const auto file_size = (uint64_t)(file.tellg());
+
+	if (read_directory(&file, file_size))
+		has_directory = true;
+	else
+		scan_chunks(&file, file_size, header.header_size);
+
+	return true;
+}
+
+/**
+ * read_directory - Load the chunk list from the end of the file
+ * @file:	Open demo
+ * @file_size:	Size of the demo
+ *
+ * Returns false if there's no valid trailer and directory.
+ */
+bool demo_reader::read_directory(std::ifstream *file, const uint64_t file_size)
+{
+	if (file_size < sizeof(demo_header) + sizeof(demo_chunk) + sizeof(demo_trailer))
+		return false;
+
+	demo_trailer trailer;
+	file->seekg(file_size - sizeof(trailer));
+	file->read((char*)(&trailer), sizeof(trailer));
+
+	// Offsets are checked against what's left so a bad one can't wrap
+	const auto end = file_size - sizeof(trailer);
+	if (!file->good()
+	 || trailer.magic != demo_trailer_magic
+	 || trailer.directory > end - sizeof(demo_chunk))
+		return false;
+
+	demo_chunk chunk;
+	file->seekg(trailer.directory);
+	file->read((char*)(&chunk), sizeof(chunk));
+	if (!file->good()
+	 || chunk.stream != demo_stream::directory
+	 || chunk.size != (uint64_t)(chunk.count) * sizeof(demo_directory_entry)
+	 || chunk.size > end - sizeof(chunk) - trailer.directory)
+		return false;
+
+	chunks.resize(chunk.count);
+	file->read((char*)(chunks.data()), chunk.size);
+	if (!file->good()) {
+		chunks.clear();
+		return false;
+	}
+
+	for (const auto &entry : chunks) {
+		if (entry.chunk.stream >= demo_stream::directory
+		 || entry.chunk.size > trailer.directory
+		 || entry.offset > trailer.directory - entry.chunk.size) {
+			chunks.clear();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * scan_chunks - Find chunks by walking the file
+ * @file:	Open demo
+ * @file_size:	Size of the demo
+ * @start:	Offset of the first chunk
+ *
+ * Stops at the first chunk that doesn't fit, which is where recording
+ * stopped.
+ */
+void demo_reader::scan_chunks(
+	std::ifstream *file,
+	const uint64_t file_size,
+	uint64_t start
+) {
+	file->clear();
+
+	while (start + sizeof(demo_chunk) <= file_size) {
+		demo_directory_entry entry = {};
+		file->seekg(start);
+		file->read((char*)(&entry.chunk), sizeof(entry.chunk));
+		entry.offset = start + sizeof(entry.chunk);
+
+		if (!file->good()
+		 || entry.chunk.stream >= demo_stream::count
+		 || entry.offset + entry.chunk.size > file_size)
+			return;
+
+		if (entry.chunk.stream != demo_stream::directory)
+			chunks.push_back(entry);
+
+		start = entry.offset + entry.chunk.size;
+	}
+}
+
+uint32_t demo_reader::count(const demo_stream stream) const
+{
+	uint32_t total = 0;
+	for (const auto &entry : chunks) {
+		if (entry.chunk.stream == stream)
+			total += entry.chunk.count;
+	}
+
+	return total;
+}
+
+demo_column::demo_column(const demo_reader &reader, const demo_stream stream) :
+	file(reader.file_name(), std::ios::binary)
+{
+	for (const auto &entry : reader.chunk_list()) {
+		if (entry.chunk.stream == stream)
+			chunks.push_back(entry);
+	}
+}
+
+/**
+ * enter_chunk - Move to the stream's next chunk
+ *
+ * Returns false at the end of the stream or if the chunk can't be decoded.
+ */
+bool demo_column::enter_chunk()
+{
+	if (next_chunk == chunks.size())
+		return false;
+
+	const auto &chunk = chunks[next_chunk].chunk;
+	file.seekg(chunks[next_chunk].offset);
+	next_chunk++;
+
+	decoded.clear();
+	decoded_pos = 0;
+
+	if (chunk.encoding == demo_encoding::raw) {
+		chunk_left = chunk.size;
+		return true;
+	}
+
+	if (chunk.encoding != demo_encoding::runs)
+		return false;
+
+	std::vector<uint8_t> encoded(chunk.size);
+	file.read((char*)(encoded.data()), encoded.size());
+	decoded.resize(chunk.count);
+	if (!file.good()
+	 || !decode_buttons(encoded.data(), encoded.size(), decoded.data(), decoded.size())) {
+		decoded.clear();
+		return false;
+	}
+
+	chunk_left = decoded.size() * sizeof(decoded[0]);
+	return true;
+}
+
+bool demo_column::read(void *out, size_t size)
+{
+	auto *dest = (char*)(out);
+	while (size != 0) {
+		if (chunk_left == 0) {
+			if (!enter_chunk())
+				return false;
+
+			continue;
+		}
+
+		const auto part = (size_t)(std::min<uint64_t>(size, chunk_left));
+		if (!decoded.empty()) {
+			memcpy(dest, (const char*)(decoded.data()) + decoded_pos, part);
+			decoded_pos += part;
+		} else {
+			file.read(dest, part);
+			if (!file.good())
+				return false;
+		}
+
+		dest += part;
+		size -= part;
+		chunk_left -= part;
+	}
+
+	return true;
+}
+
+bool demo_column::skip(uint64_t size)
+{
+	while (size != 0) {
+		if (chunk_left == 0) {
+			if (!enter_chunk())
+				return false;
+
+			continue;
+		}
+
+		const auto part = std::min(size, chunk_left);
+		if (!decoded.empty())
+			decoded_pos += (size_t)(part);
+		else
+			file.seekg(part, std::ios::cur);
+
+		size -= part;
+		chunk_left -= part;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "demo_format.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Finds the chunks of a version 1 demo. The streams themselves are read
+ * with a demo_column each, so any of them can be read without touching
+ * the others.
+ */
+class demo_reader {
+	std::string filename;
+	std::vector<demo_directory_entry> chunks;
+	bool has_directory = false;
+
+	bool read_directory(std::ifstream *file, uint64_t file_size);
+	void scan_chunks(std::ifstream *file, uint64_t file_size, uint64_t start);
+
+public:
+	// Whether a file starts like a version 1 demo
+	static bool is_demo(const std::string &filename);
+
+	// Read the header and find every chunk, false if it's not a demo
+	bool open(const std::string &filename);
+
+	const std::string &file_name() const
+	{
+		return filename;
+	}
+
+	// Every chunk except the directory, in file order
+	const std::vector<demo_directory_entry> &chunk_list() const
+	{
+		return chunks;
+	}
+
+	// False if the chunks had to be found by walking the file
+	bool complete() const
+	{
+		return has_directory;
+	}
+
+	// Items in a stream
+	uint32_t count(demo_stream stream) const;
+};
+
+/*
+ * One stream of a demo read front to back as a run of bytes, with a file
+ * handle of its own. Encoded chunks are decoded a chunk at a time.
+ */
+class demo_column {
+	std::ifstream file;
+	std::vector<demo_directory_entry> chunks;
+	size_t next_chunk = 0;
+
+	// Bytes left in the current chunk
+	uint64_t chunk_left = 0;
+
+	// The current chunk if it's encoded, empty if it's read from the file
+	std::vector<uint32_t> decoded;
+	size_t decoded_pos = 0;
+
+	bool enter_chunk();
+
+public:
+	demo_column(const demo_reader &reader, demo_stream stream);
+
+	// Read the next size bytes, false if the stream ends first
+	bool read(void *out, size_t size);
+
+	template<typename T>
+	bool read(T *out)
+	{
+		return read(out, sizeof(T));
+	}
+
+	// Skip the next size bytes, false if the stream ends first
+	bool skip(uint64_t size);
+};
\ No newline at end of file
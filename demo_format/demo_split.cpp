@@ -0,0 +1,121 @@
+#include "demo_split.h"
+#include "demo_reader.h"
+#include <algorithm>
+
+bool load_demo(const std::string &filename, loaded_demo *out)
+{
+	demo_reader reader;
+	if (!reader.open(filename))
+		return false;
+
+	const auto frames = reader.count(demo_stream::buttons);
+	out->buttons.resize(frames);
+	demo_column buttons(reader, demo_stream::buttons);
+	if (!buttons.read(out->buttons.data(), frames * 4))
+		return false;
+
+	out->rng_before.resize(frames);
+	demo_column counts(reader, demo_stream::rng_counts);
+	if (reader.count(demo_stream::rng_counts) != frames
+	 || !counts.read(out->rng_before.data(), frames * 4))
+		return false;
+
+	uint32_t calls = 0;
+	for (auto &count : out->rng_before) {
+		calls += count;
+		count = calls;
+	}
+
+	out->rng_values.resize(reader.count(demo_stream::rng_values));
+	demo_column values(reader, demo_stream::rng_values);
+	if (out->rng_values.size() < calls
+	 || !values.read(out->rng_values.data(), out->rng_values.size() * 4))
+		return false;
+
+	out->sram.resize(reader.count(demo_stream::sram));
+	demo_column sram(reader, demo_stream::sram);
+	for (auto &read : out->sram) {
+		if (!sram.read(&read.record))
+			return false;
+
+		if (read.record.success) {
+			read.data.resize(read.record.size);
+			if (!sram.read(read.data.data(), read.data.size()))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+void copy_range(
+	const loaded_demo &demo,
+	const demo_game_index &range,
+	demo_writer *output
+) {
+	auto rng = range.start_rng;
+	auto sram = range.start_sram;
+
+	for (auto frame = range.start_frame; frame < range.end_frame; frame++) {
+		const auto rng_end = std::min(demo.rng_before[frame], range.end_rng);
+		for (; rng < rng_end; rng++)
+			output->add_random(demo.rng_values[rng]);
+
+		for (; sram < range.end_sram && demo.sram[sram].record.frame <= frame; sram++) {
+			const auto &read = demo.sram[sram];
+			output->add_sram(read.record.success != 0, read.data.data(), read.record.size);
+		}
+
+		output->add_frame(demo.buttons[frame]);
+	}
+
+	// The game's last RNG calls and SRAM reads come after its last poll
+	for (; rng < range.end_rng; rng++)
+		output->add_random(demo.rng_values[rng]);
+
+	for (; sram < range.end_sram; sram++) {
+		const auto &read = demo.sram[sram];
+		output->add_sram(read.record.success != 0, read.data.data(), read.record.size);
+	}
+}
+
+bool plan_split(
+	const loaded_demo &demo,
+	const demo_game &first,
+	const demo_game &game,
+	demo_game_index *preamble,
+	demo_game *copy
+) {
+	// Everything before the first game, including the SRAM reads at boot
+	*preamble = demo_game_index();
+	preamble->end_frame = first.index.start_frame;
+	preamble->end_rng = first.index.start_rng;
+	preamble->end_sram = first.index.start_sram;
+
+	const auto fits = [&demo](const demo_game_index &range)
+	{
+		return range.start_frame <= range.end_frame
+		    && range.end_frame <= demo.buttons.size()
+		    && range.start_rng <= range.end_rng
+		    && range.end_rng <= demo.rng_values.size()
+		    && range.start_sram <= range.end_sram
+		    && range.end_sram <= demo.sram.size();
+	};
+
+	if (!fits(*preamble) || !fits(game.index))
+		return false;
+
+	// The copy starts where the first game did, in the game's frames too
+	*copy = game;
+	copy->start_frame = first.start_frame;
+
+	auto &index = copy->index;
+	index.start_frame = preamble->end_frame;
+	index.start_rng = preamble->end_rng;
+	index.start_sram = preamble->end_sram;
+	index.end_frame = index.start_frame + game.index.end_frame - game.index.start_frame;
+	index.end_rng = index.start_rng + game.index.end_rng - game.index.start_rng;
+	index.end_sram = index.start_sram + game.index.end_sram - game.index.start_sram;
+
+	return true;
+}
\ No newline at end of file
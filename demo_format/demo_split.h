@@ -0,0 +1,64 @@
+#pragma once
+
+#include "demo_info.h"
+#include "demo_writer.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A demo loaded whole, for cutting it up
+struct loaded_demo {
+	struct sram_read {
+		demo_sram_record record;
+		std::vector<char> data;
+	};
+
+	std::vector<uint32_t> buttons;
+
+	// RNG calls made before each frame's JVS poll, from the first frame on
+	std::vector<uint32_t> rng_before;
+
+	std::vector<int32_t> rng_values;
+	std::vector<sram_read> sram;
+};
+
+/**
+ * load_demo - Read every stream of a version 1 demo
+ * @filename:	Demo path
+ * @out:	Output streams
+ *
+ * Returns false if it's not a version 1 demo or a stream is damaged.
+ */
+bool load_demo(const std::string &filename, loaded_demo *out);
+
+/**
+ * copy_range - Write part of a demo to another one
+ * @demo:	Source demo
+ * @range:	Items to copy from each stream
+ * @output:	Demo being written
+ *
+ * Records are written in the order they were recorded, so the copy's
+ * rng_counts come out right.
+ */
+void copy_range(
+	const loaded_demo &demo,
+	const demo_game_index &range,
+	demo_writer *output);
+
+/**
+ * plan_split - Work out how to copy one game of a session on its own
+ * @demo:	Session demo
+ * @first:	The session's first game
+ * @game:	Game to copy
+ * @preamble:	Output, everything before the first game
+ * @copy:	Output, the game's record as it is in the copy
+ *
+ * The copy is preamble followed by game's index, see split_demo in
+ * demo_dump. Returns false if either doesn't fit in the demo.
+ */
+bool plan_split(
+	const loaded_demo &demo,
+	const demo_game &first,
+	const demo_game &game,
+	demo_game_index *preamble,
+	demo_game *copy);
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "demo_writer.h"
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Chunks are small, this many bytes of them go out in one write
+static const size_t file_buffer_size = 64 * 1024;
+
+bool demo_writer::open(const std::string &filename)
+{
+#ifdef _WIN32
+	if (fopen_s(&file, filename.c_str(), "wb") != 0)
+		file = nullptr;
+#else
+	file = fopen(filename.c_str(), "wb");
+#endif
+
+	if (file == nullptr)
+		return false;
+
+	setvbuf(file, nullptr, _IOFBF, file_buffer_size);
+
+	demo_header header = {};
+	header.magic = demo_magic;
+	header.version = demo_version;
+	header.header_size = sizeof(header);
+	fwrite(&header, sizeof(header), 1, file);
+	offset = sizeof(header);
+
+	rng_counts.reserve(demo_chunk_frames);
+	rng_values.reserve(demo_chunk_calls);
+
+	return true;
+}
+
+/**
+ * write_chunk - Append a chunk and remember it for the directory
+ * @stream:	Stream the payload belongs to
+ * @encoding:	How the payload is stored
+ * @first:	Index of the first item in the stream
+ * @count:	Items in the payload
+ * @data:	Payload
+ * @size:	Payload size in bytes
+ */
+void demo_writer::write_chunk(
+	const demo_stream stream,
+	const demo_encoding encoding,
+	const uint32_t first,
+	const uint32_t count,
+	const void *data,
+	const size_t size
+) {
+	demo_directory_entry entry = {};
+	entry.chunk.stream = stream;
+	entry.chunk.encoding = encoding;
+	entry.chunk.first = first;
+	entry.chunk.count = count;
+	entry.chunk.size = (uint32_t)(size);
+	entry.offset = offset + sizeof(entry.chunk);
+
+	fwrite(&entry.chunk, sizeof(entry.chunk), 1, file);
+	fwrite(data, 1, size, file);
+	offset = entry.offset + size;
+
+	if (stream != demo_stream::directory)
+		directory.push_back(entry);
+}
+
+// Buttons and RNG counts are always written together
+void demo_writer::write_frames()
+{
+	if (rng_counts.empty())
+		return;
+
+	const auto count = (uint32_t)(rng_counts.size());
+	const auto first = frames - count;
+
+	encoder.finish(&buttons);
+	write_chunk(
+		demo_stream::buttons, demo_encoding::runs, first, count,
+		buttons.data(), buttons.size());
+	write_chunk(
+		demo_stream::rng_counts, demo_encoding::raw, first, count,
+		rng_counts.data(), count * sizeof(rng_counts[0]));
+
+	buttons.clear();
+	rng_counts.clear();
+}
+
+void demo_writer::write_rng_values()
+{
+	if (rng_values.empty())
+		return;
+
+	const auto count = (uint32_t)(rng_values.size());
+	write_chunk(
+		demo_stream::rng_values, demo_encoding::raw, rng_calls - count, count,
+		rng_values.data(), count * sizeof(rng_values[0]));
+
+	rng_values.clear();
+}
+
+void demo_writer::add_frame(const uint32_t packed_buttons)
+{
+	encoder.add(packed_buttons, &buttons);
+	rng_counts.push_back(pending_calls);
+	pending_calls = 0;
+	frames++;
+
+	if (rng_counts.size() == demo_chunk_frames)
+		write_frames();
+}
+
+void demo_writer::add_random(const int32_t value)
+{
+	rng_values.push_back(value);
+	pending_calls++;
+	rng_calls++;
+
+	if (rng_values.size() == demo_chunk_calls)
+		write_rng_values();
+}
+
+/**
+ * add_sram - Record an SRAM read
+ * @success:	Whether the read succeeded
+ * @data:	What was read
+ * @size:	Size the game asked for
+ *
+ * SRAM is only read a few times a session, so each read gets a chunk.
+ */
+void demo_writer::add_sram(const bool success, const void *data, const uint32_t size)
+{
+	const auto stored = success ? size : 0;
+	std::vector<char> payload(sizeof(demo_sram_record) + stored);
+
+	demo_sram_record record = {};
+	record.frame = frames;
+	record.size = size;
+	record.success = success ? 1 : 0;
+	memcpy(payload.data(), &record, sizeof(record));
+	if (stored != 0)
+		memcpy(payload.data() + sizeof(record), data, stored);
+
+	write_chunk(
+		demo_stream::sram, demo_encoding::raw, sram_reads, 1,
+		payload.data(), payload.size());
+	sram_reads++;
+}
+
+void demo_writer::flush(const bool sync)
+{
+	if (file == nullptr)
+		return;
+
+	fflush(file);
+	if (!sync)
+		return;
+
+#ifdef _WIN32
+	_commit(_fileno(file));
+#else
+	fsync(fileno(file));
+#endif
+}
+
+void demo_writer::close()
+{
+	if (file == nullptr)
+		return;
+
+	write_frames();
+	write_rng_values();
+
+	demo_trailer trailer = {};
+	trailer.magic = demo_trailer_magic;
+	trailer.directory = offset;
+
+	write_chunk(
+		demo_stream::directory, demo_encoding::raw,
+		0, (uint32_t)(directory.size()),
+		directory.data(), directory.size() * sizeof(directory[0]));
+
+	fwrite(&trailer, sizeof(trailer), 1, file);
+	fclose(file);
+	file = nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "demo_format.h"
+#include "button_codec.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*
+ * Records a version 1 demo. Each stream is buffered on its own and written
+ * as a chunk once a chunk's worth has built up, SRAM reads are written as
+ * they happen. Not thread safe.
+ */
+class demo_writer {
+	FILE *file = nullptr;
+	uint64_t offset = 0;
+	std::vector<demo_directory_entry> directory;
+
+	// Items so far in each stream, written or not
+	uint32_t frames = 0;
+	uint32_t rng_calls = 0;
+	uint32_t sram_reads = 0;
+
+	// RNG calls since the last frame
+	uint32_t pending_calls = 0;
+
+	// Items not written yet, buttons are encoded as they come in
+	button_encoder encoder;
+	std::vector<uint8_t> buttons;
+	std::vector<uint32_t> rng_counts;
+	std::vector<int32_t> rng_values;
+
+	void write_chunk(
+		demo_stream stream,
+		demo_encoding encoding,
+		uint32_t first,
+		uint32_t count,
+		const void *data,
+		size_t size);
+
+	void write_frames();
+	void write_rng_values();
+
+public:
+	~demo_writer()
+	{
+		close();
+	}
+
+	// Start a new demo, false if the file couldn't be created
+	bool open(const std::string &filename);
+
+	// JVS poll, buttons packed like button_state
+	void add_frame(uint32_t packed_buttons);
+
+	void add_random(int32_t value);
+
+	// SRAM read, data is only stored if it succeeded
+	void add_sram(bool success, const void *data, uint32_t size);
+
+	// Hand what the file buffered to the OS, and have the OS write it to
+	// disk if sync is set. Chunks still being built stay buffered.
+	void flush(bool sync);
+
+	// Write everything buffered, the directory and the trailer
+	void close();
+
+	bool is_open() const
+	{
+		return file != nullptr;
+	}
+
+	uint32_t frame_count() const
+	{
+		return frames;
+	}
+};
\ No newline at end of file
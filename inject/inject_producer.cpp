@@ -0,0 +1,50 @@
+#include "inject_producer.h"
+
+inject_producer::inject_producer(std::unique_ptr<inject_mapping> mapping) :
+	mapping(std::move(mapping)),
+	ring(this->mapping->get()),
+	head(ring->head.load(std::memory_order_relaxed))
+{
+}
+
+uint32_t inject_producer::frame() const
+{
+	return ring->frame.load(std::memory_order_relaxed);
+}
+
+uint32_t inject_producer::space() const
+{
+	const auto tail = ring->tail.load(std::memory_order_acquire);
+	return inject_capacity - (head - tail);
+}
+
+bool inject_producer::push(
+	const uint32_t frame,
+	const uint32_t players,
+	const uint16_t buttons_1p,
+	const uint16_t buttons_2p
+) {
+	if (space() == 0)
+		return false;
+
+	auto &entry = ring->entries[head % inject_capacity];
+	entry.frame = frame;
+	entry.buttons_1p = buttons_1p;
+	entry.buttons_2p = buttons_2p;
+	entry.players = players;
+
+	// The entry must be visible before the game can see it's there
+	head++;
+	ring->head.store(head, std::memory_order_release);
+	return true;
+}
+
+std::unique_ptr<inject_producer> open_inject_producer(const std::string &name)
+{
+	auto mapping = map_inject_ring(name);
+	if (mapping == nullptr)
+		return nullptr;
+
+	return std::unique_ptr<inject_producer>(
+		new inject_producer(std::move(mapping)));
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "inject_ring.h"
+
+/*
+ * Feeds inputs to a running game through its inject ring. Only one
+ * producer may be attached to a ring at a time.
+ */
+class inject_producer {
+	std::unique_ptr<inject_mapping> mapping;
+	inject_ring *ring;
+
+	// Private copy of ring->head, this is its only writer
+	uint32_t head;
+
+public:
+	explicit inject_producer(std::unique_ptr<inject_mapping> mapping);
+
+	// Game frame of the latest JVS poll, 0 before the game first polls
+	uint32_t frame() const;
+
+	// Entries that can be pushed before the game catches up
+	uint32_t space() const;
+
+	/**
+	 * push - Queue buttons for a frame
+	 * @frame:	Game frame to apply them at, entries for frames that
+	 *		already passed apply at the next poll
+	 * @players:	inject_1p and/or inject_2p
+	 * @buttons_1p:	Packed TGM3 buttons for 1p
+	 * @buttons_2p:	Packed TGM3 buttons for 2p
+	 *
+	 * Frames must not go backwards between pushes. Returns false if the
+	 * ring is full.
+	 */
+	bool push(
+		uint32_t frame,
+		uint32_t players,
+		uint16_t buttons_1p,
+		uint16_t buttons_2p);
+};
+
+// Map the ring called name and attach to it, null on failure
+std::unique_ptr<inject_producer> open_inject_producer(const std::string &name);
\ No newline at end of file
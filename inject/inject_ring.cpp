@@ -0,0 +1,173 @@
+#include "inject_ring.h"
+
+// Check the header, or fill it in if this is the first side to map it
+static bool check_header(inject_ring *ring)
+{
+	if (ring->magic == 0) {
+		ring->version = inject_version;
+		ring->magic = inject_magic;
+		return true;
+	}
+
+	return ring->magic == inject_magic && ring->version == inject_version;
+}
+
+/*
+ * Entries are applied in order up to the first one for a later frame. A
+ * producer that got more than a ring ahead of the game has overwritten
+ * entries that weren't applied yet, so those are skipped.
+ */
+void apply_inject_entries(
+	inject_ring *ring,
+	const uint32_t frame,
+	uint16_t *buttons_1p,
+	uint16_t *buttons_2p
+) {
+	ring->frame.store(frame, std::memory_order_relaxed);
+
+	const auto head = ring->head.load(std::memory_order_acquire);
+	auto tail = ring->tail.load(std::memory_order_relaxed);
+	if (head - tail > inject_capacity)
+		tail = head - inject_capacity;
+
+	for (; tail != head; tail++) {
+		const auto &entry = ring->entries[tail % inject_capacity];
+		if ((int32_t)(entry.frame - frame) > 0)
+			break;
+
+		if (entry.players & inject_1p)
+			*buttons_1p = entry.buttons_1p;
+		if (entry.players & inject_2p)
+			*buttons_2p = entry.buttons_2p;
+	}
+
+	// Frees the applied slots for the producer
+	ring->tail.store(tail, std::memory_order_release);
+}
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+class win32_inject_mapping : public inject_mapping {
+	HANDLE section;
+	inject_ring *ring;
+
+public:
+	win32_inject_mapping(const HANDLE section, inject_ring *ring) :
+		section(section),
+		ring(ring)
+	{
+	}
+
+	~win32_inject_mapping() override
+	{
+		UnmapViewOfFile(ring);
+		CloseHandle(section);
+	}
+
+	inject_ring *get() const override
+	{
+		return ring;
+	}
+};
+
+std::unique_ptr<inject_mapping> map_inject_ring(const std::string &name)
+{
+	const auto section = CreateFileMapping(
+		INVALID_HANDLE_VALUE,
+		nullptr,
+		PAGE_READWRITE,
+		0,
+		sizeof(inject_ring),
+		("Local\\" + name).c_str());
+
+	if (section == nullptr)
+		return nullptr;
+
+	auto *ring = (inject_ring*)(MapViewOfFile(
+		section,
+		FILE_MAP_ALL_ACCESS,
+		0,
+		0,
+		sizeof(inject_ring)));
+
+	if (ring == nullptr) {
+		CloseHandle(section);
+		return nullptr;
+	}
+
+	std::unique_ptr<inject_mapping> mapping(
+		new win32_inject_mapping(section, ring));
+
+	if (!check_header(ring))
+		return nullptr;
+
+	return mapping;
+}
+
+#else
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class posix_inject_mapping : public inject_mapping {
+	inject_ring *ring;
+
+public:
+	posix_inject_mapping(inject_ring *ring) : ring(ring)
+	{
+	}
+
+	~posix_inject_mapping() override
+	{
+		munmap(ring, sizeof(inject_ring));
+	}
+
+	inject_ring *get() const override
+	{
+		return ring;
+	}
+};
+
+std::unique_ptr<inject_mapping> map_inject_ring(const std::string &name)
+{
+	const auto fd = shm_open(("/" + name).c_str(), O_RDWR | O_CREAT, 0600);
+	if (fd == -1)
+		return nullptr;
+
+	// Grows a new object with zeroes, leaves an existing one alone
+	struct stat info;
+	if (fstat(fd, &info) == -1
+	 || ((size_t)(info.st_size) < sizeof(inject_ring)
+	  && ftruncate(fd, sizeof(inject_ring)) == -1)) {
+		close(fd);
+		return nullptr;
+	}
+
+	auto *memory = mmap(
+		nullptr,
+		sizeof(inject_ring),
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED,
+		fd,
+		0);
+
+	close(fd);
+
+	if (memory == MAP_FAILED)
+		return nullptr;
+
+	auto *ring = (inject_ring*)(memory);
+	std::unique_ptr<inject_mapping> mapping(new posix_inject_mapping(ring));
+
+	if (!check_header(ring))
+		return nullptr;
+
+	return mapping;
+}
+
+#endif
\ No newline at end of file
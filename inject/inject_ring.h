@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Shared memory ring that other programs feed game inputs through. Only
+ * fixed size types and explicit padding, so 32 and 64 bit processes built
+ * with different compilers agree on the layout, and all zeroes is a valid
+ * empty ring so whichever side maps it first doesn't need to set it up.
+ *
+ * One producer writes entries and then bumps head, tgm3_input applies
+ * every entry that's due at each JVS poll and then bumps tail. Neither
+ * side makes a system call to do so.
+ */
+
+static const uint32_t inject_magic = 0x494D4754; // "TGMI"
+static const uint32_t inject_version = 1;
+
+// Power of 2 so the free running indices can wrap
+static const uint32_t inject_capacity = 4096;
+
+// Which button words an entry sets
+enum : uint32_t {
+	inject_1p = 1,
+	inject_2p = 2
+};
+
+/*
+ * From the game frame frame on, hold these buttons for the players in
+ * players. Entries stay in effect until a later entry replaces them, so
+ * releasing needs an entry with the buttons cleared.
+ */
+struct inject_entry {
+	uint32_t frame;
+	uint16_t buttons_1p;
+	uint16_t buttons_2p;
+	uint32_t players;
+};
+
+struct inject_ring {
+	// Set by whoever maps the ring first, 0 until then
+	uint32_t magic;
+	uint32_t version;
+	uint8_t pad0[56];
+
+	// Entries pushed so far, written by the producer
+	std::atomic<uint32_t> head;
+	uint8_t pad1[60];
+
+	// Entries applied so far, written by tgm3_input
+	std::atomic<uint32_t> tail;
+
+	// Game frame of the latest JVS poll, for producers to schedule against
+	std::atomic<uint32_t> frame;
+	uint8_t pad2[56];
+
+	inject_entry entries[inject_capacity];
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "atomics have a different size");
+static_assert(sizeof(inject_entry) == 12, "inject_entry has padding");
+static_assert(sizeof(inject_ring) == 192 + 12 * inject_capacity, "inject_ring has padding");
+
+// An inject_ring mapped into this process, unmapped on destruction
+class inject_mapping {
+public:
+	virtual ~inject_mapping()
+	{
+	}
+
+	virtual inject_ring *get() const = 0;
+};
+
+/**
+ * map_inject_ring - Create or open a named ring
+ * @name:	Name shared by both sides, without any platform prefix
+ *
+ * The name is a Local\ file mapping on Windows and a POSIX shared memory
+ * object elsewhere. Returns null on failure or if the ring there has a
+ * different version.
+ */
+std::unique_ptr<inject_mapping> map_inject_ring(const std::string &name);
+
+/**
+ * apply_inject_entries - Apply the entries that are due, tgm3_input's side
+ * @ring:	Mapped ring
+ * @frame:	Game frame of this JVS poll
+ * @buttons_1p:	Held 1p buttons, replaced by any entries applied
+ * @buttons_2p:	Held 2p buttons, replaced by any entries applied
+ */
+void apply_inject_entries(
+	inject_ring *ring,
+	uint32_t frame,
+	uint16_t *buttons_1p,
+	uint16_t *buttons_2p);
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "test.h"
+#include "../demo_format/button_codec.h"
+#include "../demo_format/demo_format.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+/**
+ * encode_chunks - Encode words the way demo_writer does
+ * @words:	Button word of every frame
+ *
+ * Runs are cut every demo_chunk_frames frames so each chunk decodes on its
+ * own.
+ */
+static std::vector<std::vector<uint8_t>> encode_chunks(
+	const std::vector<uint32_t> &words
+) {
+	std::vector<std::vector<uint8_t>> chunks;
+	button_encoder encoder;
+	std::vector<uint8_t> chunk;
+
+	for (auto i = 0u; i < words.size(); i++) {
+		encoder.add(words[i], &chunk);
+		if ((i + 1) % demo_chunk_frames == 0 || i + 1 == words.size()) {
+			encoder.finish(&chunk);
+			chunks.push_back(chunk);
+			chunk.clear();
+		}
+	}
+
+	return chunks;
+}
+
+// Decode every chunk of encode_chunks and compare with what went in
+static bool round_trips(const std::vector<uint32_t> &words)
+{
+	const auto chunks = encode_chunks(words);
+	for (auto i = 0u; i < chunks.size(); i++) {
+		const auto first = i * demo_chunk_frames;
+		const auto count = std::min<size_t>(demo_chunk_frames, words.size() - first);
+		std::vector<uint32_t> decoded(count);
+		if (!decode_buttons(chunks[i].data(), chunks[i].size(), decoded.data(), count)
+		 || !std::equal(decoded.begin(), decoded.end(), words.begin() + first))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * decodes - Whether bytes decode to exactly count words
+ * @bytes:	Encoded runs
+ * @count:	Number of words expected
+ *
+ * Words past count are guarded, decoding must never write them even when
+ * it fails.
+ */
+static bool decodes(const std::vector<uint8_t> &bytes, const size_t count)
+{
+	static const uint32_t guard = 0xDEADBEEF;
+	std::vector<uint32_t> out(count + 8, guard);
+	const auto ok = decode_buttons(bytes.data(), bytes.size(), out.data(), count);
+
+	for (auto i = count; i < out.size(); i++)
+		CHECK(out[i] == guard);
+
+	return ok;
+}
+
+void test_codec()
+{
+	// A press held from before a chunk boundary to past the next one, and
+	// a word that stays through whole chunks
+	std::vector<uint32_t> held(1000, 0);
+	held.resize(1100, 0x12);
+	held.resize(5000, 0x10001);
+	held.resize(5100, 0);
+	CHECK(round_trips(held));
+
+	// A chunk that is one run is just its word and length
+	const auto held_chunks = encode_chunks(held);
+	CHECK(held_chunks.size() == 5);
+	CHECK(held_chunks[2].size() == 5);
+
+	// Every frame different
+	std::vector<uint32_t> changing(3 * demo_chunk_frames + 17);
+	for (auto i = 0u; i < changing.size(); i++)
+		changing[i] = (i + 1) * 0x9E3779B9u;
+	CHECK(round_trips(changing));
+
+	// Nothing pressed, every full chunk is the same 3 bytes
+	const std::vector<uint32_t> zero(2 * demo_chunk_frames + 5, 0);
+	CHECK(round_trips(zero));
+
+	const auto zero_chunks = encode_chunks(zero);
+	CHECK(zero_chunks.size() == 3);
+	CHECK(zero_chunks[0] == (std::vector<uint8_t>{ 0x00, 0xFF, 0x07 }));
+	CHECK(zero_chunks[1] == zero_chunks[0]);
+	CHECK(zero_chunks[2] == (std::vector<uint8_t>{ 0x00, 0x04 }));
+
+	// No runs is only right for no frames
+	CHECK(decodes({}, 0));
+	CHECK(!decodes({}, 1));
+
+	// Every cut of a valid chunk is short of words or mid varint
+	const auto changing_chunks = encode_chunks(changing);
+	const auto &full = changing_chunks[0];
+	auto accepted = 0;
+	for (auto size = 0u; size < full.size(); size++) {
+		const std::vector<uint8_t> cut(full.begin(), full.begin() + size);
+		if (decodes(cut, demo_chunk_frames))
+			accepted++;
+	}
+	CHECK(accepted == 0);
+
+	// Truncated varints
+	CHECK(!decodes({ 0x80 }, 1));
+	CHECK(!decodes({ 0x01 }, 1));
+	CHECK(!decodes({ 0x01, 0x80 }, 1));
+	CHECK(!decodes({ 0x01, 0x00, 0x81, 0x80 }, 2));
+
+	// Largest word that fits, then one that doesn't and one that's too long
+	CHECK(decodes({ 0xFF, 0xFF, 0xFF, 0xFF, 0x0F, 0x00 }, 1));
+	CHECK(!decodes({ 0x80, 0x80, 0x80, 0x80, 0x10, 0x00 }, 1));
+	CHECK(!decodes({ 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00 }, 1));
+	CHECK(!decodes({ 0x01, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 }, 1));
+
+	// Runs longer than count, alone or added up, even near 2^32
+	CHECK(decodes({ 0x01, 0x04 }, 5));
+	CHECK(!decodes({ 0x01, 0x04 }, 4));
+	CHECK(!decodes({ 0x01, 0x02, 0x01, 0x02 }, 5));
+	CHECK(!decodes({ 0x01, 0x02 }, 4));
+	CHECK(!decodes({ 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F }, 10));
+}
+
+/**
+ * bench_codec - Time encoding and decoding a chunk of play
+ */
+void bench_codec()
+{
+	using clock = std::chrono::steady_clock;
+	static const size_t chunks = 20000;
+
+	// Buttons change about every 10 frames, like a player mid game
+	std::minstd_rand random(1);
+	std::vector<uint32_t> words(demo_chunk_frames);
+	uint32_t word = 0;
+	for (auto &frame : words) {
+		if (random() % 10 == 0)
+			word ^= 1u << (random() % 12);
+
+		frame = word;
+	}
+
+	std::vector<uint8_t> encoded;
+	uint32_t sink = 0;
+
+	auto start = clock::now();
+	for (auto i = 0u; i < chunks; i++) {
+		button_encoder encoder;
+		encoded.clear();
+		for (const auto frame : words)
+			encoder.add(frame, &encoded);
+
+		encoder.finish(&encoded);
+		sink += (uint32_t)(encoded.size());
+	}
+	auto time = clock::now() - start;
+
+	const auto frames = (double)(chunks * demo_chunk_frames);
+	auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "encode " << ns / frames << " ns/frame"
+		<< " (" << sink % 10 << ")" << std::endl;
+
+	std::vector<uint32_t> decoded(demo_chunk_frames);
+
+	start = clock::now();
+	for (auto i = 0u; i < chunks; i++) {
+		decode_buttons(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+		sink += decoded[i % decoded.size()];
+	}
+	time = clock::now() - start;
+
+	ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "decode " << ns / frames << " ns/frame"
+		<< " (" << sink % 10 << ")" << std::endl;
+}
\ No newline at end of file
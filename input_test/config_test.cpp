@@ -0,0 +1,140 @@
+#include "test.h"
+#include "../config.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+static const char test_filename[] = "input_test.cfg";
+
+// What every load of the lexer test file has to give
+static void check_lexed(const config &cfg)
+{
+	CHECK(cfg.size() == 7);
+	CHECK(cfg.value_str("", "root.plain") == "1");
+	CHECK(cfg.value_str("", "root.quoted") == "value with spaces");
+	CHECK(cfg.value_str("", "root.slashes") == "a//b /* c */");
+	CHECK(cfg.value_str("", "root.after") == "2");
+	CHECK(cfg.value_str("", "root.inner.deep") == "x");
+	CHECK(cfg.value_int(0, "root.", "last") == 3);
+	CHECK(cfg.value_int(0, "top") == -5);
+	CHECK(cfg.value_str("none", "root.trailing") == "none");
+}
+
+/**
+ * test_config - Tokenize comments, quotes and braces
+ *
+ * The second load comes from the compiled config the first one wrote.
+ */
+void test_config()
+{
+	write_test_config(test_filename,
+		"// line comment\n"
+		"root\n"
+		"{\n"
+		"\tplain 1\n"
+		"\tquoted \"value with spaces\"\n"
+		"\tslashes \"a//b /* c */\"\n"
+		"\t/* block\n"
+		"\t   comment */ after 2\n"
+		"\tinner{deep \"x\"}\n"
+		"\tlast 3 // trailing\n"
+		"}\n"
+		"top\t-5");
+
+	{
+		config parsed(test_filename);
+		check_lexed(parsed);
+	}
+
+	{
+		config mapped(test_filename);
+		check_lexed(mapped);
+	}
+
+	write_test_config(test_filename, "/* never closed");
+	CHECK(config(test_filename).size() == 0);
+
+	write_test_config(test_filename, "");
+	CHECK(config(test_filename).size() == 0);
+
+	remove_test_config(test_filename);
+
+	// Out of int range has to fail even where long is 64 bits
+	auto value = 7;
+	CHECK(config::parse_int("0x7fffffff", &value) && value == 0x7fffffff);
+	CHECK(config::parse_int("-2147483648", &value) && value == -2147483647 - 1);
+	CHECK(!config::parse_int("2147483648", &value));
+	CHECK(!config::parse_int("-2147483649", &value));
+	CHECK(!config::parse_int("0x100000000", &value));
+	CHECK(value == -2147483647 - 1);
+}
+
+/**
+ * generate_config - Make a config of per-device joystick sections
+ * @size:	Approximate size in bytes
+ */
+static std::string generate_config(const size_t size)
+{
+	std::string text = "joystick\n{\n";
+	for (auto device = 0; text.size() < size; device++) {
+		const auto name = "\t\"Arcade Stick " + std::to_string(device) + "\"\n";
+		text += name;
+		text +=
+			"\t{\n"
+			"\t\tplayer 1 // which side\n"
+			"\t\tbutton_A 3\n"
+			"\t\tbutton_B 4\n"
+			"\t\tbutton_C 5\n"
+			"\t\tbutton_D 6\n"
+			"\t\tbutton_start 10\n"
+			"\t\t/* analog stick */\n"
+			"\t\tdeadzone 0.25\n"
+			"\t\tsocd last\n"
+			"\t}\n";
+	}
+
+	return text + "}\n";
+}
+
+/**
+ * bench_config - Time loading configs from 1 KB to 10 MB
+ *
+ * The text load parses, hashes the text and writes the compiled config,
+ * the cached load only maps the compiled config.
+ */
+void bench_config()
+{
+	using clock = std::chrono::steady_clock;
+
+	static const size_t sizes[] = {
+		1024,
+		10 * 1024,
+		100 * 1024,
+		1024 * 1024,
+		10 * 1024 * 1024
+	};
+
+	for (const auto size : sizes) {
+		write_test_config(test_filename, generate_config(size));
+
+		const auto text_start = clock::now();
+		const auto keys = config(test_filename).size();
+		const auto text_time = clock::now() - text_start;
+
+		const auto cached_start = clock::now();
+		const config cached(test_filename);
+		const auto cached_time = clock::now() - cached_start;
+		CHECK(cached.size() == keys);
+
+		const auto text_us = std::chrono::duration<double, std::micro>(text_time).count();
+		const auto cached_us = std::chrono::duration<double, std::micro>(cached_time).count();
+
+		std::cout
+			<< size / 1024 << " KB, " << keys << " keys: "
+			<< "text " << text_us << " us ("
+			<< size / text_us << " MB/s), "
+			<< "cached " << cached_us << " us" << std::endl;
+	}
+
+	remove_test_config(test_filename);
+}
\ No newline at end of file
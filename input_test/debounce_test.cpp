@@ -0,0 +1,229 @@
+#include "test.h"
+#include "../tgm3_input/base_input.h"
+#include "../tgm3_input/debounce.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+static const unsigned short A = base_input::mask_A;
+static const unsigned short B = base_input::mask_B;
+
+// Hold-off used by the traces, in microseconds
+static const int64_t holdoff_us = 5000;
+
+struct timed_report {
+	int64_t us;
+	unsigned short raw;
+};
+
+struct timed_output {
+	int64_t us;
+	unsigned short buttons;
+
+	bool operator==(const timed_output &other) const
+	{
+		return us == other.us && buttons == other.buttons;
+	}
+};
+
+/**
+ * run_trace - Debounce a trace the way an input thread does
+ * @reports:	Raw reports, in order
+ * @holdoff:	Hold-off in microseconds
+ *
+ * Before each report, and after the last one, the filter is rechecked
+ * whenever its recheck time comes up first. Returns every change of the
+ * filtered buttons and when it happened.
+ */
+static std::vector<timed_output> run_trace(
+	const std::vector<timed_report> &reports,
+	const int64_t holdoff
+) {
+	eager_debounce debounce;
+	std::vector<timed_output> outputs;
+	unsigned short last = 0;
+
+	const auto note = [&](const int64_t us, const unsigned short buttons)
+	{
+		if (buttons != last)
+			outputs.push_back({ us, buttons });
+
+		last = buttons;
+	};
+
+	for (auto i = 0u; i <= reports.size(); i++) {
+		const auto next = i < reports.size() ? reports[i].us : INT64_MAX;
+		for (auto recheck = debounce.recheck_time(holdoff);
+		     recheck < next;
+		     recheck = debounce.recheck_time(holdoff))
+			note(recheck, debounce.expire(recheck, holdoff));
+
+		if (i < reports.size())
+			note(reports[i].us, debounce.update(reports[i].raw, reports[i].us, holdoff));
+	}
+
+	return outputs;
+}
+
+void test_debounce()
+{
+	// Microswitch bouncing on press, the press shows at once and stays
+	const auto press = run_trace({
+		{ 1000, A },
+		{ 1150, 0 },
+		{ 1300, A },
+		{ 1420, 0 },
+		{ 1600, A },
+	}, holdoff_us);
+	CHECK(press == (std::vector<timed_output>{ { 1000, A } }));
+
+	// Bouncing on release
+	const auto release = run_trace({
+		{ 1000, A },
+		{ 50000, 0 },
+		{ 50100, A },
+		{ 50250, 0 },
+		{ 50300, A },
+		{ 50400, 0 },
+	}, holdoff_us);
+	CHECK(release == (std::vector<timed_output>{ { 1000, A }, { 50000, 0 } }));
+
+	// A tap shorter than the hold-off with nothing reported after it. The
+	// release has to come through when the window ends, not never.
+	const auto tap = run_trace({
+		{ 1000, A },
+		{ 1100, 0 },
+		{ 1250, A },
+		{ 1400, 0 },
+	}, holdoff_us);
+	CHECK(tap == (std::vector<timed_output>{ { 1000, A }, { 6000, 0 } }));
+
+	// One button chattering doesn't hold up another
+	const auto two = run_trace({
+		{ 1000, A },
+		{ 1100, 0 },
+		{ 1200, B },
+		{ 1300, A | B },
+		{ 30000, A },
+		{ 30100, A | B },
+		{ 30200, A },
+	}, holdoff_us);
+	CHECK(two == (std::vector<timed_output>{
+		{ 1000, A },
+		{ 1200, A | B },
+		{ 30000, A } }));
+
+	// Without a hold-off every report goes through
+	const auto off = run_trace({ { 1000, A }, { 1100, 0 }, { 1200, A } }, 0);
+	CHECK(off == (std::vector<timed_output>{ { 1000, A }, { 1100, 0 }, { 1200, A } }));
+
+	eager_debounce settled;
+	settled.update(A, 1000, holdoff_us);
+	CHECK(settled.recheck_time(holdoff_us) == INT64_MAX);
+	settled.update(0, 2000, holdoff_us);
+	CHECK(settled.recheck_time(holdoff_us) == 6000);
+	settled.clear();
+	CHECK(settled.recheck_time(holdoff_us) == INT64_MAX);
+
+	// Random chatter on every button: the first edge after a quiet
+	// hold-off goes through on its report, and the output always ends up
+	// at the last report within a hold-off
+	std::minstd_rand random(1);
+	auto late = 0;
+	auto stuck = 0;
+	for (auto trace = 0; trace < 1000; trace++) {
+		std::vector<timed_report> reports;
+		int64_t us = 0;
+		unsigned short raw = 0;
+		for (auto i = 0; i < 200; i++) {
+			us += random() % 3000;
+			raw ^= (unsigned short)(1u << (random() % 16));
+			reports.push_back({ us, raw });
+		}
+
+		const auto outputs = run_trace(reports, holdoff_us);
+
+		// Last edge of each bit in the output so far
+		int64_t edge[16];
+		for (auto &time : edge)
+			time = INT64_MIN / 2;
+
+		auto out = 0u;
+		unsigned short filtered = 0;
+		unsigned short previous_raw = 0;
+		for (const auto &report : reports) {
+			while (out < outputs.size() && outputs[out].us <= report.us) {
+				for (auto bit = 0; bit < 16; bit++) {
+					if (((outputs[out].buttons ^ filtered) >> bit) & 1)
+						edge[bit] = outputs[out].us;
+				}
+
+				filtered = outputs[out].buttons;
+				out++;
+			}
+
+			// A bit that was settled and quiet for the hold-off and
+			// changes now must show now
+			const auto changed = (unsigned)(report.raw ^ previous_raw);
+			for (auto bit = 0; bit < 16; bit++) {
+				if (((changed & ~(filtered ^ previous_raw)) >> bit) & 1
+				 && report.us - edge[bit] >= holdoff_us
+				 && ((filtered ^ report.raw) >> bit) & 1)
+					late++;
+			}
+
+			previous_raw = report.raw;
+		}
+
+		if (outputs.empty() || outputs.back().buttons != raw
+		 || outputs.back().us > us + holdoff_us)
+			stuck++;
+	}
+
+	CHECK(late == 0);
+	CHECK(stuck == 0);
+}
+
+/**
+ * bench_debounce - Time filtering a report and finding its recheck time
+ */
+void bench_debounce()
+{
+	using clock = std::chrono::steady_clock;
+	static const size_t count = 10000000;
+
+	// Reports every millisecond from a device with a few buttons
+	// chattering at a time
+	std::minstd_rand random(1);
+	std::vector<timed_report> reports(count);
+	unsigned short raw = 0;
+	for (auto i = 0u; i < count; i++) {
+		if (random() % 4 == 0)
+			raw ^= (unsigned short)(1u << (random() % 16));
+
+		reports[i] = { (int64_t)(i) * 1000, raw };
+	}
+
+	const auto time_reports = [&](const char *name, const bool recheck)
+	{
+		eager_debounce debounce;
+		int64_t sink = 0;
+
+		const auto start = clock::now();
+		for (const auto &report : reports) {
+			sink += debounce.update(report.raw, report.us, holdoff_us);
+			if (recheck)
+				sink += debounce.recheck_time(holdoff_us);
+		}
+		const auto time = clock::now() - start;
+
+		const auto ns = std::chrono::duration<double, std::nano>(time).count();
+		std::cout << name << " " << ns / count << " ns/report"
+			<< " (" << sink % 10 << ")" << std::endl;
+	};
+
+	time_reports("update", false);
+	time_reports("update and recheck time", true);
+}
\ No newline at end of file
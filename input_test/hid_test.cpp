@@ -0,0 +1,282 @@
+#include "test.h"
+#include "../tgm3_input/base_input.h"
+#include "../tgm3_input/hid_program.h"
+#include "../tgm3_input/socd.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+static const uint16_t desktop_page = 0x01;
+static const uint16_t button_page = 0x09;
+
+static const unsigned short A = base_input::mask_A;
+static const unsigned short B = base_input::mask_B;
+static const unsigned short C = base_input::mask_C;
+static const unsigned short D = base_input::mask_D;
+static const unsigned short start = base_input::mask_start;
+
+struct captured_device {
+	const char *name;
+	hid_layout layout;
+	std::vector<unsigned short> button_masks;
+	std::vector<hid_axis> axes;
+
+	// Reports as read from the device, report ID byte first
+	std::vector<std::vector<uint8_t>> reports;
+};
+
+static hid_layout::field value_field(
+	const uint8_t report_id,
+	const uint16_t usage,
+	const uint32_t bit_offset,
+	const uint32_t bit_size,
+	const int32_t logical_min,
+	const int32_t logical_max
+) {
+	return { report_id, desktop_page, usage, bit_offset, bit_size, logical_min, logical_max };
+}
+
+// Buttons numbered from 1 in consecutive bits
+static void add_buttons(
+	hid_layout *layout,
+	const uint8_t report_id,
+	const uint32_t bit_offset,
+	const uint32_t count
+) {
+	for (auto i = 0u; i < count; i++) {
+		layout->buttons.push_back({
+			report_id, button_page, (uint16_t)(i + 1), bit_offset + i, 1, 0, 1 });
+	}
+}
+
+/*
+ * Generic DragonRise USB encoder (0079:0006): five 8 bit axes, a 4 bit hat
+ * and 12 buttons, no report IDs.
+ */
+static captured_device dragonrise()
+{
+	captured_device device;
+	device.name = "dragonrise";
+
+	auto &layout = device.layout;
+	layout.report_size = 9;
+	layout.values.push_back(value_field(0, 0x30, 8, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x31, 16, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x32, 24, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x33, 32, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x35, 40, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x39, 48, 4, 0, 7));
+	add_buttons(&layout, 0, 52, 12);
+
+	device.button_masks = { A, B, C, D, 0, 0, 0, 0, 0, start, 0, 0 };
+	device.axes = { hid_axis::left_right, hid_axis::up_down };
+
+	device.reports = {
+		{ 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x0f, 0x00, 0x00 }, // idle
+		{ 0x00, 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x0f, 0x00, 0x00 }, // left
+		{ 0x00, 0xff, 0xff, 0x7f, 0x7f, 0x7f, 0x0f, 0x00, 0x00 }, // down right
+		{ 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x1f, 0x00, 0x00 }, // button 1
+		{ 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x0f, 0x20, 0x00 }, // button 10
+		{ 0x00, 0x7f, 0x00, 0x7f, 0x7f, 0x7f, 0x2f, 0x80, 0x00 }, // up, 2, 12
+		{ 0x00, 0x7f, 0x7f, 0x7f, 0x7f, 0x7f, 0x02, 0x00, 0x00 }, // hat right
+	};
+
+	return device;
+}
+
+/*
+ * PS3 style fight stick (Hori, Qanba and most Brook boards in PS3 mode): 13
+ * buttons, a hat with 8 as its null state and four 8 bit axes.
+ */
+static captured_device ps3_stick()
+{
+	captured_device device;
+	device.name = "ps3 stick";
+
+	auto &layout = device.layout;
+	layout.report_size = 9;
+	add_buttons(&layout, 0, 8, 13);
+	layout.values.push_back(value_field(0, 0x39, 24, 4, 0, 7));
+	layout.values.push_back(value_field(0, 0x30, 32, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x31, 40, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x32, 48, 8, 0, 255));
+	layout.values.push_back(value_field(0, 0x35, 56, 8, 0, 255));
+
+	// Square, cross, circle, triangle and start
+	device.button_masks = { A, B, C, D, 0, 0, 0, 0, 0, start };
+
+	device.reports = {
+		{ 0x00, 0x00, 0x00, 0x08, 0x80, 0x80, 0x80, 0x80, 0x00 }, // idle
+		{ 0x00, 0x02, 0x00, 0x08, 0x80, 0x80, 0x80, 0x80, 0x00 }, // cross
+		{ 0x00, 0x00, 0x02, 0x08, 0x80, 0x80, 0x80, 0x80, 0x00 }, // start
+		{ 0x00, 0x00, 0x00, 0x02, 0x80, 0x80, 0x80, 0x80, 0x00 }, // right
+		{ 0x00, 0x09, 0x00, 0x05, 0x80, 0x80, 0x80, 0x80, 0x00 }, // down left, A, D
+		{ 0x00, 0x00, 0x00, 0x0f, 0x80, 0x80, 0x80, 0x80, 0x00 }, // hat 15
+	};
+
+	return device;
+}
+
+/*
+ * PS4 style encoder (Brook UFB in PS4 mode), input report 1 with the hat
+ * and face buttons sharing a byte and a 64 byte report.
+ */
+static captured_device ps4_encoder()
+{
+	captured_device device;
+	device.name = "ps4 encoder";
+
+	auto &layout = device.layout;
+	layout.report_size = 64;
+	layout.values.push_back(value_field(1, 0x30, 8, 8, 0, 255));
+	layout.values.push_back(value_field(1, 0x31, 16, 8, 0, 255));
+	layout.values.push_back(value_field(1, 0x32, 24, 8, 0, 255));
+	layout.values.push_back(value_field(1, 0x35, 32, 8, 0, 255));
+	layout.values.push_back(value_field(1, 0x39, 40, 4, 0, 7));
+	add_buttons(&layout, 1, 44, 14);
+
+	// Square, cross, circle, triangle and options
+	device.button_masks = { A, B, C, D, 0, 0, 0, 0, 0, start };
+	device.axes = { hid_axis::left_right, hid_axis::up_down };
+
+	const auto report = [](const std::vector<uint8_t> &prefix)
+	{
+		auto bytes = prefix;
+		bytes.resize(64);
+		return bytes;
+	};
+
+	device.reports = {
+		report({ 0x01, 0x80, 0x80, 0x80, 0x80, 0x08, 0x00, 0x00 }), // idle
+		report({ 0x01, 0x80, 0x80, 0x80, 0x80, 0x24, 0x00, 0x00 }), // down, cross
+		report({ 0x01, 0x80, 0x80, 0x80, 0x80, 0x08, 0x20, 0x00 }), // options
+		report({ 0x01, 0x80, 0xff, 0x80, 0x80, 0x98, 0x00, 0x00 }), // stick down, square, triangle
+		report({ 0x02, 0x80, 0x80, 0x80, 0x80, 0x24, 0x20, 0x00 }), // other report
+	};
+
+	return device;
+}
+
+static hid_gate_settings gate_settings(const hid_gate mode)
+{
+	hid_gate_settings gate;
+	gate.mode = mode;
+	gate.deadzone = .5F;
+	gate.diagonal = 45.F;
+	gate.hysteresis = .1F;
+	return gate;
+}
+
+// Decode each captured report from idle
+static std::vector<unsigned short> decode_all(
+	const captured_device &device,
+	const hid_gate mode
+) {
+	hid_program program;
+	program.compile(device.layout, device.button_masks, device.axes, gate_settings(mode));
+
+	std::vector<unsigned short> buttons;
+	for (const auto &report : device.reports)
+		buttons.push_back(program.decode(report.data(), report.size(), 0));
+
+	return buttons;
+}
+
+void test_hid()
+{
+	const auto dragonrise_device = dragonrise();
+	for (const auto mode : { hid_gate::axis, hid_gate::radial }) {
+		const auto buttons = decode_all(dragonrise_device, mode);
+		CHECK(buttons[0] == 0);
+		CHECK(buttons[1] == dir_left);
+		CHECK(buttons[2] == (dir_down | dir_right));
+		CHECK(buttons[3] == A);
+		CHECK(buttons[4] == start);
+		CHECK(buttons[5] == (dir_up | B));
+		CHECK(buttons[6] == dir_right);
+	}
+
+	const auto ps3 = decode_all(ps3_stick(), hid_gate::axis);
+	CHECK(ps3[0] == 0);
+	CHECK(ps3[1] == B);
+	CHECK(ps3[2] == start);
+	CHECK(ps3[3] == dir_right);
+	CHECK(ps3[4] == (dir_down | dir_left | A | D));
+	CHECK(ps3[5] == 0);
+
+	const auto ps4_device = ps4_encoder();
+	const auto ps4 = decode_all(ps4_device, hid_gate::axis);
+	CHECK(ps4[0] == 0);
+	CHECK(ps4[1] == (dir_down | B));
+	CHECK(ps4[2] == start);
+	CHECK(ps4[3] == (dir_down | A | D));
+	CHECK(ps4[4] == 0);
+
+	hid_program program;
+	program.compile(ps4_device.layout, ps4_device.button_masks, ps4_device.axes,
+		gate_settings(hid_gate::axis));
+
+	// Reports shorter than the device's are dropped
+	const auto &pressed = ps4_device.reports[1];
+	CHECK(program.decode(pressed.data(), 8, 0) == 0);
+
+	// Between the held and the fresh deadzone edge only a held direction
+	// stays on: 0x45 is past 0.4 but not 0.5
+	auto partial = ps4_device.reports[0];
+	partial[1] = 0x45;
+	CHECK(program.decode(partial.data(), partial.size(), 0) == 0);
+	CHECK(program.decode(partial.data(), partial.size(), dir_left) == dir_left);
+
+	// The round gate keeps a held diagonal past the sector edge. Right
+	// and a bit up, about 20 degrees, is right alone when nothing is held.
+	program.compile(dragonrise_device.layout, dragonrise_device.button_masks,
+		dragonrise_device.axes, gate_settings(hid_gate::radial));
+
+	auto shallow = dragonrise_device.reports[0];
+	shallow[1] = 0xff;
+	shallow[2] = 0x50;
+	CHECK(program.decode(shallow.data(), shallow.size(), 0) == dir_right);
+	CHECK(program.decode(shallow.data(), shallow.size(), dir_right | dir_up)
+		== (dir_right | dir_up));
+
+	// About 27 degrees is a diagonal either way
+	shallow[2] = 0x40;
+	CHECK(program.decode(shallow.data(), shallow.size(), 0) == (dir_right | dir_up));
+}
+
+/**
+ * bench_hid - Time decoding each device's captured reports
+ */
+void bench_hid()
+{
+	using clock = std::chrono::steady_clock;
+	static const size_t decodes = 10000000;
+
+	const captured_device devices[] = { dragonrise(), ps3_stick(), ps4_encoder() };
+
+	for (const auto &device : devices) {
+		for (const auto mode : { hid_gate::axis, hid_gate::radial }) {
+			hid_program program;
+			program.compile(device.layout, device.button_masks, device.axes,
+				gate_settings(mode));
+
+			const auto &reports = device.reports;
+			unsigned short previous = 0;
+			unsigned sink = 0;
+
+			const auto start_time = clock::now();
+			for (auto i = 0u; i < decodes; i++) {
+				const auto &report = reports[i % reports.size()];
+				previous = program.decode(report.data(), report.size(), previous);
+				sink += previous;
+			}
+			const auto time = clock::now() - start_time;
+
+			const auto ns = std::chrono::duration<double, std::nano>(time).count();
+			std::cout << device.name << " " << hid_gate_names[(int)(mode)]
+				<< " " << ns / decodes << " ns/report"
+				<< " (" << sink % 10 << ")" << std::endl;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,213 @@
+#include "test.h"
+#include "../inject/inject_producer.h"
+#include "../inject/inject_ring.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+static const char ring_name[] = "input_test_inject";
+
+// Start over from a ring that doesn't exist yet
+static void remove_ring()
+{
+#ifndef _WIN32
+	shm_unlink((std::string("/") + ring_name).c_str());
+#endif
+}
+
+/**
+ * check_ordered - Feed a ring and apply it a frame at a time
+ * @consumer:	The game's side of the ring
+ * @producer:	Producer attached to the same ring
+ * @first:	Game frame to start at
+ * @frames:	Frames to run
+ *
+ * The producer schedules up to a few thousand frames ahead, so it fills
+ * the ring and wraps around it many times. Every frame the buttons must be
+ * those of the last entry pushed for a frame up to it. Returns the number
+ * of frames that were wrong.
+ */
+static int check_ordered(
+	inject_ring *consumer,
+	inject_producer *producer,
+	const uint32_t first,
+	const uint32_t frames
+) {
+	std::minstd_rand random(1);
+	std::vector<inject_entry> pushed;
+	size_t applied = 0;
+
+	uint16_t expect_1p = 0;
+	uint16_t expect_2p = 0;
+	uint16_t buttons_1p = 0;
+	uint16_t buttons_2p = 0;
+
+	auto next_frame = first;
+	auto full = 0;
+	auto wrong = 0;
+
+	for (auto frame = first; frame != first + frames; frame++) {
+		while ((int32_t)(next_frame - frame) < 3000) {
+			inject_entry entry;
+			entry.frame = next_frame;
+			entry.players = 1 + random() % 3;
+			entry.buttons_1p = (uint16_t)(random());
+			entry.buttons_2p = (uint16_t)(random());
+
+			if (producer->space() == 0) {
+				if (producer->push(entry.frame, entry.players,
+					entry.buttons_1p, entry.buttons_2p))
+					wrong++;
+
+				full++;
+				break;
+			}
+
+			if (!producer->push(entry.frame, entry.players,
+				entry.buttons_1p, entry.buttons_2p))
+				wrong++;
+
+			pushed.push_back(entry);
+			next_frame += random() % 2;
+		}
+
+		apply_inject_entries(consumer, frame, &buttons_1p, &buttons_2p);
+
+		for (; applied < pushed.size()
+		    && (int32_t)(pushed[applied].frame - frame) <= 0; applied++) {
+			if (pushed[applied].players & inject_1p)
+				expect_1p = pushed[applied].buttons_1p;
+			if (pushed[applied].players & inject_2p)
+				expect_2p = pushed[applied].buttons_2p;
+		}
+
+		if (buttons_1p != expect_1p || buttons_2p != expect_2p
+		 || producer->frame() != frame)
+			wrong++;
+	}
+
+	// The ring filled up at times and wrapped past its end
+	CHECK(full > 0);
+	CHECK(pushed.size() > 4 * inject_capacity);
+
+	return wrong;
+}
+
+void test_inject()
+{
+	remove_ring();
+
+	// The first side to map the ring fills in the header
+	auto game = map_inject_ring(ring_name);
+	CHECK(game != nullptr);
+	if (game == nullptr)
+		return;
+
+	auto *ring = game->get();
+	CHECK(ring->magic == inject_magic);
+	CHECK(ring->version == inject_version);
+	CHECK(ring->head.load() == 0 && ring->tail.load() == 0);
+
+	// The second maps the same memory
+	{
+		auto reopened = map_inject_ring(ring_name);
+		CHECK(reopened != nullptr);
+		if (reopened != nullptr) {
+			CHECK(reopened->get() != ring);
+			ring->frame.store(1234);
+			CHECK(reopened->get()->frame.load() == 1234);
+			CHECK(reopened->get()->magic == inject_magic);
+		}
+	}
+
+	// Producers built against another version are turned away
+	ring->version = inject_version + 1;
+	CHECK(map_inject_ring(ring_name) == nullptr);
+	CHECK(open_inject_producer(ring_name) == nullptr);
+	ring->version = inject_version;
+
+	auto producer = open_inject_producer(ring_name);
+	CHECK(producer != nullptr);
+	if (producer == nullptr)
+		return;
+
+	CHECK(producer->frame() == 1234);
+
+	// A game that never polls lets exactly a ring's worth through
+	CHECK(producer->space() == inject_capacity);
+	auto pushed = 0u;
+	while (producer->push(pushed, inject_1p, (uint16_t)(pushed), 0))
+		pushed++;
+	CHECK(pushed == inject_capacity);
+	CHECK(producer->space() == 0);
+	CHECK(!producer->push(pushed, inject_1p, 1, 0));
+
+	// Everything due at once lands on the last entry
+	uint16_t buttons_1p = 0;
+	uint16_t buttons_2p = 0;
+	apply_inject_entries(ring, inject_capacity, &buttons_1p, &buttons_2p);
+	CHECK(buttons_1p == (uint16_t)(inject_capacity - 1));
+	CHECK(buttons_2p == 0);
+	CHECK(producer->space() == inject_capacity);
+
+	// Applied in order as the ring wraps around its end
+	CHECK(check_ordered(ring, producer.get(), 0, 40000) == 0);
+
+	// And as frames and indices wrap past 2^32
+	producer.reset();
+	ring->head.store(0xFFFFF000);
+	ring->tail.store(0xFFFFF000);
+	producer = open_inject_producer(ring_name);
+	CHECK(producer != nullptr);
+	if (producer != nullptr)
+		CHECK(check_ordered(ring, producer.get(), 0xFFFFF000, 40000) == 0);
+
+	producer.reset();
+	game.reset();
+	remove_ring();
+}
+
+/**
+ * bench_inject - Time a push and the poll that applies it
+ */
+void bench_inject()
+{
+	using clock = std::chrono::steady_clock;
+	static const uint32_t frames = 10000000;
+
+	remove_ring();
+	auto game = map_inject_ring(ring_name);
+	auto producer = open_inject_producer(ring_name);
+	if (game == nullptr || producer == nullptr) {
+		std::cerr << "Couldn't map " << ring_name << std::endl;
+		return;
+	}
+
+	uint16_t buttons_1p = 0;
+	uint16_t buttons_2p = 0;
+	uint32_t sink = 0;
+
+	const auto start = clock::now();
+	for (auto frame = 0u; frame < frames; frame++) {
+		producer->push(frame, inject_1p | inject_2p,
+			(uint16_t)(frame), (uint16_t)(frame >> 4));
+		apply_inject_entries(game->get(), frame, &buttons_1p, &buttons_2p);
+		sink += buttons_1p ^ buttons_2p;
+	}
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "push and apply " << ns / frames << " ns/frame"
+		<< " (" << sink % 10 << ")" << std::endl;
+
+	producer.reset();
+	game.reset();
+	remove_ring();
+}
\ No newline at end of file
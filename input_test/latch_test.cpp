@@ -0,0 +1,155 @@
+#include "test.h"
+#include "../config.h"
+#include "../tgm3_input/base_input.h"
+#include "../tgm3_input/button_state.h"
+#include "../tgm3_input/latch.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static const char latch_filename[] = "latch_test.cfg";
+
+// JVS polls come once a frame
+static const int64_t frame_us = 16667;
+
+static const uint32_t A = base_input::mask_A;
+static const uint32_t B = base_input::mask_B;
+static const uint32_t C = base_input::mask_C;
+static const uint32_t up = base_input::mask_up;
+
+struct timed_level {
+	int64_t us;
+	uint32_t level;
+};
+
+/**
+ * run_stream - Feed button changes through a button_state and poll it
+ * @events:	Packed button words and when they were published, in order
+ * @polls:	Number of frames to poll
+ *
+ * Returns what the game saw at each poll, the first at frame_us.
+ */
+static std::vector<uint32_t> run_stream(
+	const std::vector<timed_level> &events,
+	const int polls
+) {
+	button_state state;
+
+	// Forget the level from the last stream
+	latch_buttons(0, 0);
+
+	std::vector<uint32_t> seen;
+	auto next = events.begin();
+	for (auto poll = 1; poll <= polls; poll++) {
+		const auto poll_us = poll * frame_us;
+		for (; next != events.end() && next->us < poll_us; next++)
+			state.publish(next->level);
+
+		const auto sample = state.consume();
+		seen.push_back(latch_buttons(sample.level, sample.toggled));
+	}
+
+	return seen;
+}
+
+static void load_latch_config(const std::string &contents)
+{
+	write_test_config(latch_filename, contents);
+
+	std::vector<std::string> diagnostics;
+	load_latch(config(latch_filename), &diagnostics);
+	CHECK(diagnostics.empty());
+
+	remove_test_config(latch_filename);
+}
+
+void test_latch()
+{
+	load_latch_config(
+		"latch\n"
+		"{\n"
+		"\tA press\n"
+		"\tB release\n"
+		"\tC level\n"
+		"}\n");
+
+	// A 2 ms tap between polls shows for exactly one poll
+	const auto tap = run_stream({ { 20000, A }, { 22000, 0 } }, 3);
+	CHECK(tap == (std::vector<uint32_t>{ 0, A, 0 }));
+
+	// The same for 2p
+	const auto tap_2p = run_stream({ { 20000, A << 16 }, { 22000, 0 } }, 3);
+	CHECK(tap_2p == (std::vector<uint32_t>{ 0, A << 16, 0 }));
+
+	// Directions latch presses by default
+	const auto tap_up = run_stream({ { 1000, up }, { 1500, 0 } }, 2);
+	CHECK(tap_up == (std::vector<uint32_t>{ up, 0 }));
+
+	// A level button loses the tap
+	const auto tap_level = run_stream({ { 20000, C }, { 22000, 0 } }, 3);
+	CHECK(tap_level == (std::vector<uint32_t>{ 0, 0, 0 }));
+
+	// A release latched button let go for 3 ms shows released once
+	const auto gap = run_stream({ { 1000, B }, { 20000, 0 }, { 23000, B } }, 3);
+	CHECK(gap == (std::vector<uint32_t>{ B, 0, B }));
+
+	// A press latched button let go and pressed again is just held
+	const auto held = run_stream({ { 1000, A }, { 20000, 0 }, { 23000, A } }, 3);
+	CHECK(held == (std::vector<uint32_t>{ A, A, A }));
+
+	// A release after a poll that saw the press is a plain release
+	const auto release = run_stream({ { 1000, A }, { 20000, 0 } }, 3);
+	CHECK(release == (std::vector<uint32_t>{ A, 0, 0 }));
+
+	// Several taps in one frame still show once, and another button held
+	// at the same time isn't disturbed
+	const auto chatter = run_stream({
+		{ 1000, C },
+		{ 18000, C | A },
+		{ 18500, C },
+		{ 19000, C | A },
+		{ 19500, C },
+		{ 40000, 0 },
+	}, 3);
+	CHECK(chatter == (std::vector<uint32_t>{ C, C | A, 0 }));
+
+	// Level everywhere, nothing latches
+	load_latch_config(
+		"latch\n"
+		"{\n"
+		"\tA level\n"
+		"\tup level\n"
+		"}\n");
+
+	const auto unlatched = run_stream({ { 20000, A | up }, { 22000, 0 } }, 3);
+	CHECK(unlatched == (std::vector<uint32_t>{ 0, 0, 0 }));
+
+	// Back to the defaults
+	load_latch_config("");
+}
+
+/**
+ * bench_latch - Time applying the policies once per poll
+ */
+void bench_latch()
+{
+	using clock = std::chrono::steady_clock;
+	static const uint32_t polls = 100000000;
+
+	load_latch_config("");
+
+	uint32_t sink = 0;
+	uint32_t level = 0;
+	const auto start = clock::now();
+	for (auto i = 0u; i < polls; i++) {
+		const auto next = i * 2654435761u;
+		sink += latch_buttons(next, level ^ next);
+		level = next;
+	}
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << ns / polls << " ns/poll (" << sink % 10 << ")" << std::endl;
+}
\ No newline at end of file
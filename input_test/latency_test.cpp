@@ -0,0 +1,108 @@
+#include "test.h"
+#include "../tgm3_input/latency.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+void test_latency()
+{
+	using histogram = latency_histogram;
+
+	// One bucket per value below 32, then 16 per power of two
+	CHECK(histogram::bucket_index(0) == 0);
+	CHECK(histogram::bucket_limit(0) == 0);
+	CHECK(histogram::bucket_index(31) == 31);
+	CHECK(histogram::bucket_limit(31) == 31);
+	CHECK(histogram::bucket_index(32) == 32);
+	CHECK(histogram::bucket_index(33) == 32);
+	CHECK(histogram::bucket_limit(32) == 33);
+	CHECK(histogram::bucket_index(34) == 33);
+
+	for (auto bit = 5; bit < 32; bit++) {
+		const auto power = 1u << bit;
+		const auto index = (bit - 3) * histogram::sub_count;
+		CHECK(histogram::bucket_index(power) == index);
+		CHECK(histogram::bucket_index(power - 1) == index - 1);
+		CHECK(histogram::bucket_limit(index - 1) == power - 1);
+	}
+
+	// The last bucket's limit is 2^32 - 1, not wrapped around to 0 - 1
+	const auto last = histogram::bucket_count - 1;
+	CHECK(histogram::bucket_index(UINT32_MAX) == last);
+	CHECK(histogram::bucket_limit(last) == UINT32_MAX);
+	CHECK(histogram::bucket_limit(last - 1) == UINT32_MAX - (1u << 27));
+
+	// Every limit is the last value of its bucket
+	auto misplaced = 0;
+	for (auto i = 0; i < histogram::bucket_count; i++) {
+		const auto limit = histogram::bucket_limit(i);
+		if (histogram::bucket_index(limit) != i
+		 || (i != last && histogram::bucket_index(limit + 1) != i + 1))
+			misplaced++;
+	}
+	CHECK(misplaced == 0);
+
+	histogram empty;
+	CHECK(empty.count() == 0);
+	CHECK(empty.percentile(50) == 0);
+
+	// Percentiles give the bucket's limit, but never more than the maximum
+	histogram edges;
+	std::vector<uint32_t> values = { 0, 31, 32, 33 };
+	for (auto bit = 6; bit < 32; bit++)
+		values.push_back(1u << bit);
+	values.push_back(UINT32_MAX);
+
+	for (const auto value : values)
+		edges.record(value);
+
+	CHECK(edges.count() == values.size());
+	CHECK(edges.maximum() == UINT32_MAX);
+	CHECK(edges.percentile(0) == 0);
+	CHECK(edges.percentile(100) == UINT32_MAX);
+
+	const auto n = (double)(values.size());
+	for (auto i = 0u; i < values.size(); i++) {
+		const auto p = (i + 1) * 100. / n;
+		const auto expect = histogram::bucket_limit(
+			histogram::bucket_index(values[i]));
+		if (!CHECK(edges.percentile(p) == expect))
+			std::cerr << "percentile " << p << " of " << values[i] << std::endl;
+	}
+
+	histogram top;
+	top.record(UINT32_MAX);
+	CHECK(top.percentile(50) == UINT32_MAX);
+
+	histogram capped;
+	capped.record(40);
+	CHECK(capped.percentile(100) == 40);
+}
+
+/**
+ * bench_latency - Time recording a value
+ */
+void bench_latency()
+{
+	using clock = std::chrono::steady_clock;
+	static const size_t count = 10000000;
+
+	// Press latencies in microseconds, mostly a few milliseconds
+	std::minstd_rand random(1);
+	std::vector<uint32_t> values(count);
+	for (auto &value : values)
+		value = (uint32_t)(random() % 20000);
+
+	latency_histogram histogram;
+
+	const auto start = clock::now();
+	for (const auto value : values)
+		histogram.record(value);
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "record " << ns / count << " ns/value"
+		<< " (" << histogram.percentile(99) % 10 << ")" << std::endl;
+}
\ No newline at end of file
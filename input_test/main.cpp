@@ -0,0 +1,107 @@
+#include "test.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static int failures;
+
+bool check(const bool ok, const char *what, const char *file, const int line)
+{
+	if (!ok) {
+		std::cerr << file << ":" << line << ": " << what << std::endl;
+		failures++;
+	}
+
+	return ok;
+}
+
+void write_test_config(const char *filename, const std::string &contents)
+{
+	std::remove((std::string(filename) + "c").c_str());
+	std::ofstream(filename, std::ios::binary) << contents;
+}
+
+void remove_test_config(const char *filename)
+{
+	std::remove(filename);
+	std::remove((std::string(filename) + "c").c_str());
+}
+
+static const struct {
+	const char *name;
+	void (*test)();
+	void (*bench)();
+} suites[] = {
+	{ "config",   test_config,   bench_config   },
+	{ "socd",     test_socd,     bench_socd     },
+	{ "publish",  test_publish,  bench_publish  },
+	{ "hid",      test_hid,      bench_hid      },
+	{ "registry", test_registry, bench_registry },
+	{ "latch",    test_latch,    bench_latch    },
+	{ "debounce", test_debounce, bench_debounce },
+	{ "thread",   test_thread,   bench_thread   },
+	{ "latency",  test_latency,  bench_latency  },
+	{ "codec",    test_codec,    bench_codec    },
+	{ "reader",   test_reader,   bench_reader   },
+	{ "writer",   test_writer,   bench_writer   },
+	{ "split",    test_split,    bench_split    },
+	{ "inject",   test_inject,   bench_inject   },
+	{ "watcher",  test_watcher,  bench_watcher  },
+#ifdef __linux__
+	{ "uinput",   test_uinput,   bench_uinput   },
+#endif
+};
+
+/**
+ * run_tests - Run the tests of one suite or all of them
+ * @name:	Suite name, or null for every suite
+ *
+ * Returns the number of failed checks.
+ */
+static int run_tests(const char *name)
+{
+	auto found = false;
+	for (const auto &suite : suites) {
+		if (name != nullptr && strcmp(name, suite.name) != 0)
+			continue;
+
+		const auto before = failures;
+		suite.test();
+		std::cout << suite.name << ": "
+			<< (failures == before ? "ok" : "FAILED") << std::endl;
+
+		found = true;
+	}
+
+	if (!found)
+		std::cerr << "Unknown suite " << name << std::endl;
+
+	return found ? failures : 1;
+}
+
+/**
+ * main - Entry point
+ * @argc:	Command line argument count
+ * @argv:	Array of command line arguments
+ *
+ * input_test			Run every suite's tests
+ * input_test <suite>		Run one suite's tests
+ * input_test bench <suite>	Time one suite
+ */
+int main(const int argc, const char *argv[])
+{
+	if (argc >= 3 && strcmp(argv[1], "bench") == 0) {
+		for (const auto &suite : suites) {
+			if (strcmp(argv[2], suite.name) == 0) {
+				suite.bench();
+				return 0;
+			}
+		}
+
+		std::cerr << "Unknown suite " << argv[2] << std::endl;
+		return 1;
+	}
+
+	return run_tests(argc >= 2 ? argv[1] : nullptr) != 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "test.h"
+#include "../tgm3_input/button_state.h"
+#include "../tgm3_input/latency.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+ * Words published here carry a sequence number as 1p and its complement as
+ * 2p, so a word made of halves from two different publishes shows up as a
+ * 2p that doesn't match its 1p.
+ */
+static uint32_t sequence_word(const uint32_t sequence)
+{
+	return button_state::pack(
+		(unsigned short)(sequence),
+		(unsigned short)(~sequence));
+}
+
+static bool whole(const uint32_t word)
+{
+	return button_state::buttons_2p(word)
+		== (unsigned short)(~button_state::buttons_1p(word));
+}
+
+/**
+ * test_publish - Publish flat out while the game side consumes
+ *
+ * Every consumed word must be whole and no older than the last one, and
+ * every bit that differs from the last one must be marked as toggled.
+ */
+void test_publish()
+{
+	static const uint32_t publishes = 2000000;
+
+	button_state state;
+	state.publish(sequence_word(0));
+	state.consume();
+
+	// Only 16 bits of the sequence are published, the producer waits so it
+	// can't lap the consumer and make a newer word look older
+	std::atomic<uint32_t> consumed(0);
+	std::atomic<bool> done(false);
+	std::thread producer([&]
+	{
+		for (auto i = 1u; i <= publishes; i++) {
+			while (i - consumed.load(std::memory_order_relaxed) > 0x4000)
+				std::this_thread::yield();
+
+			state.publish(sequence_word(i));
+		}
+
+		done.store(true, std::memory_order_release);
+	});
+
+	auto torn = 0;
+	auto backwards = 0;
+	auto missed_toggles = 0;
+	uint32_t last = sequence_word(0);
+	uint32_t last_sequence = 0;
+	uint64_t samples = 0;
+
+	while (true) {
+		const auto finished = done.load(std::memory_order_acquire);
+		const auto sample = state.consume();
+		samples++;
+
+		if (!whole(sample.level))
+			torn++;
+
+		if ((last ^ sample.level) & ~sample.toggled)
+			missed_toggles++;
+
+		// 1p is the low 16 bits of the sequence, it only moves forward
+		const auto step = (int16_t)(
+			button_state::buttons_1p(sample.level) - (uint16_t)(last_sequence));
+		if (step < 0)
+			backwards++;
+
+		last = sample.level;
+		last_sequence += step;
+		consumed.store(last_sequence, std::memory_order_relaxed);
+
+		if (finished)
+			break;
+	}
+
+	producer.join();
+
+	CHECK(torn == 0);
+	CHECK(backwards == 0);
+	CHECK(missed_toggles == 0);
+	CHECK(last == sequence_word(publishes));
+	CHECK(samples > 1);
+}
+
+/**
+ * bench_publish - Time publishing and publish to observe latency
+ *
+ * Publishes are spaced out so each one is observed on its own, and the
+ * game side spins on load() like a poll that comes at the worst moment.
+ */
+void bench_publish()
+{
+	using clock = std::chrono::steady_clock;
+	static const uint32_t publishes = 200000;
+
+	button_state state;
+	std::vector<std::atomic<int64_t>> publish_time(publishes + 1);
+	const auto epoch = clock::now();
+
+	const auto now_ns = [epoch]
+	{
+		return (int64_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			clock::now() - epoch).count());
+	};
+
+	latency_histogram observe_ns;
+	std::thread consumer([&]
+	{
+		uint32_t seen = 0;
+		while (seen < publishes) {
+			const auto word = state.load();
+			const auto sequence = button_state::buttons_1p(word);
+			if (sequence == (uint16_t)(seen))
+				continue;
+
+			// Skipped publishes were replaced before anyone looked
+			seen += (uint16_t)(sequence - (uint16_t)(seen));
+			const auto ns = now_ns() - publish_time[seen].load(std::memory_order_relaxed);
+			observe_ns.record(ns < 0 ? 0 : ns > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns));
+		}
+	});
+
+	int64_t publish_total = 0;
+	for (auto i = 1u; i <= publishes; i++) {
+		// Spin a couple of microseconds between publishes
+		const auto next = now_ns() + 2000;
+		while (now_ns() < next)
+			;
+
+		const auto start = now_ns();
+		publish_time[i].store(start, std::memory_order_relaxed);
+		state.publish(sequence_word(i));
+		publish_total += now_ns() - start;
+	}
+
+	consumer.join();
+
+	std::cout
+		<< "publish " << (double)(publish_total) / publishes << " ns" << std::endl
+		<< "observed " << observe_ns.count() << " of " << publishes
+		<< ", ns p50 " << observe_ns.percentile(50)
+		<< " p99 " << observe_ns.percentile(99)
+		<< " p99.9 " << observe_ns.percentile(99.9)
+		<< " max " << observe_ns.maximum() << std::endl;
+}
\ No newline at end of file
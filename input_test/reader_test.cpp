@@ -0,0 +1,300 @@
+#include "test.h"
+#include "../demo_format/demo_reader.h"
+#include "../demo_format/demo_writer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static const char demo_filename[] = "input_test.dem";
+static const char cut_filename[] = "input_test_cut.dem";
+
+// What went into a demo, stream by stream
+struct demo_contents {
+	std::vector<uint32_t> buttons;
+	std::vector<uint32_t> rng_counts;
+	std::vector<int32_t> rng_values;
+	std::vector<uint32_t> sram_frames;
+};
+
+/**
+ * write_demo - Record a demo of made up play
+ * @filename:	Demo to write
+ * @frames:	Frames to record
+ *
+ * Buttons change every few frames, the RNG is called 0 to 2 times a frame
+ * and SRAM is read every 1500 frames, so every stream spans several
+ * chunks.
+ */
+static demo_contents write_demo(const char *filename, const uint32_t frames)
+{
+	demo_contents contents;
+	demo_writer writer;
+	CHECK(writer.open(filename));
+
+	for (auto frame = 0u; frame < frames; frame++) {
+		if (frame % 1500 == 0) {
+			const uint32_t data[] = { frame, ~frame };
+			writer.add_sram(frame % 3000 == 0, data, sizeof(data));
+			contents.sram_frames.push_back(frame);
+		}
+
+		const auto calls = frame % 3;
+		for (auto call = 0u; call < calls; call++) {
+			const auto value = (int32_t)(frame * 7 + call);
+			writer.add_random(value);
+			contents.rng_values.push_back(value);
+		}
+
+		const auto buttons = (frame / 9 % 5) << (frame / 700 % 16);
+		writer.add_frame(buttons);
+		contents.buttons.push_back(buttons);
+		contents.rng_counts.push_back(calls);
+	}
+
+	writer.close();
+	return contents;
+}
+
+/**
+ * column_matches - Read a stream and compare it with what was recorded
+ * @reader:	Opened demo
+ * @stream:	Stream of 32-bit items
+ * @expect:	Every item recorded, the demo may hold fewer
+ *
+ * The stream has to hold exactly the count the reader found, the first
+ * ones recorded, and end right after them.
+ */
+template<typename T>
+static bool column_matches(
+	const demo_reader &reader,
+	const demo_stream stream,
+	const std::vector<T> &expect
+) {
+	const auto count = reader.count(stream);
+	if (count > expect.size())
+		return false;
+
+	demo_column column(reader, stream);
+	for (auto i = 0u; i < count; i++) {
+		T item;
+		if (!column.read(&item) || item != expect[i])
+			return false;
+	}
+
+	T past;
+	return !column.read(&past);
+}
+
+// SRAM reads are a record and the data of the successful ones
+static bool sram_matches(const demo_reader &reader, const demo_contents &expect)
+{
+	const auto count = reader.count(demo_stream::sram);
+	if (count > expect.sram_frames.size())
+		return false;
+
+	demo_column column(reader, demo_stream::sram);
+	for (auto i = 0u; i < count; i++) {
+		demo_sram_record record;
+		if (!column.read(&record) || record.frame != expect.sram_frames[i])
+			return false;
+
+		uint32_t data[2];
+		if (record.success
+		 && (!column.read(data, sizeof(data)) || data[0] != record.frame))
+			return false;
+	}
+
+	demo_sram_record past;
+	return !column.read(&past);
+}
+
+static bool same_chunks(
+	const std::vector<demo_directory_entry> &a,
+	const std::vector<demo_directory_entry> &b
+) {
+	return a.size() == b.size()
+	    && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0);
+}
+
+static void write_file(const char *filename, const std::string &bytes)
+{
+	std::ofstream(filename, std::ios::binary).write(bytes.data(), bytes.size());
+}
+
+// Replace size bytes of a copy of a file at offset
+static std::string patched(
+	const std::string &bytes,
+	const size_t offset,
+	const void *data,
+	const size_t size
+) {
+	auto copy = bytes;
+	copy.replace(offset, size, (const char*)(data), size);
+	return copy;
+}
+
+void test_reader()
+{
+	const auto expect = write_demo(demo_filename, 5000);
+
+	demo_reader whole;
+	CHECK(whole.open(demo_filename));
+	CHECK(whole.complete());
+	CHECK(whole.count(demo_stream::buttons) == 5000);
+	CHECK(whole.count(demo_stream::rng_values) == expect.rng_values.size());
+	CHECK(whole.count(demo_stream::sram) == 4);
+	CHECK(column_matches(whole, demo_stream::buttons, expect.buttons));
+	CHECK(column_matches(whole, demo_stream::rng_counts, expect.rng_counts));
+	CHECK(column_matches(whole, demo_stream::rng_values, expect.rng_values));
+	CHECK(sram_matches(whole, expect));
+
+	std::ifstream file(demo_filename, std::ios::binary);
+	const std::string bytes(
+		(std::istreambuf_iterator<char>(file)),
+		std::istreambuf_iterator<char>());
+	file.close();
+
+	const auto &chunks = whole.chunk_list();
+	std::vector<uint64_t> cuts;
+	for (const auto &entry : chunks) {
+		cuts.push_back(entry.offset - sizeof(demo_chunk));
+		cuts.push_back(entry.offset - sizeof(demo_chunk) / 2);
+		cuts.push_back(entry.offset + entry.chunk.size / 2);
+	}
+	cuts.push_back(bytes.size() - sizeof(demo_trailer));
+	cuts.push_back(bytes.size() - 1);
+
+	// A crash mid chunk leaves exactly the chunks written before it
+	auto wrong = 0;
+	for (const auto cut : cuts) {
+		write_file(cut_filename, bytes.substr(0, (size_t)(cut)));
+
+		std::vector<demo_directory_entry> before;
+		for (const auto &entry : chunks) {
+			if (entry.offset + entry.chunk.size <= cut)
+				before.push_back(entry);
+		}
+
+		demo_reader reader;
+		if (!reader.open(cut_filename)
+		 || reader.complete()
+		 || !same_chunks(reader.chunk_list(), before)
+		 || !column_matches(reader, demo_stream::buttons, expect.buttons)
+		 || !column_matches(reader, demo_stream::rng_counts, expect.rng_counts)
+		 || !column_matches(reader, demo_stream::rng_values, expect.rng_values)
+		 || !sram_matches(reader, expect)) {
+			std::cerr << "cut at " << cut << std::endl;
+			wrong++;
+		}
+	}
+	CHECK(wrong == 0);
+
+	// A bad trailer or directory falls back to walking the chunks, which
+	// are all still there
+	demo_trailer trailer;
+	const auto trailer_offset = bytes.size() - sizeof(trailer);
+	memcpy(&trailer, bytes.data() + trailer_offset, sizeof(trailer));
+
+	std::vector<std::string> corrupt;
+
+	auto bad_magic = trailer;
+	bad_magic.magic ^= 1;
+	corrupt.push_back(patched(bytes, trailer_offset, &bad_magic, sizeof(trailer)));
+
+	auto not_directory = trailer;
+	not_directory.directory = sizeof(demo_header);
+	corrupt.push_back(patched(bytes, trailer_offset, &not_directory, sizeof(trailer)));
+
+	auto past_end = trailer;
+	past_end.directory = UINT64_MAX - 4;
+	corrupt.push_back(patched(bytes, trailer_offset, &past_end, sizeof(trailer)));
+
+	// An entry whose end wraps around to before the directory
+	auto wrapped = chunks[0];
+	wrapped.offset = UINT64_MAX - wrapped.chunk.size + 9;
+	corrupt.push_back(patched(
+		bytes, (size_t)(trailer.directory + sizeof(demo_chunk)),
+		&wrapped, sizeof(wrapped)));
+
+	// More entries than the directory has room for
+	demo_chunk long_directory;
+	memcpy(&long_directory, bytes.data() + trailer.directory, sizeof(long_directory));
+	long_directory.count++;
+	long_directory.size += sizeof(demo_directory_entry);
+	corrupt.push_back(patched(
+		bytes, (size_t)(trailer.directory),
+		&long_directory, sizeof(long_directory)));
+
+	wrong = 0;
+	for (auto i = 0u; i < corrupt.size(); i++) {
+		write_file(cut_filename, corrupt[i]);
+
+		demo_reader reader;
+		if (!reader.open(cut_filename)
+		 || reader.complete()
+		 || !same_chunks(reader.chunk_list(), chunks)
+		 || !column_matches(reader, demo_stream::buttons, expect.buttons)
+		 || !sram_matches(reader, expect)) {
+			std::cerr << "corrupt trailer " << i << std::endl;
+			wrong++;
+		}
+	}
+	CHECK(wrong == 0);
+
+	// Not a demo at all
+	write_file(cut_filename, bytes.substr(0, sizeof(demo_header) - 1));
+	CHECK(!demo_reader().open(cut_filename));
+
+	std::remove(demo_filename);
+	std::remove(cut_filename);
+}
+
+/**
+ * bench_reader - Time opening a demo and reading its buttons
+ */
+void bench_reader()
+{
+	using clock = std::chrono::steady_clock;
+	static const int opens = 200;
+
+	// An hour of play
+	const uint32_t frames = 60 * 60 * 60;
+	write_demo(demo_filename, frames);
+
+	uint32_t sink = 0;
+	auto start = clock::now();
+	for (auto i = 0; i < opens; i++) {
+		demo_reader reader;
+		reader.open(demo_filename);
+		sink += (uint32_t)(reader.chunk_list().size());
+	}
+	auto time = clock::now() - start;
+
+	auto us = std::chrono::duration<double, std::micro>(time).count();
+	std::cout << "open " << us / opens << " us/demo"
+		<< " (" << sink % 10 << ")" << std::endl;
+
+	demo_reader reader;
+	reader.open(demo_filename);
+
+	start = clock::now();
+	demo_column column(reader, demo_stream::buttons);
+	for (auto i = 0u; i < frames; i++) {
+		uint32_t buttons;
+		column.read(&buttons);
+		sink += buttons;
+	}
+	time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "read buttons " << ns / frames << " ns/frame"
+		<< " (" << sink % 10 << ")" << std::endl;
+
+	std::remove(demo_filename);
+}
\ No newline at end of file
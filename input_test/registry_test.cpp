@@ -0,0 +1,255 @@
+#include "test.h"
+#include "../tgm3_input/device_registry.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct fake_device {
+	const void *handle;
+	int id;
+};
+
+/*
+ * Plays the part of raw input's device arrivals and removals. Handles look
+ * like the ones Windows hands out and get reused once a device is gone,
+ * the way a replugged stick often comes back under the same handle.
+ */
+class fake_device_source {
+	std::minstd_rand random;
+	std::vector<const void*> plugged;
+	std::vector<const void*> unplugged;
+	uintptr_t next_handle = 0x10041;
+	size_t max_devices;
+
+public:
+	struct event {
+		bool added;
+		const void *handle;
+	};
+
+	fake_device_source(const size_t max_devices, const unsigned seed) :
+		random(seed),
+		max_devices(max_devices)
+	{
+	}
+
+	const std::vector<const void*> &devices() const
+	{
+		return plugged;
+	}
+
+	event next()
+	{
+		const auto add = plugged.empty()
+			|| (plugged.size() < max_devices && random() % 2 == 0);
+
+		if (!add) {
+			const auto i = random() % plugged.size();
+			const auto handle = plugged[i];
+			plugged[i] = plugged.back();
+			plugged.pop_back();
+			unplugged.push_back(handle);
+			return { false, handle };
+		}
+
+		const void *handle;
+		if (!unplugged.empty() && random() % 4 != 0) {
+			const auto i = random() % unplugged.size();
+			handle = unplugged[i];
+			unplugged[i] = unplugged.back();
+			unplugged.pop_back();
+		} else {
+			handle = (const void*)(next_handle);
+			next_handle += 0x20;
+		}
+
+		plugged.push_back(handle);
+		return { true, handle };
+	}
+};
+
+// Apply an event from the source the way joystick does
+static void apply(
+	device_registry<fake_device> *registry,
+	const fake_device_source::event &event,
+	const int id
+) {
+	if (event.added)
+		registry->insert(event.handle, std::make_unique<fake_device>(fake_device{ event.handle, id }));
+	else
+		registry->remove(event.handle);
+}
+
+void test_registry()
+{
+	device_registry<fake_device> registry;
+
+	CHECK(!registry.insert(nullptr, std::make_unique<fake_device>(fake_device{ nullptr, 0 })));
+	CHECK(registry.find(nullptr) == nullptr);
+	CHECK(registry.remove(nullptr) == nullptr);
+
+	const auto *first = (const void*)(0x10041);
+	CHECK(registry.insert(first, std::make_unique<fake_device>(fake_device{ first, 1 })));
+	CHECK(!registry.insert(first, std::make_unique<fake_device>(fake_device{ first, 2 })));
+	CHECK(registry.size() == 1);
+	CHECK(registry.find(first) != nullptr && registry.find(first)->id == 1);
+	CHECK(registry.remove((const void*)(0x10061)) == nullptr);
+
+	auto removed = registry.remove(first);
+	CHECK(removed != nullptr && removed->id == 1);
+	CHECK(registry.find(first) == nullptr);
+	CHECK(registry.size() == 0);
+
+	// Enough devices to grow the table a few times
+	std::vector<const void*> many;
+	for (auto i = 0; i < 1000; i++) {
+		many.push_back((const void*)((uintptr_t)(0x10041 + 0x20 * i)));
+		registry.insert(many.back(), std::make_unique<fake_device>(fake_device{ many.back(), i }));
+	}
+
+	auto found = 0;
+	for (auto i = 0; i < 1000; i++) {
+		const auto device = registry.find(many[i]);
+		if (device != nullptr && device->id == i)
+			found++;
+	}
+
+	CHECK(found == 1000);
+	CHECK(registry.size() == 1000);
+
+	for (const auto handle : many)
+		registry.remove(handle);
+
+	CHECK(registry.size() == 0);
+
+	// Plug and unplug at random against a plain map, every device has to
+	// stay reachable through removals shifting others back
+	fake_device_source source(48, 1);
+	std::unordered_map<const void*, int> reference;
+	auto lost = 0;
+	auto strays = 0;
+	auto iteration_mismatches = 0;
+
+	for (auto i = 0; i < 200000; i++) {
+		const auto event = source.next();
+		apply(&registry, event, i);
+		if (event.added)
+			reference[event.handle] = i;
+		else
+			reference.erase(event.handle);
+
+		if (!event.added && registry.find(event.handle) != nullptr)
+			strays++;
+
+		for (const auto &entry : reference) {
+			const auto device = registry.find(entry.first);
+			if (device == nullptr || device->id != entry.second)
+				lost++;
+		}
+
+		if (i % 64 != 0)
+			continue;
+
+		size_t visited = 0;
+		registry.for_each([&](const fake_device &device)
+		{
+			const auto it = reference.find(device.handle);
+			if (it != reference.end() && it->second == device.id)
+				visited++;
+		});
+
+		if (visited != reference.size() || registry.size() != reference.size())
+			iteration_mismatches++;
+	}
+
+	CHECK(lost == 0);
+	CHECK(strays == 0);
+	CHECK(iteration_mismatches == 0);
+}
+
+// Time looking up the device for each report and print ns per report
+template<typename F>
+static void time_lookups(
+	const char *name,
+	const int count,
+	const std::vector<const void*> &reports,
+	F lookup
+) {
+	using clock = std::chrono::steady_clock;
+	static const size_t lookups = 10000000;
+
+	uintptr_t sink = 0;
+	const auto start = clock::now();
+	for (auto i = 0u; i < lookups; i++)
+		sink += (uintptr_t)(lookup(reports[i % reports.size()]));
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << count << " devices " << name << " " << ns / lookups
+		<< " ns/report (" << sink % 10 << ")" << std::endl;
+}
+
+/**
+ * bench_registry - Time report dispatch and plugging
+ *
+ * Dispatch is compared against the linear scan over handles joystick used
+ * before the registry.
+ */
+void bench_registry()
+{
+	using clock = std::chrono::steady_clock;
+
+	for (const auto count : { 2, 8, 32 }) {
+		device_registry<fake_device> registry;
+		std::vector<std::pair<const void*, std::unique_ptr<fake_device>>> scanned;
+
+		fake_device_source source((size_t)(count), 1);
+		while (source.devices().size() < (size_t)(count)) {
+			const auto event = source.next();
+			apply(&registry, event, 0);
+		}
+
+		for (const auto handle : source.devices())
+			scanned.emplace_back(handle, std::make_unique<fake_device>(fake_device{ handle, 0 }));
+
+		// Reports come from the devices in no particular order
+		std::minstd_rand random(1);
+		std::vector<const void*> reports(4096);
+		for (auto &handle : reports)
+			handle = source.devices()[random() % count];
+
+		time_lookups("registry", count, reports, [&](const void *handle)
+		{
+			return registry.find(handle);
+		});
+
+		time_lookups("scan", count, reports, [&](const void *handle) -> fake_device*
+		{
+			for (const auto &entry : scanned) {
+				if (entry.first == handle)
+					return entry.second.get();
+			}
+
+			return nullptr;
+		});
+	}
+
+	static const int events = 1000000;
+	device_registry<fake_device> registry;
+	fake_device_source source(32, 2);
+
+	const auto start = clock::now();
+	for (auto i = 0; i < events; i++)
+		apply(&registry, source.next(), i);
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "churn " << ns / events << " ns/event, "
+		<< registry.size() << " left" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "test.h"
+#include "../tgm3_input/socd.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <random>
+#include <vector>
+
+/*
+ * The list based order keyboard and joystick used to keep: new presses go
+ * to the front in bit order, releases are removed
+ */
+class list_order {
+	std::list<unsigned short> pressed;
+	unsigned short held = 0;
+
+public:
+	void update(const unsigned short dir_buttons)
+	{
+		const auto now = (unsigned short)(dir_buttons & dir_all);
+		for (unsigned short dir = dir_right; dir <= dir_up; dir <<= 1) {
+			if ((now & dir) && !(held & dir))
+				pressed.push_front(dir);
+			else if (!(now & dir) && (held & dir))
+				pressed.remove(dir);
+		}
+
+		held = now;
+	}
+
+	unsigned short newest() const
+	{
+		return pressed.empty() ? 0 : pressed.front();
+	}
+
+	unsigned short oldest() const
+	{
+		return pressed.empty() ? 0 : pressed.back();
+	}
+};
+
+// Random held direction words, mostly one bit changing at a time
+static std::vector<unsigned short> random_directions(const size_t count)
+{
+	std::minstd_rand random(1);
+	std::vector<unsigned short> words(count);
+
+	unsigned short held = 0;
+	for (auto &word : words) {
+		if (random() % 8 == 0)
+			held = (unsigned short)(random() & dir_all);
+		else
+			held ^= (unsigned short)(dir_right << (random() % 4));
+
+		word = held;
+	}
+
+	return words;
+}
+
+// Resolve a sequence of held words and return the last output
+template<typename Policy>
+static unsigned short resolve_all(std::initializer_list<unsigned short> words)
+{
+	direction_priority priority;
+	unsigned short out = 0;
+	for (const auto word : words)
+		out = priority.update<Policy>(word);
+
+	return out;
+}
+
+void test_socd()
+{
+	const auto lr = (unsigned short)(dir_left | dir_right);
+	const auto ud = (unsigned short)(dir_up | dir_down);
+
+	// Last wins follows the newest press and falls back when it's released
+	CHECK(resolve_all<socd_last_wins>({ dir_left, lr }) == dir_right);
+	CHECK(resolve_all<socd_last_wins>({ dir_left, lr, dir_left }) == dir_left);
+	CHECK(resolve_all<socd_last_wins>({ dir_right, lr, dir_right | dir_up }) == dir_up);
+
+	// First wins holds the first press until it's released
+	CHECK(resolve_all<socd_first_wins>({ dir_left, lr }) == dir_left);
+	CHECK(resolve_all<socd_first_wins>({ dir_left, lr, dir_right }) == dir_right);
+
+	// Opposites cancel and leave the other axis alone
+	CHECK(resolve_all<socd_neutral>({ lr }) == 0);
+	CHECK(resolve_all<socd_neutral>({ ud | dir_left }) == dir_left);
+
+	// Up beats down, left and right are last wins
+	CHECK(resolve_all<socd_up_priority>({ dir_down, ud }) == dir_up);
+	CHECK(resolve_all<socd_up_priority>({ dir_right, lr | dir_down }) == (dir_left | dir_down));
+
+	// Up beats down, left and right cancel
+	CHECK(resolve_all<socd_hitbox>({ dir_down, ud | lr }) == dir_up);
+
+	// Presses in the same update count in bit order, so left is newer
+	CHECK(resolve_all<socd_last_wins>({ lr }) == dir_left);
+	CHECK(resolve_all<socd_first_wins>({ lr }) == dir_right);
+
+	// Other buttons don't count as directions
+	CHECK(resolve_all<socd_last_wins>({ (unsigned short)(dir_up | 2 | 0x8000) }) == dir_up);
+
+	direction_priority cleared;
+	cleared.update<socd_last_wins>(dir_left);
+	cleared.clear();
+	CHECK(cleared.update<socd_last_wins>(dir_right) == dir_right);
+
+	// The packed order matches the old list for any sequence
+	direction_order packed;
+	list_order reference;
+	auto mismatches = 0;
+	for (const auto word : random_directions(100000)) {
+		packed.update(word);
+		reference.update(word);
+		if (packed.newest() != reference.newest()
+		 || packed.oldest() != reference.oldest())
+			mismatches++;
+	}
+
+	CHECK(mismatches == 0);
+}
+
+// Time one resolver over the words and print ns per update
+template<typename F>
+static void time_updates(const char *name, const std::vector<unsigned short> &words, F update)
+{
+	using clock = std::chrono::steady_clock;
+
+	unsigned sink = 0;
+	const auto start = clock::now();
+	for (const auto word : words)
+		sink += update(word);
+	const auto time = clock::now() - start;
+
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << name << " " << ns / words.size() << " ns/update"
+		<< " (" << sink % 10 << ")" << std::endl;
+}
+
+// Visible outside this file, so the direction order can't be optimized out
+// for policies that don't read it, just like a device's in the game
+direction_priority bench_priority[6];
+
+/**
+ * bench_socd - Time every policy and the old list based order
+ */
+void bench_socd()
+{
+	const auto words = random_directions(10000000);
+
+	auto &p = bench_priority;
+	time_updates("last", words, [&](unsigned short w) { return p[0].update<socd_last_wins>(w); });
+	time_updates("first", words, [&](unsigned short w) { return p[1].update<socd_first_wins>(w); });
+	time_updates("neutral", words, [&](unsigned short w) { return p[2].update<socd_neutral>(w); });
+	time_updates("up", words, [&](unsigned short w) { return p[3].update<socd_up_priority>(w); });
+	time_updates("hitbox", words, [&](unsigned short w) { return p[4].update<socd_hitbox>(w); });
+	time_updates("configured", words, [&](unsigned short w) { return p[5].update(w, socd_mode::hitbox); });
+
+	list_order reference;
+	time_updates("old list", words, [&](unsigned short w)
+	{
+		reference.update(w);
+		return reference.newest();
+	});
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "test.h"
+#include "../demo_format/demo_info.h"
+#include "../demo_format/demo_reader.h"
+#include "../demo_format/demo_split.h"
+#include "../demo_format/demo_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static const char session_filename[] = "input_test_session.dem";
+static const char session_info[] = "input_test_session.inf";
+static const char copy_filename[] = "input_test_copy.dem";
+static const char copy_info[] = "input_test_copy.inf";
+
+// Demo frames the games of the session start and end at
+static const uint32_t game_starts[] = { 100, 1500 };
+static const uint32_t game_ends[] = { 1200, 2800 };
+static const uint32_t session_frames = 3000;
+
+/**
+ * record_session - Record a two game session the way tgm3_input does
+ *
+ * SRAM is read at boot, exactly on each game's start frame, and during
+ * the second game. Games are indexed on game over like
+ * rec_calc_final_grade does, which counts a read made right before a
+ * game's first poll as belonging to what came before.
+ */
+static std::vector<demo_game> record_session()
+{
+	demo_writer writer;
+	CHECK(writer.open(session_filename));
+
+	std::vector<uint32_t> rng_before;
+	std::vector<uint32_t> sram_frames;
+	std::vector<demo_game> games;
+	uint32_t rng = 0;
+
+	const auto read_sram = [&](const uint32_t frame)
+	{
+		const uint32_t data[] = { frame, (uint32_t)(sram_frames.size()) };
+		writer.add_sram(sram_frames.size() % 4 != 1, data, sizeof(data));
+		sram_frames.push_back(frame);
+	};
+
+	for (auto frame = 0u; frame < session_frames; frame++) {
+		if (frame == 0)
+			read_sram(frame);
+		if (frame == 0 || frame == game_starts[0] || frame == game_starts[1]
+		 || frame == game_starts[1] + 1 || frame == 2000)
+			read_sram(frame);
+
+		for (auto call = 0u; call < frame % 3; call++)
+			writer.add_random((int32_t)(rng++ * 13));
+
+		rng_before.push_back(rng);
+		writer.add_frame(frame * 0x10001 / 50);
+
+		for (auto i = 0; i < 2; i++) {
+			if (frame + 1 != game_ends[i])
+				continue;
+
+			// Grade calculation calls the RNG after the last poll
+			writer.add_random((int32_t)(rng++ * 13));
+
+			demo_game game = {};
+			game.frames_played = (int)(game_ends[i] - game_starts[i]);
+			game.mode = (short)(i + 1);
+			game.level = (short)(500 + i);
+			game.grade = (char)(10 + i);
+			game.start_frame = 5000 + (int)(game_starts[i]);
+			game.has_index = true;
+			game.index.start_frame = game_starts[i];
+			game.index.end_frame = frame + 1;
+			game.index.start_rng = rng_before[game_starts[i]];
+			game.index.end_rng = rng;
+			game.index.start_sram = (uint32_t)(std::upper_bound(
+				sram_frames.begin(),
+				sram_frames.end(),
+				game_starts[i]) - sram_frames.begin());
+			game.index.end_sram = (uint32_t)(sram_frames.size());
+			games.push_back(game);
+		}
+	}
+
+	writer.close();
+
+	std::ofstream info(session_info, std::ios::binary);
+	info.write(&demo_info_version, 1);
+	for (const auto &game : games)
+		write_demo_game(info, game);
+
+	return games;
+}
+
+/**
+ * split - Copy one game of the session, like demo_dump split
+ * @game_num:	Game to copy
+ * @copy:	Output, the copy's record as written to its .inf
+ */
+static bool split(const int game_num, demo_game *copy)
+{
+	std::ifstream input(session_info, std::ios::binary);
+	std::vector<demo_game> games;
+	if (read_demo_info(input, &games) != demo_info_version)
+		return false;
+
+	loaded_demo demo;
+	demo_game_index preamble;
+	if (!load_demo(session_filename, &demo)
+	 || !plan_split(demo, games[0], games[game_num], &preamble, copy))
+		return false;
+
+	demo_writer output;
+	if (!output.open(copy_filename))
+		return false;
+
+	copy_range(demo, preamble, &output);
+	copy_range(demo, games[game_num].index, &output);
+	output.close();
+
+	std::ofstream info(copy_info, std::ios::binary);
+	info.write(&demo_info_version, 1);
+	write_demo_game(info, *copy);
+	return info.good();
+}
+
+static bool same_index(const demo_game_index &a, const demo_game_index &b)
+{
+	return a.start_frame == b.start_frame && a.end_frame == b.end_frame
+	    && a.start_rng == b.start_rng && a.end_rng == b.end_rng
+	    && a.start_sram == b.start_sram && a.end_sram == b.end_sram;
+}
+
+void test_split()
+{
+	const auto games = record_session();
+	CHECK(games.size() == 2);
+
+	loaded_demo session;
+	CHECK(load_demo(session_filename, &session));
+	CHECK(session.buttons.size() == session_frames);
+
+	// The reads at each game's start frame come before its first poll
+	CHECK(games[0].index.start_sram == 3);
+	CHECK(games[1].index.start_sram == 4);
+	CHECK(games[1].index.end_sram == 6);
+
+	demo_game copy;
+	CHECK(split(1, &copy));
+
+	// Boot up to game 0's first poll, then game 1
+	const auto &game = games[1];
+	const auto preamble_frames = game_starts[0];
+	const auto preamble_rng = session.rng_before[preamble_frames];
+	const auto game_rng = game.index.end_rng - game.index.start_rng;
+
+	demo_game_index expect;
+	expect.start_frame = preamble_frames;
+	expect.end_frame = preamble_frames + game_ends[1] - game_starts[1];
+	expect.start_rng = preamble_rng;
+	expect.end_rng = preamble_rng + game_rng;
+	expect.start_sram = 3;
+	expect.end_sram = 3 + 2;
+	CHECK(same_index(copy.index, expect));
+	CHECK(copy.start_frame == games[0].start_frame);
+	CHECK(copy.frames_played == game.frames_played);
+	CHECK(copy.mode == game.mode && copy.level == game.level && copy.grade == game.grade);
+
+	// The .inf written next to the copy says the same
+	std::ifstream input(copy_info, std::ios::binary);
+	std::vector<demo_game> copy_games;
+	CHECK(read_demo_info(input, &copy_games) == demo_info_version);
+	CHECK(copy_games.size() == 1);
+	if (copy_games.size() == 1)
+		CHECK(same_index(copy_games[0].index, expect));
+
+	loaded_demo result;
+	CHECK(load_demo(copy_filename, &result));
+	CHECK(result.buttons.size() == expect.end_frame);
+	CHECK(result.rng_values.size() == expect.end_rng);
+	CHECK(result.sram.size() == expect.end_sram);
+	if (result.buttons.size() != expect.end_frame
+	 || result.rng_values.size() != expect.end_rng
+	 || result.sram.size() != expect.end_sram)
+		return;
+
+	// Every record lands where the same poll of the session put it
+	auto wrong = 0;
+	for (auto frame = 0u; frame < expect.end_frame; frame++) {
+		const auto source = frame < preamble_frames
+			? frame
+			: frame - preamble_frames + game_starts[1];
+
+		const auto offset = frame < preamble_frames
+			? 0
+			: game.index.start_rng - preamble_rng;
+
+		if (result.buttons[frame] != session.buttons[source]
+		 || result.rng_before[frame] + offset != session.rng_before[source])
+			wrong++;
+	}
+	CHECK(wrong == 0);
+
+	CHECK(std::equal(
+		result.rng_values.begin(),
+		result.rng_values.begin() + preamble_rng,
+		session.rng_values.begin()));
+	CHECK(std::equal(
+		result.rng_values.begin() + preamble_rng,
+		result.rng_values.end(),
+		session.rng_values.begin() + game.index.start_rng));
+
+	// Boot reads, the one on game 0's start frame, then game 1's reads
+	// after its first poll. The one on game 1's start frame was game 0's.
+	const uint32_t sram_frames[] = {
+		0, 0, preamble_frames, preamble_frames + 1, preamble_frames + 500
+	};
+	const uint32_t sram_sources[] = { 0, 1, 2, 4, 5 };
+	for (auto i = 0; i < 5; i++) {
+		const auto &read = result.sram[i];
+		const auto &source = session.sram[sram_sources[i]];
+		CHECK(read.record.frame == sram_frames[i]);
+		CHECK(read.record.success == source.record.success);
+		CHECK(read.data == source.data);
+	}
+
+	// Game 0 is the preamble and itself, an exact copy
+	CHECK(split(0, &copy));
+	CHECK(same_index(copy.index, games[0].index));
+
+	loaded_demo first;
+	CHECK(load_demo(copy_filename, &first));
+	CHECK(first.buttons.size() == game_ends[0]);
+	CHECK(std::equal(first.buttons.begin(), first.buttons.end(), session.buttons.begin()));
+	CHECK(std::equal(first.rng_before.begin(), first.rng_before.end(), session.rng_before.begin()));
+	CHECK(first.sram.size() == games[0].index.end_sram);
+
+	// A game that doesn't fit in the demo isn't split
+	auto broken = games[1];
+	broken.index.end_frame = session_frames + 1;
+	demo_game_index preamble;
+	CHECK(!plan_split(session, games[0], broken, &preamble, &copy));
+
+	std::remove(session_filename);
+	std::remove(session_info);
+	std::remove(copy_filename);
+	std::remove(copy_info);
+}
+
+/**
+ * bench_split - Time loading a session and copying a game out of it
+ */
+void bench_split()
+{
+	using clock = std::chrono::steady_clock;
+	static const int splits = 200;
+
+	record_session();
+
+	demo_game copy;
+	const auto start = clock::now();
+	for (auto i = 0; i < splits; i++)
+		split(1, &copy);
+	const auto time = clock::now() - start;
+
+	const auto us = std::chrono::duration<double, std::micro>(time).count();
+	std::cout << "split " << us / splits << " us/split"
+		<< " (" << copy.index.end_frame % 10 << ")" << std::endl;
+
+	std::remove(session_filename);
+	std::remove(session_info);
+	std::remove(copy_filename);
+	std::remove(copy_info);
+}
\ No newline at end of file
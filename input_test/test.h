@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+
+/*
+ * Checks and benchmarks for the parts of the input code that don't depend
+ * on Windows, so they run on any machine. Each suite has a test that
+ * reports failed checks through CHECK, and a benchmark that prints
+ * timings.
+ */
+
+// Print a failed check and count it
+#define CHECK(cond) check((cond), #cond, __FILE__, __LINE__)
+
+bool check(bool ok, const char *what, const char *file, int line);
+
+// Write a config for a test, removing a compiled one left from earlier
+void write_test_config(const char *filename, const std::string &contents);
+
+// Remove a test config and the compiled config loading it wrote
+void remove_test_config(const char *filename);
+
+void test_config();
+void bench_config();
+
+void test_socd();
+void bench_socd();
+
+void test_publish();
+void bench_publish();
+
+void test_hid();
+void bench_hid();
+
+void test_registry();
+void bench_registry();
+
+void test_latch();
+void bench_latch();
+
+void test_debounce();
+void bench_debounce();
+
+#ifdef __linux__
+void test_uinput();
+void bench_uinput();
+#endif
+
+void test_thread();
+void bench_thread();
+
+void test_latency();
+void bench_latency();
+
+void test_codec();
+void bench_codec();
+
+void test_reader();
+void bench_reader();
+
+void test_writer();
+void bench_writer();
+
+void test_inject();
+void bench_inject();
+
+void test_watcher();
+void bench_watcher();
+
+void test_split();
+void bench_split();
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "test.h"
+#include "../tgm3_input/input_thread.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+// What the handler saw, it can't take any context
+static std::atomic<uint32_t> handled_bits(0);
+static std::atomic<int> handler_calls(0);
+static std::atomic<bool> handled_elsewhere(true);
+static std::thread::id requesting_thread;
+
+static void record_requests(const uint32_t requests)
+{
+	if (std::this_thread::get_id() == requesting_thread)
+		handled_elsewhere.store(false, std::memory_order_relaxed);
+
+	handled_bits.fetch_or(requests, std::memory_order_relaxed);
+	handler_calls.fetch_add(1, std::memory_order_release);
+}
+
+// Wait for the handler to have run calls times in total
+static bool wait_for_calls(const int calls)
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (handler_calls.load(std::memory_order_acquire) < calls) {
+		if (std::chrono::steady_clock::now() > deadline)
+			return false;
+
+		std::this_thread::yield();
+	}
+
+	return true;
+}
+
+// A source that can't be opened
+class failing_source : public input_source {
+public:
+	bool open() override
+	{
+		return false;
+	}
+
+	void pump() override
+	{
+	}
+
+	void wake() override
+	{
+	}
+
+	void close() override
+	{
+	}
+};
+
+void test_thread()
+{
+	requesting_thread = std::this_thread::get_id();
+	handled_bits.store(0);
+	handler_calls.store(0);
+
+	{
+		input_thread failing;
+		CHECK(!failing.start(std::unique_ptr<input_source>(new failing_source()), record_requests));
+		CHECK(!failing.running());
+	}
+
+	input_thread worker;
+	CHECK(worker.start(std::unique_ptr<input_source>(new condition_source()), record_requests));
+	CHECK(worker.running());
+
+	// Can't start twice
+	CHECK(!worker.start(std::unique_ptr<input_source>(new condition_source()), record_requests));
+
+	worker.request(1);
+	CHECK(wait_for_calls(1));
+	CHECK(handled_bits.load() == 1);
+
+	// Every bit gets through, merged or not
+	for (auto bit = 0; bit < 32; bit++)
+		worker.request(1u << bit);
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (handled_bits.load() != 0xFFFFFFFF && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::yield();
+
+	CHECK(handled_bits.load() == 0xFFFFFFFF);
+	CHECK(handler_calls.load() <= 33);
+	CHECK(handled_elsewhere.load());
+	CHECK(worker.request_latency().count() > 0);
+
+	worker.stop();
+	CHECK(!worker.running());
+
+	// A stopped thread can be started again
+	CHECK(worker.start(std::unique_ptr<input_source>(new condition_source()), record_requests));
+	const auto calls = handler_calls.load();
+	worker.request(2);
+	CHECK(wait_for_calls(calls + 1));
+	worker.stop();
+}
+
+/**
+ * bench_thread - Time requests to their handler with the condition source
+ *
+ * Measures the thread's own latency, the raw input window only adds the
+ * message wait on top of it.
+ */
+void bench_thread()
+{
+	static const int requests = 20000;
+
+	handler_calls.store(0);
+
+	input_thread worker;
+	if (!worker.start(std::unique_ptr<input_source>(new condition_source()), record_requests))
+		return;
+
+	// One at a time so each is timed from an idle thread
+	for (auto i = 1; i <= requests; i++) {
+		worker.request(1);
+		if (!wait_for_calls(i))
+			break;
+	}
+
+	const auto &latency = worker.request_latency();
+	std::cout << latency.count() << " requests, us p50 " << latency.percentile(50)
+		<< " p99 " << latency.percentile(99)
+		<< " p99.9 " << latency.percentile(99.9)
+		<< " max " << latency.maximum() << std::endl;
+
+	worker.stop();
+}
\ No newline at end of file
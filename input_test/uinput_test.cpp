@@ -0,0 +1,269 @@
+// Only on Linux, where evdev_input exists
+#ifdef __linux__
+
+#include "test.h"
+#include "../config.h"
+#include "../tgm3_input/base_input.h"
+#include "../tgm3_input/evdev.h"
+#include "../tgm3_input/latency.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+
+static const char uinput_filename[] = "uinput_test.cfg";
+static const char stick_name[] = "tgm3_input test stick";
+
+// evdev_input calls this from its reader thread
+static std::atomic<int> notifications(0);
+
+void notify_buttons_changed()
+{
+	notifications.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void emit(const int fd, const int type, const int code, const int value)
+{
+	input_event event = {};
+	event.type = (unsigned short)(type);
+	event.code = (unsigned short)(code);
+	event.value = value;
+	write(fd, &event, sizeof(event));
+}
+
+static void abs_setup(const int fd, const int code, const int minimum, const int maximum)
+{
+	uinput_abs_setup setup = {};
+	setup.code = (unsigned short)(code);
+	setup.absinfo.minimum = minimum;
+	setup.absinfo.maximum = maximum;
+	ioctl(fd, UI_ABS_SETUP, &setup);
+}
+
+/**
+ * create_stick - Make a virtual arcade stick
+ *
+ * 8 buttons from BTN_TRIGGER, X and Y, a gas pedal axis and a hat. Gas is
+ * ABS_GAS, 0x09, which used to become the hat switch usage. Returns the
+ * uinput fd, -1 if uinput can't be used here.
+ */
+static int create_stick()
+{
+	const auto fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	ioctl(fd, UI_SET_EVBIT, EV_KEY);
+	for (auto i = 0; i < 8; i++)
+		ioctl(fd, UI_SET_KEYBIT, BTN_TRIGGER + i);
+
+	ioctl(fd, UI_SET_EVBIT, EV_ABS);
+	for (const auto code : { ABS_X, ABS_Y, ABS_GAS, ABS_HAT0X, ABS_HAT0Y })
+		ioctl(fd, UI_SET_ABSBIT, code);
+
+	abs_setup(fd, ABS_X, 0, 255);
+	abs_setup(fd, ABS_Y, 0, 255);
+	abs_setup(fd, ABS_GAS, 0, 255);
+	abs_setup(fd, ABS_HAT0X, -1, 1);
+	abs_setup(fd, ABS_HAT0Y, -1, 1);
+
+	uinput_setup setup = {};
+	setup.id.bustype = BUS_USB;
+	setup.id.vendor = 0x1234;
+	setup.id.product = 0x5678;
+	strncpy(setup.name, stick_name, sizeof(setup.name) - 1);
+
+	if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+// Whether an event node for the stick exists yet, udev may take a while
+static bool stick_node_exists()
+{
+	auto *dir = opendir("/dev/input");
+	if (dir == nullptr)
+		return false;
+
+	auto found = false;
+	while (const auto *entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "event", 5) != 0)
+			continue;
+
+		const auto path = std::string("/dev/input/") + entry->d_name;
+		const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+
+		char name[128] = {};
+		ioctl(fd, EVIOCGNAME(sizeof(name) - 1), name);
+		close(fd);
+
+		if (strcmp(name, stick_name) == 0)
+			found = true;
+	}
+
+	closedir(dir);
+	return found;
+}
+
+/**
+ * open_stick - Create the stick and have an evdev_input read it
+ * @input:	Initialized here
+ *
+ * Returns the uinput fd, -1 with the reason printed if it can't be done
+ * on this machine.
+ */
+static int open_stick(evdev_input *input)
+{
+	const auto fd = create_stick();
+	if (fd == -1) {
+		std::cout << "uinput: /dev/uinput not available, skipped" << std::endl;
+		return -1;
+	}
+
+	auto waited = 0;
+	for (; waited < 100 && !stick_node_exists(); waited++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	if (waited == 100) {
+		std::cout << "uinput: no event node appeared, skipped" << std::endl;
+		ioctl(fd, UI_DEV_DESTROY);
+		close(fd);
+		return -1;
+	}
+
+	write_test_config(uinput_filename,
+		"joystick\n"
+		"{\n"
+		"\t\"" + std::string(stick_name) + "\"\n"
+		"\t{\n"
+		"\t\tplayer 1\n"
+		"\t\tleft_right 0\n"
+		"\t\tup_down 1\n"
+		"\t\tA 0\n"
+		"\t\tB 1\n"
+		"\t\tC 2\n"
+		"\t\tD 3\n"
+		"\t\tstart 7\n"
+		"\t}\n"
+		"}\n");
+
+	std::vector<std::string> diagnostics;
+	input->init(config(uinput_filename), &diagnostics);
+	CHECK(diagnostics.empty());
+
+	remove_test_config(uinput_filename);
+	return fd;
+}
+
+// Wait for the reader thread to publish buttons
+static bool wait_for(const evdev_input &input, const unsigned short buttons)
+{
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (input.get_buttons_1p() != buttons) {
+		if (std::chrono::steady_clock::now() > deadline)
+			return false;
+
+		std::this_thread::yield();
+	}
+
+	return true;
+}
+
+static void send_event(const int fd, const int type, const int code, const int value)
+{
+	emit(fd, type, code, value);
+	emit(fd, EV_SYN, SYN_REPORT, 0);
+}
+
+void test_uinput()
+{
+	evdev_input input;
+	const auto fd = open_stick(&input);
+	if (fd == -1)
+		return;
+
+	// The gas pedal at 0 would be a hat held up if it were a hat switch
+	send_event(fd, EV_ABS, ABS_X, 128);
+	send_event(fd, EV_ABS, ABS_Y, 128);
+	CHECK(wait_for(input, 0));
+
+	send_event(fd, EV_KEY, BTN_TRIGGER, 1);
+	CHECK(wait_for(input, base_input::mask_A));
+	send_event(fd, EV_KEY, BTN_TRIGGER, 0);
+	CHECK(wait_for(input, 0));
+
+	send_event(fd, EV_KEY, BTN_TRIGGER + 7, 1);
+	CHECK(wait_for(input, base_input::mask_start));
+	send_event(fd, EV_KEY, BTN_TRIGGER + 7, 0);
+
+	send_event(fd, EV_ABS, ABS_X, 0);
+	CHECK(wait_for(input, base_input::mask_left));
+	send_event(fd, EV_ABS, ABS_X, 128);
+	CHECK(wait_for(input, 0));
+
+	send_event(fd, EV_ABS, ABS_GAS, 255);
+	send_event(fd, EV_ABS, ABS_HAT0X, 1);
+	CHECK(wait_for(input, base_input::mask_right));
+
+	emit(fd, EV_ABS, ABS_HAT0Y, -1);
+	emit(fd, EV_KEY, BTN_TRIGGER + 1, 1);
+	emit(fd, EV_SYN, SYN_REPORT, 0);
+	CHECK(wait_for(input,
+		base_input::mask_up | base_input::mask_right | base_input::mask_B));
+
+	CHECK(notifications.load() > 0);
+
+	// Unplugging lets go of everything
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	CHECK(wait_for(input, 0));
+}
+
+/**
+ * bench_uinput - Time from writing an event to its buttons being published
+ *
+ * Covers the kernel, the reader thread waking up and decoding.
+ */
+void bench_uinput()
+{
+	static const int presses = 2000;
+
+	evdev_input input;
+	const auto fd = open_stick(&input);
+	if (fd == -1)
+		return;
+
+	latency_histogram latency_us;
+	for (auto i = 0; i < presses; i++) {
+		const auto value = (i + 1) % 2;
+		const auto start = std::chrono::steady_clock::now();
+		send_event(fd, EV_KEY, BTN_TRIGGER, value);
+		if (!wait_for(input, value != 0 ? base_input::mask_A : 0))
+			break;
+
+		const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		latency_us.record((uint32_t)(us));
+	}
+
+	std::cout << latency_us.count() << " presses, us p50 " << latency_us.percentile(50)
+		<< " p99 " << latency_us.percentile(99)
+		<< " max " << latency_us.maximum() << std::endl;
+
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+}
+
+#endif
\ No newline at end of file
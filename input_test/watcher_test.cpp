@@ -0,0 +1,242 @@
+#include "test.h"
+#include "../tgm3_input/file_watcher.h"
+#include "../tgm3_input/snapshot.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+static const char watch_filename[] = "input_test_watch.cfg";
+static const char other_filename[] = "input_test_other.cfg";
+static const char temp_filename[] = "input_test_watch.tmp";
+
+/**
+ * wait_until - Poll until a condition holds
+ * @done:	Condition
+ *
+ * Returns false if it still doesn't after two seconds, which is far longer
+ * than a change notification takes.
+ */
+template<typename F>
+static bool wait_until(F done)
+{
+	const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+	while (!done()) {
+		if (std::chrono::steady_clock::now() > give_up)
+			return false;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	return true;
+}
+
+static void write_file(const char *filename, const char *contents)
+{
+	std::ofstream(filename, std::ios::binary) << contents;
+}
+
+/**
+ * test_file_watcher - Edit the watched file the ways editors do
+ *
+ * Written in place, and written elsewhere then renamed over it. Changes to
+ * other files in the directory don't count.
+ */
+static void test_file_watcher()
+{
+	write_file(watch_filename, "first 1");
+
+	auto watcher = make_file_watcher(watch_filename);
+	CHECK(watcher != nullptr);
+	if (watcher == nullptr)
+		return;
+
+	std::atomic<int> changes(0);
+	std::atomic<bool> stopped(false);
+	std::thread waiter([&]
+	{
+		while (watcher->wait())
+			changes++;
+
+		stopped = true;
+	});
+
+	write_file(watch_filename, "second 2");
+	CHECK(wait_until([&] { return changes.load() >= 1; }));
+
+	// Notifications come fast, one that hasn't shown up by now won't
+	const auto before = changes.load();
+	write_file(other_filename, "other 1");
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	CHECK(changes.load() == before);
+
+	write_file(temp_filename, "third 3");
+	CHECK(std::rename(temp_filename, watch_filename) == 0);
+	CHECK(wait_until([&] { return changes.load() > before; }));
+
+	// stop wakes a wait that has nothing else to wake it
+	watcher->stop();
+	const auto woke = wait_until([&] { return stopped.load(); });
+	CHECK(woke);
+
+	if (woke) {
+		waiter.join();
+	} else {
+		// Still blocked, it can't be allowed to see the watcher go
+		watcher.release();
+		waiter.detach();
+	}
+
+	// And stays stopped for later waits
+	if (woke)
+		CHECK(!watcher->wait());
+
+	std::remove(watch_filename);
+	std::remove(other_filename);
+	std::remove(temp_filename);
+}
+
+// A published version that records when it's freed
+struct tracked_version {
+	uint32_t id;
+	std::atomic<bool> *freed;
+
+	tracked_version(const uint32_t id, std::atomic<bool> *freed) :
+		id(id),
+		freed(freed)
+	{
+	}
+
+	~tracked_version()
+	{
+		freed[id].store(true);
+	}
+};
+
+/**
+ * test_snapshot - Publish flat out while the input thread reads
+ *
+ * The reader checks the version it holds wasn't freed, both when it gets
+ * it and after holding it a while, before going quiescent. Once it stops,
+ * everything but the current version and the last one replaced is freed.
+ */
+static void test_snapshot()
+{
+	static const uint32_t publishes = 200000;
+
+	std::unique_ptr<std::atomic<bool>[]> freed(new std::atomic<bool>[publishes]);
+	for (auto i = 0u; i < publishes; i++)
+		freed[i].store(false);
+
+	std::atomic<int> early(0);
+	std::atomic<int> backwards(0);
+
+	{
+		snapshot<tracked_version> versions;
+		std::atomic<bool> done(false);
+
+		std::thread reader([&]
+		{
+			uint32_t last = 0;
+			while (!done.load()) {
+				const auto *version = versions.get();
+				if (version != nullptr) {
+					const auto id = version->id;
+					if (freed[id].load())
+						early++;
+					if (id < last)
+						backwards++;
+
+					last = id;
+
+					// Long enough for the publisher to replace it
+					for (auto spin = 0; spin < 200; spin++) {
+						if (freed[id].load()) {
+							early++;
+							break;
+						}
+					}
+				}
+
+				snapshot_quiescent();
+			}
+		});
+
+		for (auto i = 0u; i < publishes; i++) {
+			versions.publish(std::unique_ptr<const tracked_version>(
+				new tracked_version(i, freed.get())));
+
+			if (i % 1024 == 0)
+				std::this_thread::yield();
+		}
+
+		done = true;
+		reader.join();
+
+		// This thread is the reader now
+		snapshot_quiescent();
+		versions.publish(nullptr);
+
+		auto left = 0u;
+		for (auto i = 0u; i < publishes; i++) {
+			if (!freed[i].load())
+				left++;
+		}
+
+		// The last version, replaced by null after the reader's last
+		// quiescent point
+		CHECK(left == 1);
+		CHECK(!freed[publishes - 1].load());
+	}
+
+	CHECK(early == 0);
+	CHECK(backwards == 0);
+	CHECK(freed[publishes - 1].load());
+}
+
+void test_watcher()
+{
+	test_file_watcher();
+	test_snapshot();
+}
+
+/**
+ * bench_watcher - Time reading a snapshot and publishing one
+ */
+void bench_watcher()
+{
+	using clock = std::chrono::steady_clock;
+	static const uint32_t reads = 100000000;
+	static const uint32_t publishes = 1000000;
+
+	snapshot<uint32_t> value;
+	value.publish(std::unique_ptr<const uint32_t>(new uint32_t(1)));
+
+	uint32_t sink = 0;
+	auto start = clock::now();
+	for (auto i = 0u; i < reads; i++) {
+		sink += *value.get();
+		if (i % 256 == 0)
+			snapshot_quiescent();
+	}
+	auto time = clock::now() - start;
+
+	auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "get " << ns / reads << " ns/read"
+		<< " (" << sink % 10 << ")" << std::endl;
+
+	start = clock::now();
+	for (auto i = 0u; i < publishes; i++) {
+		value.publish(std::unique_ptr<const uint32_t>(new uint32_t(i)));
+		snapshot_quiescent();
+	}
+	time = clock::now() - start;
+
+	ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "publish " << ns / publishes << " ns/publish"
+		<< " (" << *value.get() % 10 << ")" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+#include "test.h"
+#include "../demo_format/background_writer.h"
+#include "../demo_format/demo_reader.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+static const char writer_filename[] = "input_test_writer.dem";
+
+// Records in the order they were made
+struct recorded_play {
+	std::vector<uint32_t> buttons;
+	std::vector<uint32_t> rng_counts;
+	std::vector<int32_t> rng_values;
+
+	// Frame and first data word of every SRAM read, ~0 if it failed
+	std::vector<std::pair<uint32_t, uint32_t>> sram;
+};
+
+/**
+ * record_play - Interleave every kind of record through a writer
+ * @writer:	Opened writer
+ * @frames:	Frames to record
+ *
+ * RNG calls and SRAM reads land between frames, so reading them back in
+ * order shows the writer thread kept them in order.
+ */
+static recorded_play record_play(
+	background_demo_writer *writer,
+	const uint32_t frames
+) {
+	recorded_play play;
+	for (auto frame = 0u; frame < frames; frame++) {
+		const auto calls = frame * 5 % 7 % 4;
+		for (auto call = 0u; call < calls; call++) {
+			const auto value = (int32_t)(frame * 31 + call) - 1000;
+			writer->add_random(value);
+			play.rng_values.push_back(value);
+
+			// Reads in the middle of a frame's calls too
+			if (frame % 401 == 0 && call == 0) {
+				const uint32_t data[] = { frame * 3, frame };
+				const auto success = frame % 802 == 0;
+				writer->add_sram(success, data, sizeof(data));
+				play.sram.push_back({ frame, success ? frame * 3 : ~0u });
+			}
+		}
+
+		const auto buttons = frame / 6 % 3 * (frame / 50 + 1);
+		writer->add_frame(buttons);
+		play.buttons.push_back(buttons);
+		play.rng_counts.push_back(calls);
+	}
+
+	return play;
+}
+
+// Read a stream of 32-bit items back whole
+template<typename T>
+static std::vector<T> read_column(const demo_reader &reader, const demo_stream stream)
+{
+	std::vector<T> items(reader.count(stream));
+	demo_column column(reader, stream);
+	if (!items.empty() && !column.read(items.data(), items.size() * sizeof(T)))
+		items.clear();
+
+	return items;
+}
+
+/**
+ * played_back - Whether a demo holds exactly what was recorded
+ * @filename:	Demo
+ * @expect:	What went into it
+ */
+static bool played_back(const char *filename, const recorded_play &expect)
+{
+	demo_reader reader;
+	if (!reader.open(filename) || !reader.complete())
+		return false;
+
+	std::vector<std::pair<uint32_t, uint32_t>> sram;
+	demo_column column(reader, demo_stream::sram);
+	for (auto i = 0u; i < reader.count(demo_stream::sram); i++) {
+		demo_sram_record record;
+		uint32_t data[2] = { ~0u, 0 };
+		if (!column.read(&record)
+		 || (record.success && !column.read(data, sizeof(data))))
+			return false;
+
+		sram.push_back({ record.frame, data[0] });
+	}
+
+	return read_column<uint32_t>(reader, demo_stream::buttons) == expect.buttons
+	    && read_column<uint32_t>(reader, demo_stream::rng_counts) == expect.rng_counts
+	    && read_column<int32_t>(reader, demo_stream::rng_values) == expect.rng_values
+	    && sram == expect.sram;
+}
+
+void test_writer()
+{
+	background_demo_writer::settings timing;
+	timing.flush_ms = 1;
+	timing.sync_ms = 0;
+
+	// Roomy enough that the recording never waits
+	{
+		background_demo_writer writer;
+		CHECK(writer.open(writer_filename, timing));
+		const auto play = record_play(&writer, 3000);
+		writer.close();
+
+		const auto &stats = writer.recording_stats();
+		CHECK(stats.overflows == 0);
+		CHECK(stats.max_pending >= 1);
+		CHECK(stats.max_pending <= background_demo_writer::default_capacity);
+		CHECK(played_back(writer_filename, play));
+	}
+
+	// So small the recording has to wait on the writer thread, which
+	// sleeps between drains, and nothing may get lost or reordered
+	{
+		background_demo_writer writer(16);
+		CHECK(writer.open(writer_filename, timing));
+		const auto play = record_play(&writer, 1000);
+		writer.close();
+
+		const auto &stats = writer.recording_stats();
+		CHECK(stats.overflows > 0);
+		CHECK(stats.max_pending == 16);
+		CHECK(played_back(writer_filename, play));
+	}
+
+	// Without flushes the file only gets its data on close, whatever the
+	// thread didn't drain by then is written by close itself
+	{
+		timing.flush_ms = 0;
+		background_demo_writer writer(4096);
+		CHECK(writer.open(writer_filename, timing));
+		const auto play = record_play(&writer, 200);
+		writer.close();
+		CHECK(played_back(writer_filename, play));
+	}
+
+	std::remove(writer_filename);
+}
+
+/**
+ * bench_writer - Time recording a frame on the recording thread
+ */
+void bench_writer()
+{
+	using clock = std::chrono::steady_clock;
+	static const uint32_t frames = 1000000;
+
+	background_demo_writer::settings timing;
+	timing.flush_ms = 100;
+	timing.sync_ms = 0;
+
+	background_demo_writer writer;
+	writer.open(writer_filename, timing);
+
+	// A frame's JVS poll and a couple of RNG calls
+	const auto start = clock::now();
+	for (auto frame = 0u; frame < frames; frame++) {
+		writer.add_random((int32_t)(frame));
+		writer.add_random((int32_t)(frame * 3));
+		writer.add_frame(frame / 10);
+	}
+	const auto time = clock::now() - start;
+
+	writer.close();
+
+	const auto &stats = writer.recording_stats();
+	const auto ns = std::chrono::duration<double, std::nano>(time).count();
+	std::cout << "record " << ns / frames << " ns/frame"
+		<< ", " << stats.overflows << " overflows"
+		<< ", " << stats.max_pending << " max pending" << std::endl;
+
+	std::remove(writer_filename);
+}
\ No newline at end of file
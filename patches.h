@@ -0,0 +1,30 @@
+#pragma once
+
+#include "config_schema.h"
+#include <string>
+
+// Settings under patches, shared by the launcher and the input DLL
+struct patch_settings {
+	int resolution_x;
+	int resolution_y;
+	bool fullscreen;
+	bool windowed;
+	bool gl_nearest;
+	int monitor;
+	std::string sram_path;
+
+	static const config_schema<patch_settings> &schema()
+	{
+		static const config_schema<patch_settings> schema("patches.", {
+			{ "resolution_x", &patch_settings::resolution_x, 640   },
+			{ "resolution_y", &patch_settings::resolution_y, 480   },
+			{ "fullscreen",   &patch_settings::fullscreen,   true  },
+			{ "windowed",     &patch_settings::windowed,     false },
+			{ "gl_nearest",   &patch_settings::gl_nearest,   true  },
+			{ "monitor",      &patch_settings::monitor,      0     },
+			{ "sram_path",    &patch_settings::sram_path,    "./"  },
+		});
+
+		return schema;
+	}
+};
\ No newline at end of file
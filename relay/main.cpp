@@ -0,0 +1,365 @@
+#include "relay.h"
+#include "../tgm3_input/latency.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include "../config.h"
+#include "../tgm3_input/keyboard.h"
+#include "../tgm3_input/joystick.h"
+#include <Windows.h>
+#include <mmsystem.h>
+#endif
+
+// Frames are sent at least this often even if nothing changes
+static const uint64_t frame_us = 1000000 / 60;
+
+// Stats are printed this often
+static const uint64_t report_us = 5000000;
+
+// Sender side counters, acks are counted on their own thread
+static std::atomic<uint32_t> packets_sent(0);
+static std::atomic<uint32_t> packets_acked(0);
+static latency_histogram one_way;
+
+/**
+ * ack_thread - Time round trips until the socket breaks
+ * @sock:	Connected socket
+ *
+ * One way latency is taken as half the round trip, which doesn't need the
+ * clocks of both machines to agree.
+ */
+static void ack_thread(relay_socket *sock)
+{
+	relay_ack ack;
+	while (true) {
+		const auto size = sock->receive(&ack, sizeof(ack), -1);
+		if (size < 0)
+			return;
+
+		if (size != sizeof(ack) || ack.magic != relay_ack_magic)
+			continue;
+
+		const auto now = relay_now();
+		if (now < ack.send_time)
+			continue;
+
+		const auto us = (now - ack.send_time) / 2;
+		one_way.record(us > UINT32_MAX ? UINT32_MAX : (uint32_t)(us));
+		packets_acked.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * print_send_stats - Print what the acks say so far
+ */
+static void print_send_stats()
+{
+	const auto sent = packets_sent.load(std::memory_order_relaxed);
+	const auto acked = packets_acked.load(std::memory_order_relaxed);
+	const auto lost = sent > acked ? sent - acked : 0;
+
+	std::cout
+		<< "sent " << sent
+		<< ", acked " << acked
+		<< " (" << (sent != 0 ? lost * 100. / sent : 0.) << "% lost)"
+		<< ", one way us p50 " << one_way.percentile(50)
+		<< " p99 " << one_way.percentile(99)
+		<< " max " << one_way.maximum()
+		<< std::endl;
+}
+
+/**
+ * run_test - Send a fixed pattern
+ * @sock:	Connected socket
+ * @loss:	Percentage of packets to drop on purpose
+ *
+ * A is tapped for one frame out of every four, so the receiver can check
+ * every tap made it through by counting presses.
+ */
+static int run_test(relay_socket *sock, const int loss)
+{
+	relay_encoder encoder;
+	std::minstd_rand random(1);
+
+	auto next = std::chrono::steady_clock::now();
+	auto last_report = relay_now();
+
+	for (auto frame = 0u; ; frame++) {
+		relay_packet packet;
+		encoder.encode(frame % 4 == 0 ? 2 : 0, relay_now(), &packet);
+
+		if ((int)(random() % 100) >= loss)
+			sock->send(&packet, sizeof(packet));
+
+		packets_sent.fetch_add(1, std::memory_order_relaxed);
+
+		if (relay_now() - last_report >= report_us) {
+			print_send_stats();
+			last_report = relay_now();
+		}
+
+		next += std::chrono::microseconds(frame_us);
+		std::this_thread::sleep_until(next);
+	}
+}
+
+/**
+ * run_listen - Receive frames and print loss
+ * @port:	Port to listen on
+ *
+ * Acks like the game does, and counts presses of A to check taps from
+ * run_test all arrive.
+ */
+static int run_listen(const uint16_t port)
+{
+	auto sock = relay_socket::listen(port);
+	if (sock == nullptr) {
+		std::cerr << "Couldn't listen on " << port << std::endl;
+		return 1;
+	}
+
+	relay_decoder decoder;
+	uint16_t last = 0;
+	uint32_t frames = 0;
+	uint32_t presses = 0;
+	auto last_report = relay_now();
+
+	while (true) {
+		relay_packet packet;
+		const auto size = sock->receive(&packet, sizeof(packet), 100);
+		if (size < 0)
+			return 1;
+
+		if (size == sizeof(packet) && packet.magic == relay_magic) {
+			relay_ack ack;
+			ack.magic = relay_ack_magic;
+			ack.frame = packet.frame;
+			ack.send_time = packet.send_time;
+			sock->reply(&ack, sizeof(ack));
+
+			uint16_t buttons[relay_history];
+			const auto count = decoder.decode(packet, buttons);
+			for (auto i = 0; i < count; i++) {
+				if (buttons[i] & ~last & 2)
+					presses++;
+
+				last = buttons[i];
+				frames++;
+			}
+		}
+
+		if (relay_now() - last_report >= report_us) {
+			const auto &stats = decoder.stats;
+			std::cout
+				<< "packets " << stats.packets
+				<< ", stale " << stats.stale
+				<< ", lost " << stats.lost_packets
+				<< ", frames " << frames
+				<< ", frames lost " << stats.lost_frames
+				<< ", A presses " << presses
+				<< std::endl;
+
+			last_report = relay_now();
+		}
+	}
+}
+
+#ifdef _WIN32
+
+keyboard keyboard_device;
+joystick joystick_device;
+base_input *devices[] = {
+	&keyboard_device,
+	&joystick_device
+};
+
+// Raw input records, reused for every WM_INPUT
+static uint64_t input_buffer[256];
+
+// Called by joystick when a debounce recheck changes its buttons outside of
+// WM_INPUT. The send loop reads the buttons after every message it
+// dispatches, the timer's included, so there's nothing to do.
+void notify_buttons_changed()
+{
+}
+
+/**
+ * send_frame - Encode and send one frame
+ * @sock:	Connected socket
+ * @encoder:	Sender state
+ * @buttons:	Packed TGM3 buttons for the frame
+ */
+static void send_frame(
+	relay_socket *sock,
+	relay_encoder *encoder,
+	const uint16_t buttons
+) {
+	relay_packet packet;
+	encoder->encode(buttons, relay_now(), &packet);
+	sock->send(&packet, sizeof(packet));
+	packets_sent.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * window_proc - Pass raw input to the devices
+ */
+static LRESULT CALLBACK window_proc(
+	HWND wnd,
+	UINT msg,
+	WPARAM wparam,
+	LPARAM lparam
+) {
+	if (msg != WM_INPUT)
+		return DefWindowProc(wnd, msg, wparam, lparam);
+
+	auto *input = (RAWINPUT*)(input_buffer);
+	UINT size = sizeof(input_buffer);
+	if (GetRawInputData(
+		(HRAWINPUT)(lparam),
+		RID_INPUT,
+		input,
+		&size,
+		sizeof(RAWINPUTHEADER)) != (UINT)(-1)
+	) {
+		for (auto &device : devices)
+			device->update(input);
+	}
+
+	return 0;
+}
+
+// Both players of every device, this machine only has one
+static uint16_t read_buttons()
+{
+	unsigned short buttons = 0;
+	for (const auto &device : devices)
+		buttons |= device->get_buttons_1p() | device->get_buttons_2p();
+
+	return buttons;
+}
+
+/**
+ * run_send - Relay this machine's devices
+ * @sock:	Connected socket
+ *
+ * Devices are set up from tgm3.cfg like in the game. A frame is sent as
+ * soon as the buttons change, and at 60 Hz otherwise.
+ */
+static int run_send(relay_socket *sock)
+{
+	const config cfg("tgm3.cfg");
+	std::vector<std::string> diagnostics;
+	for (auto &device : devices)
+		device->init(cfg, &diagnostics);
+
+	for (const auto &message : diagnostics)
+		std::cerr << "tgm3.cfg: " << message << std::endl;
+
+	WNDCLASS wc = {};
+	wc.lpfnWndProc = window_proc;
+	wc.hInstance = GetModuleHandle(nullptr);
+	wc.lpszClassName = "relay";
+	RegisterClass(&wc);
+
+	// Message only, input is received in the background
+	const auto wnd = CreateWindow(
+		"relay", "relay", 0, 0, 0, 0, 0,
+		HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+
+	for (auto &device : devices) {
+		for (auto &usage : device->get_usage()) {
+			RAWINPUTDEVICE rid;
+			rid.usUsagePage = 1;
+			rid.usUsage = usage;
+			rid.dwFlags = RIDEV_INPUTSINK;
+			rid.hwndTarget = wnd;
+			RegisterRawInputDevices(&rid, 1, sizeof(rid));
+		}
+	}
+
+	timeBeginPeriod(1);
+
+	relay_encoder encoder;
+	auto last_sent = read_buttons();
+	auto next = relay_now();
+	auto last_report = next;
+
+	while (true) {
+		const auto now = relay_now();
+		const auto wait_ms = next > now ? (DWORD)((next - now) / 1000) : 0;
+		MsgWaitForMultipleObjects(0, nullptr, FALSE, wait_ms, QS_ALLINPUT);
+
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+			DispatchMessage(&msg);
+
+		const auto buttons = read_buttons();
+		if (buttons != last_sent || relay_now() >= next) {
+			send_frame(sock, &encoder, buttons);
+			last_sent = buttons;
+			next = relay_now() + frame_us;
+		}
+
+		if (relay_now() - last_report >= report_us) {
+			print_send_stats();
+			last_report = relay_now();
+		}
+	}
+}
+
+#endif
+
+/**
+ * main - Entry point
+ * @argc:	Command line argument count
+ * @argv:	Array of command line arguments
+ *
+ * relay send <host> [port]		Relay this machine's devices
+ * relay test <host> [port] [loss %]	Send a test pattern
+ * relay listen [port]			Receive and print loss, like the game
+ */
+int main(const int argc, const char *argv[])
+{
+	if (argc >= 2 && strcmp(argv[1], "listen") == 0) {
+		return run_listen(argc >= 3
+			? (uint16_t)(atoi(argv[2]))
+			: relay_default_port);
+	}
+
+	if (argc < 3
+	 || (strcmp(argv[1], "send") != 0 && strcmp(argv[1], "test") != 0)) {
+		std::cerr
+			<< "relay send <host> [port]" << std::endl
+			<< "relay test <host> [port] [loss %]" << std::endl
+			<< "relay listen [port]" << std::endl;
+
+		return 1;
+	}
+
+	const auto port = argc >= 4 ? (uint16_t)(atoi(argv[3])) : relay_default_port;
+	auto sock = relay_socket::connect(argv[2], port);
+	if (sock == nullptr) {
+		std::cerr << "Couldn't connect to " << argv[2] << std::endl;
+		return 1;
+	}
+
+	std::thread(ack_thread, sock.get()).detach();
+
+	if (strcmp(argv[1], "test") == 0)
+		return run_test(sock.get(), argc >= 5 ? atoi(argv[4]) : 0);
+
+#ifdef _WIN32
+	return run_send(sock.get());
+#else
+	std::cerr << "send needs raw input, use test" << std::endl;
+	return 1;
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "relay.h"
+#include <algorithm>
+#include <cstring>
+
+void relay_encoder::encode(
+	const uint16_t buttons,
+	const uint64_t now,
+	relay_packet *packet
+) {
+	std::memmove(&history[1], &history[0], sizeof(history) - sizeof(history[0]));
+	history[0] = buttons;
+	frame++;
+
+	packet->magic = relay_magic;
+	packet->frame = frame;
+	packet->send_time = now;
+	std::memcpy(packet->buttons, history, sizeof(history));
+}
+
+int relay_decoder::decode(const relay_packet &packet, uint16_t *buttons)
+{
+	stats.packets++;
+
+	const auto ahead = (int32_t)(packet.frame - last_frame);
+
+	// Far behind means the sender started over
+	if (!started || ahead < -relay_history) {
+		started = true;
+		last_frame = packet.frame;
+		buttons[0] = packet.buttons[0];
+		return 1;
+	}
+
+	if (ahead <= 0) {
+		stats.stale++;
+		return 0;
+	}
+
+	const auto count = std::min(ahead, (int32_t)(relay_history));
+	stats.lost_packets += ahead - 1;
+	stats.lost_frames += ahead - count;
+
+	for (auto i = 0; i < count; i++)
+		buttons[i] = packet.buttons[count - 1 - i];
+
+	last_frame = packet.frame;
+	return count;
+}
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+using socket_t = SOCKET;
+static const socket_t bad_socket = INVALID_SOCKET;
+
+uint64_t relay_now()
+{
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER now;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&now);
+
+	return (uint64_t)(now.QuadPart / frequency.QuadPart * 1000000
+		+ now.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart);
+}
+
+// Every socket holds a Winsock reference
+static bool start_sockets()
+{
+	WSADATA data;
+	return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+}
+
+static void stop_sockets()
+{
+	WSACleanup();
+}
+
+static void close_socket(const socket_t sock)
+{
+	closesocket(sock);
+}
+
+// Windows reports an ICMP port unreachable from an earlier send as an error
+// on the next receive, there's nothing to do about it
+static bool receive_again()
+{
+	return WSAGetLastError() == WSAECONNRESET;
+}
+
+#else
+
+#include <cerrno>
+#include <netdb.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+using socket_t = int;
+static const socket_t bad_socket = -1;
+
+uint64_t relay_now()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec) * 1000000 + (uint64_t)(now.tv_nsec) / 1000;
+}
+
+static bool start_sockets()
+{
+	return true;
+}
+
+static void stop_sockets()
+{
+}
+
+static void close_socket(const socket_t sock)
+{
+	close(sock);
+}
+
+// Connected sockets see ICMP port unreachable as ECONNREFUSED
+static bool receive_again()
+{
+	return errno == EINTR || errno == ECONNREFUSED;
+}
+
+#endif
+
+relay_socket::relay_socket(const intptr_t handle) :
+	handle(handle),
+	peer_size(0)
+{
+}
+
+relay_socket::~relay_socket()
+{
+	close_socket((socket_t)(handle));
+	stop_sockets();
+}
+
+std::unique_ptr<relay_socket> relay_socket::listen(const uint16_t port)
+{
+	if (!start_sockets())
+		return nullptr;
+
+	const auto sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == bad_socket) {
+		stop_sockets();
+		return nullptr;
+	}
+
+	std::unique_ptr<relay_socket> result(new relay_socket((intptr_t)(sock)));
+
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (const sockaddr*)(&address), sizeof(address)) != 0)
+		return nullptr;
+
+	return result;
+}
+
+std::unique_ptr<relay_socket> relay_socket::connect(
+	const std::string &host,
+	const uint16_t port
+) {
+	if (!start_sockets())
+		return nullptr;
+
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	addrinfo *addresses;
+	const auto service = std::to_string(port);
+	if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0) {
+		stop_sockets();
+		return nullptr;
+	}
+
+	const auto sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == bad_socket) {
+		freeaddrinfo(addresses);
+		stop_sockets();
+		return nullptr;
+	}
+
+	std::unique_ptr<relay_socket> result(new relay_socket((intptr_t)(sock)));
+
+	const auto connected = ::connect(
+		sock,
+		addresses->ai_addr,
+		(int)(addresses->ai_addrlen)) == 0;
+
+	freeaddrinfo(addresses);
+
+	if (!connected)
+		return nullptr;
+
+	return result;
+}
+
+bool relay_socket::send(const void *data, const size_t size)
+{
+	return ::send((socket_t)(handle), (const char*)(data), (int)(size), 0)
+		== (int)(size);
+}
+
+bool relay_socket::reply(const void *data, const size_t size)
+{
+	if (peer_size == 0)
+		return false;
+
+	return sendto(
+		(socket_t)(handle),
+		(const char*)(data),
+		(int)(size),
+		0,
+		(const sockaddr*)(peer),
+		peer_size) == (int)(size);
+}
+
+int relay_socket::receive(void *data, const size_t size, const int timeout_ms)
+{
+	const auto sock = (socket_t)(handle);
+
+	while (true) {
+		if (timeout_ms >= 0) {
+			fd_set readable;
+			FD_ZERO(&readable);
+			FD_SET(sock, &readable);
+
+			timeval timeout;
+			timeout.tv_sec = timeout_ms / 1000;
+			timeout.tv_usec = timeout_ms % 1000 * 1000;
+
+			const auto ready = select(
+				(int)(sock) + 1, &readable, nullptr, nullptr, &timeout);
+
+			if (ready == 0)
+				return 0;
+			if (ready < 0)
+				return -1;
+		}
+
+		sockaddr_storage from;
+		socklen_t from_size = sizeof(from);
+		const auto received = recvfrom(
+			sock,
+			(char*)(data),
+			(int)(size),
+			0,
+			(sockaddr*)(&from),
+			&from_size);
+
+		if (received < 0 && receive_again())
+			continue;
+
+		if (received < 0)
+			return -1;
+
+		peer_size = (int)(std::min((size_t)(from_size), sizeof(peer)));
+		std::memcpy(peer, &from, peer_size);
+		return (int)(received);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/*
+ * Button relay for a player at another machine. The sender samples its
+ * devices into numbered frames and sends one packet per frame, carrying
+ * that frame and the ones before it, so a lost packet is made up for by
+ * the next one. The receiver echoes each packet back so the sender can
+ * time round trips.
+ *
+ * Packets are little endian structs, which every target is.
+ */
+
+static const uint32_t relay_magic = 0x524D4754; // "TGMR"
+static const uint32_t relay_ack_magic = 0x414D4754; // "TGMA"
+static const uint16_t relay_default_port = 7143;
+
+// Frames in each packet, newest first
+static const int relay_history = 8;
+
+struct relay_packet {
+	uint32_t magic;
+
+	// Number of the frame in buttons[0], buttons[i] is frame - i
+	uint32_t frame;
+
+	// Sender clock in microseconds, echoed back in the ack
+	uint64_t send_time;
+
+	uint16_t buttons[relay_history];
+};
+
+struct relay_ack {
+	uint32_t magic;
+	uint32_t frame;
+	uint64_t send_time;
+};
+
+static_assert(sizeof(relay_packet) == 32, "relay_packet has padding");
+static_assert(sizeof(relay_ack) == 16, "relay_ack has padding");
+
+// Monotonic clock in microseconds
+uint64_t relay_now();
+
+// Sender side, keeps the frames that go in the next packet
+class relay_encoder {
+	uint32_t frame = 0;
+	uint16_t history[relay_history];
+
+public:
+	relay_encoder()
+	{
+		memset(history, 0, sizeof(history));
+	}
+
+	// Add a frame and fill in the packet that carries it
+	void encode(uint16_t buttons, uint64_t now, relay_packet *packet);
+};
+
+// Receiver side counters
+struct relay_stats {
+	uint32_t packets = 0;
+
+	// Older than or the same as a frame already seen
+	uint32_t stale = 0;
+
+	// Packets that never arrived, judging by the frame numbers
+	uint32_t lost_packets = 0;
+
+	// Frames that were only in lost packets, too many lost in a row
+	uint32_t lost_frames = 0;
+};
+
+// Receiver side, turns packets back into a stream of frames
+class relay_decoder {
+	bool started = false;
+	uint32_t last_frame = 0;
+
+public:
+	relay_stats stats;
+
+	/**
+	 * decode - Find the frames in a packet that weren't seen yet
+	 * @packet:	Received packet, magic already checked
+	 * @buttons:	Output, oldest first
+	 *
+	 * Returns how many frames were written, at most relay_history. The
+	 * first packet only counts for its newest frame.
+	 */
+	int decode(const relay_packet &packet, uint16_t *buttons);
+
+	// Forget the stream, for a sender that restarted
+	void reset()
+	{
+		started = false;
+	}
+};
+
+// UDP socket, Winsock or BSD sockets
+class relay_socket {
+	intptr_t handle;
+
+	// Where the last packet came from, replies go there
+	uint8_t peer[128];
+	int peer_size;
+
+	explicit relay_socket(intptr_t handle);
+
+public:
+	~relay_socket();
+
+	// Receive on port from anywhere, null on failure
+	static std::unique_ptr<relay_socket> listen(uint16_t port);
+
+	// Send to host:port and only receive from there, null on failure
+	static std::unique_ptr<relay_socket> connect(
+		const std::string &host,
+		uint16_t port);
+
+	// Send to the connected address
+	bool send(const void *data, size_t size);
+
+	// Send to where the last received packet came from
+	bool reply(const void *data, size_t size);
+
+	/**
+	 * receive - Wait for a packet
+	 * @data:	Output
+	 * @size:	Size of data
+	 * @timeout_ms:	How long to wait, -1 for no limit
+	 *
+	 * Returns the packet's size, 0 on timeout and -1 once the socket is
+	 * closed or broken.
+	 */
+	int receive(void *data, size_t size, int timeout_ms);
+};
\ No newline at end of file
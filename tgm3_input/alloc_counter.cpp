@@ -0,0 +1,87 @@
+#define WIN32_LEAN_AND_MEAN
+#include "alloc_counter.h"
+
+#ifndef ALLOC_COUNTER
+
+void count_allocations_on_this_thread()
+{
+}
+
+unsigned counted_allocations()
+{
+	return 0;
+}
+
+#else
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <Windows.h>
+
+static std::atomic<DWORD> counted_thread(0);
+static std::atomic<unsigned> allocations(0);
+
+void count_allocations_on_this_thread()
+{
+	counted_thread.store(GetCurrentThreadId(), std::memory_order_relaxed);
+}
+
+unsigned counted_allocations()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+static void *counted_malloc(const size_t size)
+{
+	if (GetCurrentThreadId() == counted_thread.load(std::memory_order_relaxed))
+		allocations.fetch_add(1, std::memory_order_relaxed);
+
+	return malloc(size != 0 ? size : 1);
+}
+
+void *operator new(const size_t size)
+{
+	auto *ptr = counted_malloc(size);
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+void *operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(const size_t size, const std::nothrow_t&) throw()
+{
+	return counted_malloc(size);
+}
+
+void *operator new[](const size_t size, const std::nothrow_t&) throw()
+{
+	return counted_malloc(size);
+}
+
+void operator delete(void *ptr) throw()
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr) throw()
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) throw()
+{
+	free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) throw()
+{
+	free(ptr);
+}
+
+#endif
\ No newline at end of file
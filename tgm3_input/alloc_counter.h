@@ -0,0 +1,15 @@
+#pragma once
+
+/*
+ * Heap allocation counter for one thread. With ALLOC_COUNTER defined, as in
+ * Debug builds, operator new is replaced for the whole DLL and only
+ * allocations made by the thread that called
+ * count_allocations_on_this_thread are counted. Otherwise the DLL keeps the
+ * default allocator and nothing is counted.
+ */
+
+// Start counting the calling thread's allocations
+void count_allocations_on_this_thread();
+
+// Allocations the counted thread has made so far
+unsigned counted_allocations();
\ No newline at end of file
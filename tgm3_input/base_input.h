@@ -1,25 +1,26 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
+#include <string>
 
 class config;
 struct tagRAWINPUT;
 
 class base_input {
-protected:
+public:
 	// Game button bitmasks
-	static constexpr auto mask_up = 32;
-	static constexpr auto mask_down = 16;
-	static constexpr auto mask_left = 8;
-	static constexpr auto mask_right = 4;
+	static const int mask_up = 32;
+	static const int mask_down = 16;
+	static const int mask_left = 8;
+	static const int mask_right = 4;
 
-	static constexpr auto mask_A = 2;
-	static constexpr auto mask_B = 1;
-	static constexpr auto mask_C = 32768;
-	static constexpr auto mask_D = 16384;
-	static constexpr auto mask_start = 128;
+	static const int mask_A = 2;
+	static const int mask_B = 1;
+	static const int mask_C = 32768;
+	static const int mask_D = 16384;
+	static const int mask_start = 128;
 
-public:
 	// Usage for raw input device
 	virtual std::vector<int> get_usage() = 0;
 
@@ -33,6 +34,37 @@ public:
 	// Must be used on alt tab
 	virtual void clear_buttons() = 0;
 
-	// Initialize from config
-	virtual void init(const config &cfg) = 0;
+	// Initialize from config, config errors get appended to diagnostics
+	virtual void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) = 0;
+
+	// Apply a modified config, called from the reload thread
+	virtual void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) = 0;
+
+	// Raw input device plugged in, may be one that's already known
+	virtual void device_added(
+		const config &cfg,
+		void *ri_handle,
+		std::vector<std::string> *diagnostics)
+	{
+	}
+
+	// Raw input device unplugged
+	virtual void device_removed(void *ri_handle)
+	{
+	}
+
+	// Buttons for sources that are stepped by game frames instead of the
+	// window, packed like button_state. Called on every JVS poll.
+	virtual uint32_t poll_buttons(uint32_t frame)
+	{
+		return 0;
+	}
 };
+
+// Sources that read input on threads of their own call this after their
+// buttons change, the buttons are then published from the window thread
+void notify_buttons_changed();
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Buttons for both players as one 32 bit word, 1p in the low half and 2p in
+ * the high half. The window thread combines every device into a word and
+ * stores it, the game thread loads it once per JVS poll, so the game never
+ * sees 1p and 2p from different updates and neither side ever waits.
+ *
+ * Next to the word sits a mask of the bits that changed since the game
+ * thread last consumed it, so presses and releases that came and went
+ * between two polls aren't lost.
+ *
+ * Only one thread may publish.
+ */
+class button_state {
+	// Level in the low 32 bits, changed bits in the high 32 bits
+	std::atomic<uint64_t> word;
+
+public:
+	struct sample {
+		uint32_t level;
+		uint32_t toggled;
+	};
+
+	button_state() : word(0)
+	{
+	}
+
+	button_state(const button_state&) = delete;
+	button_state &operator=(const button_state&) = delete;
+
+	static uint32_t pack(
+		const unsigned short buttons_1p,
+		const unsigned short buttons_2p)
+	{
+		return (uint32_t)(buttons_1p) | ((uint32_t)(buttons_2p) << 16);
+	}
+
+	static unsigned short buttons_1p(const uint32_t state)
+	{
+		return (unsigned short)(state & 0xFFFF);
+	}
+
+	static unsigned short buttons_2p(const uint32_t state)
+	{
+		return (unsigned short)(state >> 16);
+	}
+
+	// Called by the thread that owns the devices
+	void publish(const uint32_t state)
+	{
+		auto old = word.load(std::memory_order_relaxed);
+		uint64_t next;
+		do {
+			const auto toggled = (uint32_t)(old >> 32) | ((uint32_t)(old) ^ state);
+			next = state | ((uint64_t)(toggled) << 32);
+		} while (!word.compare_exchange_weak(
+			old,
+			next,
+			std::memory_order_release,
+			std::memory_order_relaxed));
+	}
+
+	// Latest published state, safe from any thread
+	uint32_t load() const
+	{
+		return (uint32_t)(word.load(std::memory_order_acquire));
+	}
+
+	// Latest state plus what changed since the last consume, for the game
+	// thread only
+	sample consume()
+	{
+		const auto old = word.fetch_and(0xFFFFFFFF, std::memory_order_acq_rel);
+		return { (uint32_t)(old), (uint32_t)(old >> 32) };
+	}
+};
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Eager debounce for the 16 bits of a button word. The first edge of a
+ * button goes through at once, then edges the other way are ignored until
+ * holdoff has passed since it, which hides switch chatter without delaying
+ * presses.
+ *
+ * A button that really changed back within holdoff stays wrong until it's
+ * filtered again after the window ends. Devices don't necessarily report
+ * again by then, so the caller has to call expire at recheck_time.
+ */
+class eager_debounce {
+	unsigned short stable;
+
+	// Buttons as last reported, differs from stable while an edge is held
+	// off
+	unsigned short reported;
+
+	// Time of the last accepted edge of each bit
+	int64_t last_edge[16];
+
+public:
+	eager_debounce()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		stable = 0;
+		reported = 0;
+		for (auto &time : last_edge)
+			time = INT64_MIN / 2;
+	}
+
+	/**
+	 * update - Filter a new sample
+	 * @raw:	Buttons as reported
+	 * @now:	Time of the report
+	 * @holdoff:	Time to ignore contrary edges for, same units as now
+	 */
+	unsigned short update(
+		const unsigned short raw,
+		const int64_t now,
+		const int64_t holdoff)
+	{
+		reported = raw;
+
+		const auto changed = (unsigned)(raw ^ stable);
+		if (changed == 0)
+			return stable;
+
+		for (auto bit = 0; bit < 16; bit++) {
+			if ((changed & (1u << bit)) == 0)
+				continue;
+
+			if (now - last_edge[bit] < holdoff)
+				continue;
+
+			stable ^= (unsigned short)(1u << bit);
+			last_edge[bit] = now;
+		}
+
+		return stable;
+	}
+
+	/**
+	 * recheck_time - When a held off edge can go through
+	 * @holdoff:	Same as for update
+	 *
+	 * Returns INT64_MAX if every button was last reported the way it's
+	 * filtered.
+	 */
+	int64_t recheck_time(const int64_t holdoff) const
+	{
+		const auto held_off = (unsigned)(reported ^ stable);
+		if (held_off == 0)
+			return INT64_MAX;
+
+		auto first = INT64_MAX;
+		for (auto bit = 0; bit < 16; bit++) {
+			if ((held_off & (1u << bit)) != 0 && last_edge[bit] < first)
+				first = last_edge[bit];
+		}
+
+		return first + holdoff;
+	}
+
+	/**
+	 * expire - Filter the last report again
+	 * @now:	Current time, recheck_time or later
+	 * @holdoff:	Same as for update
+	 */
+	unsigned short expire(const int64_t now, const int64_t holdoff)
+	{
+		return update(reported, now, holdoff);
+	}
+};
\ No newline at end of file
@@ -1,5 +1,19 @@
 #define WIN32_LEAN_AND_MEAN
+#include "demo.h"
+#include "button_state.h"
+#include "latency.h"
+#include "../config_schema.h"
+#include "../demo_format/background_writer.h"
+#include "../demo_format/demo_info.h"
+#include "../demo_format/demo_map.h"
+#include "../demo_format/demo_reader.h"
+#include "../demo_format/demo_writer.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <vector>
 #include <string>
 #include <ctime>
 
@@ -7,37 +21,162 @@
 #include <detours.h.>
 #include <intrin.h>
 
-static std::ifstream input;
-
-static std::ofstream output;
+// Demo being played, read straight from memory
+static std::unique_ptr<mapped_file> play_file;
+
+// Version 1 streams, and button runs decoded up front
+static mapped_stream play_streams[3];
+static std::vector<uint32_t> play_decoded;
+
+// Where each hook reads from, all the same stream for version 0 demos
+static mapped_stream *play_buttons;
+static mapped_stream *play_rng;
+static mapped_stream *play_sram;
+
+// What to do once the demo runs out
+enum class end_action {
+	exit,
+	pause,
+	control
+};
+
+static const char *const end_action_names[] = {
+	"exit",
+	"pause",
+	"control",
+	nullptr
+};
+
+static end_action end_of_demo;
+static bool demo_ended;
+
+// Demo being recorded, or converted to while playing a version 0 demo
+static demo_writer output;
 static std::ofstream out_info;
+static bool converting;
+
+// Records go through background_output instead if demo.background is set
+static background_demo_writer background_output;
+static bool background;
+
+// Items recorded so far in each stream
+static uint32_t recorded_frames;
+static uint32_t recorded_rng;
+static uint32_t recorded_sram;
+
+// Game frame counter and RNG calls before each JVS poll, to find where games
+// start. Kept for the last max_marks polls in a ring indexed by demo frame,
+// so the game thread never grows it. A game longer than that is indexed
+// from the oldest poll kept.
+struct frame_mark {
+	int game_frame;
+	uint32_t rng_calls;
+};
+
+static const uint32_t max_marks = 60 * 60 * 60;
+static std::vector<frame_mark> frame_marks;
+
+// Frames recorded before each SRAM read, from read number sram_base on.
+// Reads no game can start before anymore are dropped at game over.
+static std::vector<uint32_t> sram_frames;
+static uint32_t sram_base;
+
+struct demo_settings {
+	bool background;
+	int flush_ms;
+	int sync_ms;
+	int end;
+};
+
+static const config_schema<demo_settings> schema("demo.", {
+	{ "background", &demo_settings::background, true },
+	{ "flush_ms",   &demo_settings::flush_ms,   1000 },
+	{ "sync_ms",    &demo_settings::sync_ms,    0    },
+	{ "end",        &demo_settings::end,        (int)(end_action::exit), end_action_names },
+});
+
+// QueryPerformanceCounter ticks spent recording in the current frame
+static uint64_t frame_ticks;
+static uint64_t tick_frequency;
+
+// Nanoseconds spent recording in each frame
+static latency_histogram frame_record_ns;
 
 using get_jvs_data_t = char*(*)(int);
 static get_jvs_data_t orig_get_jvs_data;
 
-static const char format_version = 0;
-static int header_size = 1; // begins with format ver
+using random_t = int(*)(int*, int);
+static random_t orig_random;
+
+using read_sram_t = int(*)(const char*, char*, int, size_t);
+static read_sram_t orig_read_sram;
 
 static int target_frame; // frame to skip to
 
+/**
+ * pause_demo - Keep the last frame up until the window is closed
+ *
+ * The game thread stays here, so the window's messages are handled here
+ * too.
+ */
+static void pause_demo()
+{
+	while (true) {
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+			if (msg.message == WM_QUIT)
+				exit(0);
+
+			TranslateMessage(&msg);
+			DispatchMessage(&msg);
+		}
+
+		Sleep(16);
+	}
+}
+
+/**
+ * end_demo - Called when a hook runs out of demo
+ *
+ * Do what demo.end says. Conversions always exit, there's nothing left to
+ * convert. With control the hooks let the real input, RNG and SRAM through
+ * from here on, SRAM still isn't written.
+ */
+static void end_demo()
+{
+	if (converting || end_of_demo == end_action::exit)
+		exit(0);
+
+	demo_ended = true;
+	target_frame = 0;
+
+	if (end_of_demo == end_action::pause)
+		pause_demo();
+}
+
 /**
  * play_get_jvs_data - Playback input hook
  * @unknown:	Always 1
  *
- * Just read values from the file
+ * Just read values from the demo
  */
 static char *play_get_jvs_data(const int unknown)
 {
 	auto *data = orig_get_jvs_data(unknown);
+	if (demo_ended)
+		return data;
 
-	auto *buttons1 = (unsigned short*)(data + 0x184);
-	auto *buttons2 = (unsigned short*)(data + 0x186);
+	uint32_t state;
+	if (!play_buttons->read(&state)) {
+		end_demo();
+		return data;
+	}
 
-	input.read((char*)(buttons1), sizeof(*buttons1));
-	input.read((char*)(buttons2), sizeof(*buttons2));
+	*(unsigned short*)(data + 0x184) = button_state::buttons_1p(state);
+	*(unsigned short*)(data + 0x186) = button_state::buttons_2p(state);
 
-	if (input.eof())
-		exit(0);
+	if (converting)
+		output.add_frame(state);
 
 	return data;
 }
@@ -47,17 +186,23 @@ static char *play_get_jvs_data(const int unknown)
  * @seed:	Seed pointer
  * @save_seed:	Boolean indicating whether to update the seed
  *
- * Just read values from the file
+ * Just read values from the demo
  */
 static int play_random(int *seed, const int save_seed)
 {
-	int result;
-	input.read((char*)(&result), sizeof(result));
+	int32_t result;
+	if (demo_ended || !play_rng->read(&result)) {
+		if (!demo_ended)
+			end_demo();
+
+		return orig_random(seed, save_seed);
+	}
+
 	if (save_seed)
 		*seed = result;
 
-	if (input.eof())
-		exit(0);
+	if (converting)
+		output.add_random(result);
 
 	return result;
 }
@@ -78,17 +223,54 @@ static int play_read_sram(
 	const int unused,
 	const size_t size)
 {
+	if (demo_ended)
+		return orig_read_sram(name, buf, unused, size);
+
 	// This returns a boolean value, but Arika used a 32-bit return type.
 	// Using a char will save space in the demo.
 	char success;
-	input.read(&success, sizeof(success));
+	if (!play_sram->read(&success))
+		return 0;
 
-	if (success)
-		input.read(buf, size);
+	if (success && !play_sram->read(buf, size))
+		return 0;
+
+	if (converting)
+		output.add_sram(success != 0, buf, (uint32_t)(size));
 
 	return success;
 }
 
+/**
+ * play_v1_read_sram - Playback hook for SRAM data in version 1 demos
+ * @name:	Filename
+ * @buf:	Output buf
+ * @unused:	Most likely did something during development but not anymore
+ * @size:	Size to write
+ *
+ * Reads past the end of the demo fail like a missing file would
+ */
+static int play_v1_read_sram(
+	const char *name,
+	char *buf,
+	const int unused,
+	const size_t size)
+{
+	if (demo_ended)
+		return orig_read_sram(name, buf, unused, size);
+
+	demo_sram_record record;
+	if (!play_sram->read(&record) || !record.success)
+		return 0;
+
+	// The game always asks for the same sizes, but don't overrun buf
+	const auto stored = std::min<size_t>(record.size, size);
+	play_sram->read(buf, stored);
+	play_sram->skip(record.size - stored);
+
+	return 1;
+}
+
 // Can't be overwriting our player data by watching a demo
 static void play_write_sram(
 	const char *name,
@@ -112,6 +294,37 @@ BOOL WINAPI play_SwapBuffers(HDC hdc)
 	return frame_count > target_frame ? orig_SwapBuffers(hdc) : TRUE;
 }
 
+static uint64_t qpc_now()
+{
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart);
+}
+
+/**
+ * report_recording - Print the recording hooks' cost on exit
+ *
+ * Set demo.background to false to compare against writing on the game
+ * thread.
+ */
+static void report_recording()
+{
+	const auto &stats = background_output.recording_stats();
+
+	char message[256];
+	sprintf_s(message, sizeof(message),
+		"tgm3_input: recording took p50 %uns p99 %uns max %uns per frame "
+		"(%s), %u ring overflows, %u records pending at most\n",
+		frame_record_ns.percentile(50),
+		frame_record_ns.percentile(99),
+		frame_record_ns.maximum(),
+		background ? "background" : "game thread",
+		stats.overflows,
+		stats.max_pending);
+
+	OutputDebugString(message);
+}
+
 /**
  * rec_get_jvs_data - Recording input hook
  * @unknown:	Always 1
@@ -125,14 +338,25 @@ static char *rec_get_jvs_data(const int unknown)
 	auto *buttons1 = (unsigned short*)(data + 0x184);
 	auto *buttons2 = (unsigned short*)(data + 0x186);
 
-	output.write((char*)(buttons1), sizeof(*buttons1));
-	output.write((char*)(buttons2), sizeof(*buttons2));
+	const auto start = qpc_now();
+	const auto state = button_state::pack(*buttons1, *buttons2);
+	if (background)
+		background_output.add_frame(state);
+	else
+		output.add_frame(state);
+
+	frame_marks[recorded_frames % max_marks] = { *(int*)(0x4AE114), recorded_rng };
+	recorded_frames++;
+
+	// A frame's RNG calls come before its JVS poll
+	frame_ticks += qpc_now() - start;
+	const auto ns = frame_ticks * 1000000000 / tick_frequency;
+	frame_record_ns.record(ns > UINT32_MAX ? UINT32_MAX : (uint32_t)(ns));
+	frame_ticks = 0;
 
 	return data;
 }
 
-using random_t = int(*)(int*, int);
-static random_t orig_random;
 /**
  * rec_random - Recording RNG hook
  * @seed:	Seed pointer
@@ -143,12 +367,18 @@ static random_t orig_random;
 static int rec_random(int *seed, const int save_seed)
 {
 	auto result = orig_random(seed, save_seed);
-	output.write((char*)(&result), sizeof(result));
+
+	const auto start = qpc_now();
+	if (background)
+		background_output.add_random(result);
+	else
+		output.add_random(result);
+
+	recorded_rng++;
+	frame_ticks += qpc_now() - start;
 	return result;
 }
 
-using read_sram_t = int(*)(const char*, char*, int, size_t);
-static read_sram_t orig_read_sram;
 /**
  * rec_read_sram - Recording hook for SRAM data
  * @name:	Filename
@@ -165,13 +395,17 @@ static int rec_read_sram(
 		const int unused,
 		const size_t size)
 {
-	// This returns a boolean value, but Arika used a 32-bit return type.
-	// Using a char will save space in the demo.
-	const auto success = (char)(orig_read_sram(name, buf, unused, size));
-	output.write(&success, sizeof(success));
+	const auto success = orig_read_sram(name, buf, unused, size);
 
-	if (success)
-		output.write(buf, size);
+	const auto start = qpc_now();
+	if (background)
+		background_output.add_sram(success != 0, buf, (uint32_t)(size));
+	else
+		output.add_sram(success != 0, buf, (uint32_t)(size));
+
+	sram_frames.push_back(recorded_frames);
+	recorded_sram++;
+	frame_ticks += qpc_now() - start;
 
 	return success;
 }
@@ -181,8 +415,11 @@ unknown_game_over_t orig_calc_final_grade;
 /**
  * rec_calc_final_grade - Gets called once on game over
  *
- * Write the play time in frames, mode, level, grade index and start frame to
- * the end of the info file.
+ * Write the play time in frames, mode, level, grade index, start frame and
+ * where the game is in each stream to the end of the info file.
+ *
+ * The game starts at the first JVS poll on or after its start frame. RNG
+ * calls and SRAM reads before that poll belong to what came before.
  */
 void rec_calc_final_grade(void *data)
 {
@@ -197,40 +434,165 @@ void rec_calc_final_grade(void *data)
 	const auto grade = *(char*)(grade_data + 0x6);
 
 	const auto frame_count = *(int*)(0x4AE114); // frames since startup
-	const auto start_frame = frame_count - frames_played;
 
-	out_info.write((char*)(&frames_played), sizeof(frames_played));
-	out_info.write((char*)(&mode), sizeof(mode));
-	out_info.write((char*)(&level), sizeof(level));
-	out_info.write(&grade, 1);
-	out_info.write((char*)(&start_frame), sizeof(start_frame));
+	demo_game game;
+	game.frames_played = frames_played;
+	game.mode = mode;
+	game.level = level;
+	game.grade = grade;
+	game.start_frame = frame_count - frames_played;
+
+	// First poll on or after the start frame among the ones kept
+	const auto oldest = recorded_frames > max_marks ? recorded_frames - max_marks : 0;
+	auto first = oldest;
+	auto last = recorded_frames;
+	while (first < last) {
+		const auto middle = first + (last - first) / 2;
+		if (frame_marks[middle % max_marks].game_frame < game.start_frame)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+
+	auto &index = game.index;
+	index.start_frame = first;
+	index.end_frame = recorded_frames;
+	index.start_rng = first != recorded_frames
+		? frame_marks[first % max_marks].rng_calls
+		: recorded_rng;
+	index.end_rng = recorded_rng;
+	index.start_sram = sram_base + (uint32_t)(std::upper_bound(
+		sram_frames.begin(),
+		sram_frames.end(),
+		index.start_frame) - sram_frames.begin());
+	index.end_sram = recorded_sram;
+
+	// Later games start on or after the oldest poll kept, so reads up to
+	// it are always counted before them
+	const auto stale = std::upper_bound(
+		sram_frames.begin(),
+		sram_frames.end(),
+		oldest);
+
+	sram_base += (uint32_t)(stale - sram_frames.begin());
+	sram_frames.erase(sram_frames.begin(), stale);
+
+	write_demo_game(out_info, game);
+	out_info.flush();
+}
+
+/**
+ * setup_conversion - Record a version 0 demo to version 1 while it plays
+ * @name:	Demo name without the extension
+ *
+ * Version 0 records can only be told apart by the order the game asks for
+ * them, so the game replays the demo as fast as it can and the playback
+ * hooks hand every record to a version 1 writer. The result and a copy of
+ * the info file go next to the original with _v1 added to the name.
+ */
+static void setup_conversion(const char *name)
+{
+	char out_filename[MAX_PATH];
+	sprintf_s(out_filename, MAX_PATH, "demos/%s_v1.dem", name);
+	if (!output.open(out_filename)) {
+		MessageBox(
+			nullptr,
+			"Failed to create the converted demo file.",
+			"Error",
+			MB_OK);
+
+		exit(EXIT_FAILURE);
+	}
+
+	char info_filename[MAX_PATH];
+	char out_info_filename[MAX_PATH];
+	sprintf_s(info_filename, MAX_PATH, "demos/%s.inf", name);
+	sprintf_s(out_info_filename, MAX_PATH, "demos/%s_v1.inf", name);
+
+	std::ifstream in_info(info_filename, std::ios::binary);
+	if (in_info.is_open()) {
+		std::ofstream copy(out_info_filename, std::ios::binary);
+		copy << in_info.rdbuf();
+	}
+
+	converting = true;
+	target_frame = INT_MAX;
+}
+
+/**
+ * open_playback - Map a demo and point the playback hooks at it
+ * @filename:	Demo file
+ *
+ * Returns the demo's version, or -1 if it can't be played. Version 1
+ * streams each get their own reader, version 0 hooks all share one.
+ */
+static int open_playback(const char *filename)
+{
+	play_file = map_file(filename);
+	if (play_file == nullptr)
+		return -1;
+
+	demo_header header = {};
+	if (play_file->size() >= sizeof(header))
+		memcpy(&header, play_file->data(), sizeof(header));
+
+	if (header.magic != demo_magic) {
+		play_streams[0].add(play_file->data(), play_file->size());
+		play_buttons = &play_streams[0];
+		play_rng = &play_streams[0];
+		play_sram = &play_streams[0];
+		return 0;
+	}
+
+	demo_reader reader;
+	if (!reader.open(filename)
+	 || !map_stream(*play_file, reader, demo_stream::buttons, &play_decoded, &play_streams[0]))
+		return -1;
+
+	// Only buttons are encoded
+	std::vector<uint32_t> unused;
+	map_stream(*play_file, reader, demo_stream::rng_values, &unused, &play_streams[1]);
+	map_stream(*play_file, reader, demo_stream::sram, &unused, &play_streams[2]);
+
+	play_buttons = &play_streams[0];
+	play_rng = &play_streams[1];
+	play_sram = &play_streams[2];
+	return header.version;
 }
 
 /**
  * setup_playback - Install hooks for demo playback
- * @name:	Demo file to play
+ * @cmdline:		Demo name and optionally the game to skip to
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
  *
  * Hook the SRAM reading function and the RNG to read from the demo file and
- * hook the SRAM write functions to do nothing 
+ * hook the SRAM write functions to do nothing. The whole demo is mapped
+ * into memory, so the hooks never wait on the file. "convert <name>"
+ * converts a version 0 demo instead.
  */
-void setup_playback(const char *cmdline)
-{
-	orig_get_jvs_data = (get_jvs_data_t)(DetourFunction(
-		(BYTE*)(0x45D490), (BYTE*)(play_get_jvs_data)));
-	DetourFunction((BYTE*)(0x431F20), (BYTE*)(play_random));
-	DetourFunction((BYTE*)(0x44B690), (BYTE*)(play_read_sram));
-	DetourFunction((BYTE*)(0x44B7E0), (BYTE*)(play_write_sram));
-	orig_SwapBuffers = (SwapBuffers_t)(DetourFunction(
-		(BYTE*)(SwapBuffers), (BYTE*)(play_SwapBuffers)));
+void setup_playback(
+	const char *cmdline,
+	const config &cfg,
+	std::vector<std::string> *diagnostics
+) {
+	demo_settings settings;
+	schema.bind(cfg, &settings, diagnostics);
+	end_of_demo = (end_action)(settings.end);
 
 	char name[MAX_PATH];
 	int target_game = 0;
-	sscanf_s(cmdline, "%s %i", name, MAX_PATH, &target_game);
+	const auto convert = strncmp(cmdline, "convert ", 8) == 0;
+	if (convert)
+		sscanf_s(cmdline + 8, "%s", name, MAX_PATH);
+	else
+		sscanf_s(cmdline, "%s %i", name, MAX_PATH, &target_game);
 
 	char demo_filename[MAX_PATH];
 	sprintf_s(demo_filename, MAX_PATH, "demos/%s.dem", name);
-	input.open(demo_filename, std::ios::binary);
-	if (input.fail()) {
+
+	const auto version = open_playback(demo_filename);
+	if (version == -1) {
 		MessageBox(
 			nullptr,
 			"Failed to open demo file for playback.",
@@ -240,6 +602,32 @@ void setup_playback(const char *cmdline)
 		exit(EXIT_FAILURE);
 	}
 
+	if (convert && version != 0) {
+		MessageBox(
+			nullptr,
+			"The demo is already version 1.",
+			"Error",
+			MB_OK);
+
+		exit(EXIT_FAILURE);
+	}
+
+	orig_get_jvs_data = (get_jvs_data_t)(DetourFunction(
+		(BYTE*)(0x45D490), (BYTE*)(play_get_jvs_data)));
+	orig_random = (random_t)(DetourFunction(
+		(BYTE*)(0x431F20), (BYTE*)(play_random)));
+	orig_read_sram = (read_sram_t)(DetourFunction(
+		(BYTE*)(0x44B690),
+		(BYTE*)(version == 0 ? play_read_sram : play_v1_read_sram)));
+	DetourFunction((BYTE*)(0x44B7E0), (BYTE*)(play_write_sram));
+	orig_SwapBuffers = (SwapBuffers_t)(DetourFunction(
+		(BYTE*)(SwapBuffers), (BYTE*)(play_SwapBuffers)));
+
+	if (convert) {
+		setup_conversion(name);
+		return;
+	}
+
 	char info_filename[MAX_PATH];
 	sprintf_s(info_filename, MAX_PATH, "demos/%s.inf", name);
 	std::ifstream in_info(info_filename, std::ios::binary);
@@ -249,66 +637,65 @@ void setup_playback(const char *cmdline)
 		return;
 	}
 
-	// For backwards compatibility
-	char target_version;
-	in_info.read(&target_version, 1);
-
-	int game_num = 0;
-	while (true) {
-		int frames_played;
-		in_info.read((char*)(&frames_played), sizeof(frames_played));
-
-		if (in_info.eof()) {
-			MessageBox(
-				nullptr,
-				"Failed to locate the target game in the demo .inf file.",
-				cmdline,
-				MB_OK);
-
-			exit(EXIT_FAILURE);
-		}
+	std::vector<demo_game> games;
+	read_demo_info(in_info, &games);
+	if (target_game < 0 || target_game >= (int)(games.size())) {
+		MessageBox(
+			nullptr,
+			"Failed to locate the target game in the demo .inf file.",
+			cmdline,
+			MB_OK);
 
-		short mode;
-		in_info.read((char*)(&mode), sizeof(mode));
-		short level;
-		in_info.read((char*)(&level), sizeof(level));
-		char grade;
-		in_info.read(&grade, 1);
-		int start_frame;
-		in_info.read((char*)(&start_frame), sizeof(start_frame));
-
-		if (game_num++ == target_game) {
-			target_frame = start_frame;
-			break;
-		}
+		exit(EXIT_FAILURE);
 	}
 
+	target_frame = games[target_game].start_frame;
 }
 
 /**
  * setup_recording - Install hooks for demo recording
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
  *
- * Hook the SRAM reading function and the RNG to save their result
+ * Hook the SRAM reading function and the RNG to save their result. The
+ * file is written on a thread of its own unless demo.background is off.
  */
-void setup_recording()
-{
+std::string setup_recording(
+	const config &cfg,
+	std::vector<std::string> *diagnostics
+) {
+	demo_settings settings;
+	schema.bind(cfg, &settings, diagnostics);
 	CreateDirectory("demos", nullptr);
 
 	tm datetime;
 	auto time_ms = time(nullptr);
 	localtime_s(&datetime, &time_ms);
 
-	char filename[MAX_PATH];
-	strftime(filename, MAX_PATH, "demos/%Y_%m_%d_%H_%M_%S.dem", &datetime);
+	char name[MAX_PATH];
+	strftime(name, MAX_PATH, "demos/%Y_%m_%d_%H_%M_%S", &datetime);
+
+	background = settings.background;
+	if (background) {
+		background_demo_writer::settings timing;
+		timing.flush_ms = settings.flush_ms;
+		timing.sync_ms = settings.sync_ms;
+		background_output.open(std::string(name) + ".dem", timing);
+	} else {
+		output.open(std::string(name) + ".dem");
+	}
 
-	char info_filename[MAX_PATH];
-	strftime(info_filename, MAX_PATH, "demos/%Y_%m_%d_%H_%M_%S.inf", &datetime);
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	tick_frequency = (uint64_t)(frequency.QuadPart);
+	atexit(report_recording);
 
-	output.open(filename, std::ios::binary);
-	out_info.open(info_filename, std::ios::binary);
+	out_info.open(std::string(name) + ".inf", std::ios::binary);
 
 	// Version
-	out_info.write(&format_version, 1);
+	out_info.write(&demo_info_version, 1);
+
+	frame_marks.resize(max_marks);
 
 	orig_get_jvs_data = (get_jvs_data_t)(DetourFunction(
 		(BYTE*)(0x45D490), (BYTE*)(rec_get_jvs_data)));
@@ -318,4 +705,6 @@ void setup_recording()
 		(BYTE*)(0x44B690), (BYTE*)(rec_read_sram)));
 	orig_calc_final_grade = (unknown_game_over_t)(DetourFunction(
 		(BYTE*)(0x406B20), (BYTE*)(rec_calc_final_grade)));
+
+	return name;
 }
\ No newline at end of file
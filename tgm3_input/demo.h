@@ -1,5 +1,17 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
+class config;
+
 // These must be called after any other get_buttons hooks are made
-void setup_playback(const char *cmdline);
-void setup_recording();
\ No newline at end of file
+void setup_playback(
+	const char *cmdline,
+	const config &cfg,
+	std::vector<std::string> *diagnostics);
+
+// Returns the path of the new demo without an extension
+std::string setup_recording(
+	const config &cfg,
+	std::vector<std::string> *diagnostics);
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+ * Devices keyed by their raw input handle. Lookups are a hash and usually a
+ * single probe, adding and removing never moves more than one device. The
+ * devices themselves are kept in a dense array for iteration.
+ *
+ * Not thread safe, callers serialize changes against iteration.
+ */
+template<typename T>
+class device_registry {
+	struct slot {
+		const void *key; // nullptr if empty
+		size_t index;    // Into devices
+	};
+
+	std::vector<slot> slots;
+	std::vector<std::pair<const void*, std::unique_ptr<T>>> devices;
+
+	size_t mask() const
+	{
+		return slots.size() - 1;
+	}
+
+	size_t home(const void *key) const
+	{
+		auto h = (uint64_t)((uintptr_t)(key));
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		return (size_t)(h) & mask();
+	}
+
+	// Slot holding key, or the empty slot it would go in
+	size_t probe(const void *key) const
+	{
+		auto i = home(key);
+		while (slots[i].key != nullptr && slots[i].key != key)
+			i = (i + 1) & mask();
+
+		return i;
+	}
+
+	void grow()
+	{
+		std::vector<slot> old(slots.size() * 2, slot{ nullptr, 0 });
+		old.swap(slots);
+
+		for (const auto &entry : old) {
+			if (entry.key != nullptr)
+				slots[probe(entry.key)] = entry;
+		}
+	}
+
+public:
+	device_registry() : slots(16, slot{ nullptr, 0 })
+	{
+	}
+
+	device_registry(const device_registry&) = delete;
+	device_registry &operator=(const device_registry&) = delete;
+
+	size_t size() const
+	{
+		return devices.size();
+	}
+
+	// Device registered under key, null if none
+	T *find(const void *key) const
+	{
+		if (key == nullptr)
+			return nullptr;
+
+		const auto &entry = slots[probe(key)];
+		return entry.key != nullptr ? devices[entry.index].second.get() : nullptr;
+	}
+
+	/**
+	 * insert - Register a device
+	 * @key:	Raw input handle
+	 * @device:	Device to take ownership of
+	 *
+	 * Returns false and drops device if the key is null or already taken.
+	 */
+	bool insert(const void *key, std::unique_ptr<T> device)
+	{
+		if (key == nullptr || find(key) != nullptr)
+			return false;
+
+		// Keep the load factor under 1/2
+		if ((devices.size() + 1) * 2 > slots.size())
+			grow();
+
+		slots[probe(key)] = { key, devices.size() };
+		devices.emplace_back(key, std::move(device));
+		return true;
+	}
+
+	/**
+	 * remove - Unregister a device
+	 * @key:	Raw input handle
+	 *
+	 * Returns the device, null if there was none. The last device takes
+	 * its place in the iteration order.
+	 */
+	std::unique_ptr<T> remove(const void *key)
+	{
+		if (key == nullptr)
+			return nullptr;
+
+		auto i = probe(key);
+		if (slots[i].key == nullptr)
+			return nullptr;
+
+		const auto index = slots[i].index;
+		auto device = std::move(devices[index].second);
+
+		if (index != devices.size() - 1) {
+			devices[index] = std::move(devices.back());
+			slots[probe(devices[index].first)].index = index;
+		}
+		devices.pop_back();
+
+		// Shift back the entries after the hole that would be cut off
+		// from their home slot
+		auto j = i;
+		while (true) {
+			j = (j + 1) & mask();
+			if (slots[j].key == nullptr)
+				break;
+
+			const auto k = home(slots[j].key);
+			const auto between = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+			if (between)
+				continue;
+
+			slots[i] = slots[j];
+			i = j;
+		}
+		slots[i] = { nullptr, 0 };
+
+		return device;
+	}
+
+	// Iteration over the registered devices
+	template<typename Func>
+	void for_each(Func func) const
+	{
+		for (const auto &entry : devices)
+			func(*entry.second);
+	}
+};
\ No newline at end of file
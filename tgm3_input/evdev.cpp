@@ -0,0 +1,594 @@
+#ifdef __linux__
+
+#include "evdev.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+// Whether bit is set in an EVIOCGBIT/EVIOCGKEY result
+static bool test_bit(const uint8_t *bits, const int bit)
+{
+	return (bits[bit / 8] >> (bit % 8)) & 1;
+}
+
+// Hat switch positions clockwise from up, indexed by (y + 1) * 3 + x + 1,
+// 8 is centered
+static const uint8_t hat_positions[] = {
+	7, 0, 1,
+	6, 8, 2,
+	5, 4, 3
+};
+
+/**
+ * abs_usage - HID usage of an absolute axis
+ * @code:	ABS_* code
+ * @page:	Receives the usage page
+ * @usage:	Receives the usage
+ *
+ * Codes are mapped one by one, the ABS_* and usage orders only agree up to
+ * ABS_RZ. Axes with no HID counterpart get a vendor defined usage so none
+ * of them is ever taken for a hat switch.
+ */
+static void abs_usage(const int code, uint16_t *page, uint16_t *usage)
+{
+	static const struct {
+		int code;
+		uint16_t page;
+		uint16_t usage;
+	} usages[] = {
+		{ ABS_X,        0x01, 0x30 },
+		{ ABS_Y,        0x01, 0x31 },
+		{ ABS_Z,        0x01, 0x32 },
+		{ ABS_RX,       0x01, 0x33 },
+		{ ABS_RY,       0x01, 0x34 },
+		{ ABS_RZ,       0x01, 0x35 },
+		{ ABS_THROTTLE, 0x02, 0xBB },
+		{ ABS_RUDDER,   0x02, 0xBA },
+		{ ABS_WHEEL,    0x01, 0x38 },
+		{ ABS_GAS,      0x02, 0xC4 },
+		{ ABS_BRAKE,    0x02, 0xC5 },
+	};
+
+	for (const auto &entry : usages) {
+		if (entry.code == code) {
+			*page = entry.page;
+			*usage = entry.usage;
+			return;
+		}
+	}
+
+	*page = 0xFF00;
+	*usage = (uint16_t)(code);
+}
+
+evdev_input::device::~device()
+{
+	close(fd);
+	delete pending.load(std::memory_order_relaxed);
+}
+
+/**
+ * init - Open every event device that's assigned a player
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * Devices are opened in order of their event number so duplicate numbers
+ * stay the same between runs. Nothing is started if none are assigned.
+ */
+void evdev_input::init(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	auto *dir = opendir("/dev/input");
+	if (dir == nullptr)
+		return;
+
+	std::vector<int> event_nums;
+	while (const auto *entry = readdir(dir)) {
+		if (strncmp(entry->d_name, "event", 5) == 0)
+			event_nums.push_back(atoi(entry->d_name + 5));
+	}
+
+	closedir(dir);
+
+	std::sort(event_nums.begin(), event_nums.end());
+
+	for (const auto num : event_nums) {
+		const auto path = "/dev/input/event" + std::to_string(num);
+		open_device(cfg, diagnostics, path.c_str());
+	}
+
+	if (devices.empty())
+		return;
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (epoll_fd == -1 || stop_fd == -1)
+		return;
+
+	epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = nullptr;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &event);
+
+	for (auto &dev : devices) {
+		event.data.ptr = dev.get();
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dev->fd, &event);
+	}
+
+	reader = std::thread(&evdev_input::read_thread, this);
+}
+
+evdev_input::~evdev_input()
+{
+	if (reader.joinable()) {
+		const uint64_t one = 1;
+		write(stop_fd, &one, sizeof(one));
+		reader.join();
+	}
+
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	if (stop_fd != -1)
+		close(stop_fd);
+}
+
+/**
+ * open_device - Open an event device and keep it if it's used
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ * @path:		Device node
+ *
+ * Check for config info on a device based on its evdev name. Append a
+ * number in the case of duplicates, like raw input joysticks.
+ */
+void evdev_input::open_device(
+	const config &cfg,
+	std::vector<std::string> *diagnostics,
+	const char *path
+) {
+	std::unique_ptr<device> new_device(new device());
+	new_device->fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (new_device->fd == -1)
+		return;
+
+	char name[128] = {};
+	if (ioctl(new_device->fd, EVIOCGNAME(sizeof(name) - 1), name) < 0)
+		return;
+
+	auto duplicate_num = 1;
+	for (auto taken = true; taken; ) {
+		taken = false;
+		for (const auto &check_device : devices) {
+			if (check_device->duplicate_num == duplicate_num
+			 && check_device->name == name)
+				taken = true;
+		}
+
+		if (taken)
+			duplicate_num++;
+	}
+
+	auto prefix_str = std::string("joystick.") + name;
+	if (duplicate_num > 1)
+		prefix_str += " " + std::to_string(duplicate_num);
+
+	prefix_str += '.';
+	// The joystick backend reports typos for every joystick namespace
+	joystick_settings cfg_dev;
+	joystick_settings::schema().bind(cfg, prefix_str, &cfg_dev, nullptr);
+
+	// Make sure this is actually going to be used for a player
+	if (cfg_dev.player != 1 && cfg_dev.player != 2)
+		return;
+
+	if (!locate_fields(new_device.get()))
+		return;
+
+	new_device->name = name;
+	new_device->prefix = prefix_str;
+	new_device->duplicate_num = duplicate_num;
+	new_device->dropped = false;
+	new_device->decoded = 0;
+	new_device->map = build_mapping(*new_device, cfg_dev);
+
+	// Event times are compared against the clock when debounce hold-offs
+	// end
+	auto clock_id = (int)(CLOCK_MONOTONIC);
+	ioctl(new_device->fd, EVIOCSCLOCKID, &clock_id);
+
+	resync(new_device.get());
+
+	devices.push_back(std::move(new_device));
+}
+
+/**
+ * locate_fields - Lay out a device's state as a HID report
+ * @dev:	Device with fd open
+ *
+ * The report starts with a 0 report ID byte, then one bit for each key
+ * from BTN_MISC up, then a 32 bit little endian value for each absolute
+ * axis except the hats, then a hat switch byte if there's a first hat.
+ * Returns false if the device has no buttons or axes.
+ */
+bool evdev_input::locate_fields(device *dev)
+{
+	uint8_t key_bits[(KEY_MAX + 8) / 8] = {};
+	uint8_t abs_bits[(ABS_MAX + 8) / 8] = {};
+	ioctl(dev->fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+	ioctl(dev->fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+
+	auto &layout = dev->layout;
+	layout.buttons.clear();
+	layout.values.clear();
+
+	// Keyboards have keys below BTN_MISC, leave them to raw input
+	dev->key_index.assign(KEY_MAX + 1, -1);
+	for (auto code = BTN_MISC; code <= KEY_MAX; code++) {
+		if (!test_bit(key_bits, code))
+			continue;
+
+		hid_layout::field field = {};
+		field.usage_page = 0x09;
+		field.usage = (uint16_t)(layout.buttons.size() + 1);
+		field.bit_offset = (uint32_t)(8 + layout.buttons.size());
+		field.bit_size = 1;
+		field.logical_max = 1;
+
+		dev->key_index[code] = (int)(layout.buttons.size());
+		layout.buttons.push_back(field);
+	}
+
+	auto offset = (uint32_t)((8 + layout.buttons.size() + 31) / 32 * 32);
+
+	dev->axis_index.assign(ABS_MAX + 1, -1);
+	for (auto code = 0; code <= ABS_MAX; code++) {
+		if (!test_bit(abs_bits, code))
+			continue;
+
+		if (code >= ABS_HAT0X && code <= ABS_HAT3Y)
+			continue;
+
+		input_absinfo info;
+		if (ioctl(dev->fd, EVIOCGABS(code), &info) < 0)
+			continue;
+
+		hid_layout::field field = {};
+		abs_usage(code, &field.usage_page, &field.usage);
+		field.bit_offset = offset;
+		field.bit_size = 32;
+		field.logical_min = info.minimum;
+		field.logical_max = info.maximum;
+
+		dev->axis_index[code] = (int)(layout.values.size());
+		layout.values.push_back(field);
+		offset += 32;
+	}
+
+	dev->hat_byte = -1;
+	dev->hat_x = 0;
+	dev->hat_y = 0;
+	if (test_bit(abs_bits, ABS_HAT0X) || test_bit(abs_bits, ABS_HAT0Y)) {
+		hid_layout::field field = {};
+		field.usage_page = 0x01;
+		field.usage = 0x39;
+		field.bit_offset = offset;
+		field.bit_size = 8;
+		field.logical_max = 7;
+
+		dev->hat_byte = (int)(offset / 8);
+		layout.values.push_back(field);
+		offset += 8;
+	}
+
+	if (layout.buttons.empty() && layout.values.empty())
+		return false;
+
+	layout.report_size = (offset + 7) / 8;
+	dev->report.assign(layout.report_size, 0);
+	if (dev->hat_byte != -1)
+		dev->report[dev->hat_byte] = hat_positions[4];
+
+	return true;
+}
+
+/**
+ * build_mapping - Turn device settings into a report decoder
+ * @dev:	Device the settings are for
+ * @cfg_dev:	Settings bound from the device's config namespace
+ */
+std::unique_ptr<evdev_input::mapping> evdev_input::build_mapping(
+	const device &dev,
+	const joystick_settings &cfg_dev
+) {
+	std::unique_ptr<mapping> map(new mapping());
+
+	map->player = cfg_dev.player;
+	map->socd = (socd_mode)(cfg_dev.socd);
+
+	cfg_dev.compile(dev.layout, &map->program);
+
+	map->debounce_ns = (int64_t)(std::max(cfg_dev.debounce, 0.F) * 1000000.);
+
+	return map;
+}
+
+/**
+ * reload - Apply a modified config to the opened devices
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * The reader thread picks up each new mapping at the device's next
+ * SYN_REPORT. A mapping it never got to is freed here.
+ */
+void evdev_input::reload(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	for (auto &dev : devices) {
+		joystick_settings cfg_dev;
+		joystick_settings::schema().bind(cfg, dev->prefix, &cfg_dev, nullptr);
+
+		auto map = build_mapping(*dev, cfg_dev);
+		delete dev->pending.exchange(map.release(), std::memory_order_acq_rel);
+	}
+}
+
+// CLOCK_MONOTONIC in nanoseconds, the clock devices stamp events with
+static int64_t now_ns()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * read_thread - Wait for events from every device
+ *
+ * Waits time out when a device's debounce hold-off ends with an edge held
+ * off, so a switch that settled inside the window isn't left wrong until
+ * the device sends something else.
+ */
+void evdev_input::read_thread()
+{
+	epoll_event events[16];
+
+	while (true) {
+		auto recheck = INT64_MAX;
+		for (const auto &dev : devices) {
+			recheck = std::min(
+				recheck,
+				dev->debounce.recheck_time(dev->map->debounce_ns));
+		}
+
+		// Round up, waking early only means waiting again
+		auto timeout = -1;
+		if (recheck != INT64_MAX) {
+			const auto ns = std::max(recheck - now_ns(), (int64_t)(0));
+			timeout = (int)(std::min(ns / 1000000 + 1, (int64_t)(INT32_MAX)));
+		}
+
+		const auto count = epoll_wait(epoll_fd, events, 16, timeout);
+		if (count == -1 && errno == EINTR)
+			continue;
+
+		if (count == -1)
+			return;
+
+		for (auto i = 0; i < count; i++) {
+			auto *dev = (device*)(events[i].data.ptr);
+			if (dev == nullptr)
+				return;
+
+			read_events(dev);
+		}
+
+		if (recheck == INT64_MAX)
+			continue;
+
+		const auto now = now_ns();
+		for (auto &dev : devices) {
+			const auto holdoff = dev->map->debounce_ns;
+			if (dev->debounce.recheck_time(holdoff) <= now)
+				set_buttons(dev.get(), dev->debounce.expire(now, holdoff));
+		}
+	}
+}
+
+/**
+ * read_events - Apply everything queued on a device
+ * @dev:	Device that's readable
+ *
+ * State is only decoded at SYN_REPORT so the buttons and axes of one
+ * report change together. After SYN_DROPPED everything up to the next
+ * SYN_REPORT is thrown away and the state is read back from the device.
+ */
+void evdev_input::read_events(device *dev)
+{
+	input_event events[64];
+
+	while (true) {
+		const auto size = read(dev->fd, events, sizeof(events));
+		if (size == -1 && errno == EINTR)
+			continue;
+
+		if (size == -1 && errno == ENODEV) {
+			// Unplugged, stop listening and let go of its buttons
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, dev->fd, nullptr);
+			std::fill(dev->report.begin(), dev->report.end(), 0);
+			if (dev->hat_byte != -1)
+				dev->report[dev->hat_byte] = hat_positions[4];
+
+			dev->hat_x = 0;
+			dev->hat_y = 0;
+			dev->debounce.clear();
+			sync(dev, 0);
+			return;
+		}
+
+		if (size <= 0)
+			return;
+
+		const auto num_events = (size_t)(size) / sizeof(input_event);
+		for (auto i = 0u; i < num_events; i++) {
+			const auto &event = events[i];
+
+			if (event.type == EV_SYN && event.code == SYN_DROPPED) {
+				dev->dropped = true;
+				continue;
+			}
+
+			if (event.type == EV_SYN && event.code == SYN_REPORT) {
+				if (dev->dropped) {
+					resync(dev);
+					dev->dropped = false;
+				}
+
+				sync(dev,
+					(int64_t)(event.input_event_sec) * 1000000000
+					+ (int64_t)(event.input_event_usec) * 1000);
+				continue;
+			}
+
+			if (dev->dropped)
+				continue;
+
+			if (event.type == EV_KEY && event.code <= KEY_MAX) {
+				const auto idx = dev->key_index[event.code];
+				if (idx == -1)
+					continue;
+
+				const auto bit = 8 + idx;
+				auto &byte = dev->report[bit / 8];
+				if (event.value != 0)
+					byte |= (uint8_t)(1 << (bit % 8));
+				else
+					byte &= (uint8_t)~(1 << (bit % 8));
+			} else if (event.type == EV_ABS && event.code <= ABS_MAX) {
+				if (event.code == ABS_HAT0X) {
+					dev->hat_x = event.value;
+					continue;
+				} else if (event.code == ABS_HAT0Y) {
+					dev->hat_y = event.value;
+					continue;
+				}
+
+				const auto idx = dev->axis_index[event.code];
+				if (idx == -1)
+					continue;
+
+				const auto value = (uint32_t)(event.value);
+				const auto byte = dev->layout.values[idx].bit_offset / 8;
+				for (auto j = 0; j < 4; j++)
+					dev->report[byte + j] = (uint8_t)(value >> (j * 8));
+			}
+		}
+	}
+}
+
+/**
+ * resync - Read a device's whole state back
+ * @dev:	Device to read
+ *
+ * Used when opening a device and after the kernel dropped events.
+ */
+void evdev_input::resync(device *dev)
+{
+	uint8_t key_state[(KEY_MAX + 8) / 8] = {};
+	ioctl(dev->fd, EVIOCGKEY(sizeof(key_state)), key_state);
+
+	for (auto code = 0; code <= KEY_MAX; code++) {
+		const auto idx = dev->key_index[code];
+		if (idx == -1)
+			continue;
+
+		const auto bit = 8 + idx;
+		auto &byte = dev->report[bit / 8];
+		if (test_bit(key_state, code))
+			byte |= (uint8_t)(1 << (bit % 8));
+		else
+			byte &= (uint8_t)~(1 << (bit % 8));
+	}
+
+	for (auto code = 0; code <= ABS_MAX; code++) {
+		const auto idx = dev->axis_index[code];
+		const auto hat = code == ABS_HAT0X || code == ABS_HAT0Y;
+		if (idx == -1 && !(hat && dev->hat_byte != -1))
+			continue;
+
+		input_absinfo info;
+		if (ioctl(dev->fd, EVIOCGABS(code), &info) < 0)
+			continue;
+
+		if (code == ABS_HAT0X) {
+			dev->hat_x = info.value;
+		} else if (code == ABS_HAT0Y) {
+			dev->hat_y = info.value;
+		} else {
+			const auto value = (uint32_t)(info.value);
+			const auto byte = dev->layout.values[idx].bit_offset / 8;
+			for (auto j = 0; j < 4; j++)
+				dev->report[byte + j] = (uint8_t)(value >> (j * 8));
+		}
+	}
+}
+
+/**
+ * sync - Decode a device's state into its player's buttons
+ * @dev:	Device that got a SYN_REPORT
+ * @time_ns:	Event time in nanoseconds, for debouncing
+ */
+void evdev_input::sync(device *dev, const int64_t time_ns)
+{
+	auto *next = dev->pending.exchange(nullptr, std::memory_order_acquire);
+	if (next != nullptr)
+		dev->map.reset(next);
+
+	// Player may have been unset by a reload
+	const auto *map = dev->map.get();
+	if (map->player != 1 && map->player != 2)
+		return;
+
+	if (dev->hat_byte != -1) {
+		const auto x = dev->hat_x < 0 ? 0 : dev->hat_x > 0 ? 2 : 1;
+		const auto y = dev->hat_y < 0 ? 0 : dev->hat_y > 0 ? 2 : 1;
+		dev->report[dev->hat_byte] = hat_positions[y * 3 + x];
+	}
+
+	dev->decoded = map->program.decode(
+		dev->report.data(),
+		dev->report.size(),
+		dev->decoded);
+
+	set_buttons(dev, dev->debounce.update(
+		dev->decoded,
+		time_ns,
+		map->debounce_ns));
+}
+
+/**
+ * set_buttons - Apply SOCD and hand a device's buttons to its player
+ * @dev:	Device the buttons are from
+ * @debounced:	Decoded and debounced buttons
+ */
+void evdev_input::set_buttons(device *dev, const unsigned short debounced)
+{
+	const auto *map = dev->map.get();
+	if (map->player != 1 && map->player != 2)
+		return;
+
+	auto *directions = map->player == 1 ? &directions_1p : &directions_2p;
+	const auto buttons = (unsigned short)((debounced & ~dir_all)
+		| directions->update(debounced & dir_all, map->socd));
+
+	auto *player_buttons = map->player == 1 ? &buttons_1p : &buttons_2p;
+	if (player_buttons->exchange(buttons, std::memory_order_release) != buttons)
+		notify_buttons_changed();
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+
+// Only available when built with winelib, where Linux headers are around
+#ifdef __linux__
+
+#include "base_input.h"
+#include "hid_program.h"
+#include "joystick_settings.h"
+#include "debounce.h"
+#include "socd.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Reads /dev/input/event* directly instead of going through Wine's HID
+ * emulation. Devices are configured with the same joystick.<name>. keys as
+ * raw input joysticks: buttons are numbered in order of their BTN_* codes
+ * and axes in order of their ABS_* codes, leaving out hats. The first hat
+ * always maps to the directions.
+ *
+ * Events are read on a thread of its own, which calls
+ * notify_buttons_changed whenever a player's buttons change.
+ */
+class evdev_input : public base_input {
+	// Config dependent part of device, handed to the reader thread
+	struct mapping {
+		int player;
+		hid_program program;
+		int64_t debounce_ns;
+		socd_mode socd;
+	};
+
+	struct device {
+		int fd;
+		std::string name;
+		std::string prefix;
+		int duplicate_num;
+
+		// Index in the config for each key and absolute axis code, -1
+		// if unused
+		std::vector<int> key_index;
+		std::vector<int> axis_index;
+
+		// Device state laid out as a HID report so hid_program can
+		// decode and gate it like a raw input joystick. The first hat
+		// becomes a hat switch byte at hat_byte, -1 if there's none.
+		hid_layout layout;
+		std::vector<uint8_t> report;
+		int hat_byte;
+		int hat_x;
+		int hat_y;
+
+		// Reader thread only
+		bool dropped;
+		unsigned short decoded;
+		eager_debounce debounce;
+		std::unique_ptr<mapping> map;
+
+		// Set by reload, picked up by the reader thread
+		std::atomic<mapping*> pending;
+
+		device() : pending(nullptr)
+		{
+		}
+
+		~device();
+	};
+
+	// Fixed once init returns
+	std::vector<std::unique_ptr<device>> devices;
+
+	int epoll_fd = -1;
+	int stop_fd = -1;
+	std::thread reader;
+
+	std::atomic<unsigned short> buttons_1p;
+	std::atomic<unsigned short> buttons_2p;
+
+	// Reader thread only
+	direction_priority directions_1p;
+	direction_priority directions_2p;
+
+	// Open an event device and keep it if it's assigned a player
+	void open_device(
+		const config &cfg,
+		std::vector<std::string> *diagnostics,
+		const char *path);
+
+	// Build the report layout from the device's capabilities
+	static bool locate_fields(device *dev);
+
+	static std::unique_ptr<mapping> build_mapping(
+		const device &dev,
+		const joystick_settings &cfg_dev);
+
+	// Reader thread
+	void read_events(device *dev);
+	void resync(device *dev);
+	void sync(device *dev, int64_t time_ns);
+	void set_buttons(device *dev, unsigned short debounced);
+	void read_thread();
+
+public:
+	evdev_input() : buttons_1p(0), buttons_2p(0)
+	{
+	}
+
+	~evdev_input();
+
+	// Nothing comes through raw input
+	std::vector<int> get_usage() override
+	{
+		return {};
+	}
+
+	// Open the event devices and start the reader thread
+	void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	// Hand new mappings to the reader thread
+	void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	void update(const tagRAWINPUT *input) override
+	{
+	}
+
+	void clear_buttons() override
+	{
+		buttons_1p.store(0, std::memory_order_relaxed);
+		buttons_2p.store(0, std::memory_order_relaxed);
+	}
+
+	unsigned short get_buttons_1p() const override
+	{
+		return buttons_1p.load(std::memory_order_acquire);
+	}
+
+	unsigned short get_buttons_2p() const override
+	{
+		return buttons_2p.load(std::memory_order_acquire);
+	}
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "file_watcher.h"
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+// Directory change notification filtered by the file's write time
+class win32_file_watcher : public file_watcher {
+	std::string path;
+	HANDLE change;
+	HANDLE stop_event;
+	FILETIME last_write;
+
+	bool get_write_time(FILETIME *time) const
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+			return false;
+
+		*time = data.ftLastWriteTime;
+		return true;
+	}
+
+public:
+	win32_file_watcher(const std::string &path, const HANDLE change) :
+		path(path),
+		change(change),
+		stop_event(CreateEvent(nullptr, TRUE, FALSE, nullptr))
+	{
+		if (!get_write_time(&last_write))
+			last_write = { 0, 0 };
+	}
+
+	~win32_file_watcher() override
+	{
+		FindCloseChangeNotification(change);
+		CloseHandle(stop_event);
+	}
+
+	bool wait() override
+	{
+		while (true) {
+			const HANDLE handles[] = { stop_event, change };
+			const auto result = WaitForMultipleObjects(
+				2, handles, FALSE, INFINITE);
+
+			if (result != WAIT_OBJECT_0 + 1)
+				return false;
+
+			FindNextChangeNotification(change);
+
+			// Something else in the directory changed
+			FILETIME write_time;
+			if (!get_write_time(&write_time)
+			 || CompareFileTime(&write_time, &last_write) == 0)
+				continue;
+
+			last_write = write_time;
+			return true;
+		}
+	}
+
+	void stop() override
+	{
+		SetEvent(stop_event);
+	}
+};
+
+/**
+ * make_file_watcher - Watch a file for modification
+ * @path:	File path
+ *
+ * Windows can only notify about directories, so watch the file's directory
+ * for writes and compare the file's write time when it fires.
+ */
+std::unique_ptr<file_watcher> make_file_watcher(const std::string &path)
+{
+	const auto slash = path.find_last_of("/\\");
+	const auto dir = slash != std::string::npos ? path.substr(0, slash + 1) : ".";
+
+	const auto change = FindFirstChangeNotification(
+		dir.c_str(),
+		FALSE,
+		FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+
+	if (change == INVALID_HANDLE_VALUE)
+		return nullptr;
+
+	return std::unique_ptr<file_watcher>(new win32_file_watcher(path, change));
+}
+
+#else
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+
+// inotify on the file's directory so editors that replace the file work too
+class inotify_file_watcher : public file_watcher {
+	std::string name;
+	int notify_fd;
+	int stop_fd;
+
+public:
+	inotify_file_watcher(const std::string &name, const int notify_fd) :
+		name(name),
+		notify_fd(notify_fd),
+		stop_fd(eventfd(0, 0))
+	{
+	}
+
+	~inotify_file_watcher() override
+	{
+		close(notify_fd);
+		close(stop_fd);
+	}
+
+	bool wait() override
+	{
+		alignas(inotify_event) char buf[sizeof(inotify_event) + NAME_MAX + 1];
+
+		while (true) {
+			pollfd fds[] = {
+				{ stop_fd,   POLLIN, 0 },
+				{ notify_fd, POLLIN, 0 }
+			};
+
+			if (poll(fds, 2, -1) < 0 || (fds[0].revents & POLLIN))
+				return false;
+
+			const auto len = read(notify_fd, buf, sizeof(buf));
+			if (len <= 0)
+				return false;
+
+			for (auto *pos = buf; pos < buf + len;) {
+				const auto *event = (const inotify_event*)(pos);
+				if (event->len != 0 && name == event->name)
+					return true;
+
+				pos += sizeof(inotify_event) + event->len;
+			}
+		}
+	}
+
+	void stop() override
+	{
+		const uint64_t one = 1;
+		if (write(stop_fd, &one, sizeof(one)) < 0)
+			return;
+	}
+};
+
+std::unique_ptr<file_watcher> make_file_watcher(const std::string &path)
+{
+	const auto slash = path.find_last_of('/');
+	const auto dir = slash != std::string::npos ? path.substr(0, slash + 1) : ".";
+	const auto name = slash != std::string::npos ? path.substr(slash + 1) : path;
+
+	const auto notify_fd = inotify_init();
+	if (notify_fd < 0)
+		return nullptr;
+
+	if (inotify_add_watch(
+		notify_fd,
+		dir.c_str(),
+		IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0
+	) {
+		close(notify_fd);
+		return nullptr;
+	}
+
+	return std::unique_ptr<file_watcher>(
+		new inotify_file_watcher(name, notify_fd));
+}
+
+#endif
\ No newline at end of file
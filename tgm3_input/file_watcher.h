@@ -0,0 +1,21 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+// Waits for changes to a single file
+class file_watcher {
+public:
+	virtual ~file_watcher()
+	{
+	}
+
+	// Block until the file is modified, return false once stop was called
+	virtual bool wait() = 0;
+
+	// Wake up wait from another thread and make it return false
+	virtual void stop() = 0;
+};
+
+// Create the watcher for the current platform, null on failure
+std::unique_ptr<file_watcher> make_file_watcher(const std::string &path);
\ No newline at end of file
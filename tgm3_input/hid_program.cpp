@@ -0,0 +1,313 @@
+#include "hid_program.h"
+#include "socd.h"
+#include <algorithm>
+#include <cmath>
+
+static const int hat_switch_page = 0x01;
+static const int hat_switch_usage = 0x39;
+
+// Whether a field fits inside reports of size bytes
+static bool field_fits(const hid_layout::field &field, const size_t size)
+{
+	return field.bit_size != 0
+	    && field.bit_size <= 32
+	    && (field.bit_offset + field.bit_size + 7) / 8 <= size;
+}
+
+/**
+ * extract - Read a field from a report
+ * @report:	Report buffer
+ * @bit_offset:	First bit of the field
+ * @bit_size:	Width of the field, at most 32
+ * @is_signed:	Whether to sign extend
+ */
+int32_t hid_program::extract(
+	const uint8_t *report,
+	const uint32_t bit_offset,
+	const uint32_t bit_size,
+	const bool is_signed
+) {
+	const auto first = bit_offset / 8;
+	const auto last = (bit_offset + bit_size - 1) / 8;
+
+	uint64_t raw = 0;
+	for (auto i = last + 1; i-- > first; )
+		raw = (raw << 8) | report[i];
+
+	raw >>= bit_offset % 8;
+	raw &= ((uint64_t)(1) << bit_size) - 1;
+
+	if (is_signed && bit_size < 64 && (raw >> (bit_size - 1)) & 1)
+		raw |= ~(uint64_t)(0) << bit_size;
+
+	return (int32_t)(raw);
+}
+
+void hid_program::compile(
+	const hid_layout &layout,
+	const std::vector<unsigned short> &button_masks,
+	const std::vector<hid_axis> &axes,
+	const hid_gate_settings &gate
+) {
+	report_size = layout.report_size;
+	report_ids = false;
+	bits.clear();
+	values.clear();
+	sticks.clear();
+	hats.clear();
+
+	const auto deadzone = std::min(std::max(gate.deadzone, 0.F), 1.F);
+	const auto held_deadzone = std::max(deadzone - gate.hysteresis, 0.F);
+
+	const auto note_report_id = [&](const hid_layout::field &field)
+	{
+		if (field.report_id != 0)
+			report_ids = true;
+	};
+
+	for (auto i = 0u; i < layout.buttons.size() && i < button_masks.size(); i++) {
+		const auto &field = layout.buttons[i];
+		if (button_masks[i] == 0 || !field_fits(field, report_size))
+			continue;
+
+		note_report_id(field);
+		bits.push_back({
+			field.bit_offset / 8,
+			(uint8_t)(field.bit_offset % 8),
+			field.report_id,
+			button_masks[i]
+		});
+	}
+
+	// Same as rescaling to [-1, 1] and comparing against deadzone
+	const auto add_value = [&](const hid_layout::field &field, const hid_axis axis)
+	{
+		const auto range = (double)(field.logical_max) - field.logical_min;
+		const auto threshold = [&](const float offset)
+		{
+			return field.logical_min + (1. + offset) * range / 2.;
+		};
+
+		value_op op;
+		op.bit_offset = field.bit_offset;
+		op.bit_size = field.bit_size;
+		op.report_id = field.report_id;
+		op.is_signed = field.logical_min < 0;
+		op.low = (int32_t)(std::floor(threshold(-deadzone)));
+		op.high = (int32_t)(std::ceil(threshold(deadzone)));
+		op.low_held = (int32_t)(std::floor(threshold(-held_deadzone)));
+		op.high_held = (int32_t)(std::ceil(threshold(held_deadzone)));
+
+		if (axis == hid_axis::up_down) {
+			op.low_mask = dir_up;
+			op.high_mask = dir_down;
+		} else {
+			op.low_mask = dir_left;
+			op.high_mask = dir_right;
+		}
+
+		note_report_id(field);
+		values.push_back(op);
+	};
+
+	// Axes for the round gates, combined after the loop
+	const hid_layout::field *stick_x = nullptr;
+	const hid_layout::field *stick_y = nullptr;
+
+	for (auto i = 0u; i < layout.values.size(); i++) {
+		const auto &field = layout.values[i];
+		if (!field_fits(field, report_size))
+			continue;
+
+		if (field.usage_page == hat_switch_page
+		 && field.usage == hat_switch_usage) {
+			// Clockwise from up in 8 or 4 steps
+			static const unsigned short eight_way[] = {
+				dir_up,
+				dir_up | dir_right,
+				dir_right,
+				dir_down | dir_right,
+				dir_down,
+				dir_down | dir_left,
+				dir_left,
+				dir_up | dir_left
+			};
+
+			static const unsigned short four_way[] = {
+				dir_up,
+				dir_right,
+				dir_down,
+				dir_left
+			};
+
+			hat_op op;
+			op.bit_offset = field.bit_offset;
+			op.bit_size = field.bit_size;
+			op.report_id = field.report_id;
+			op.logical_min = field.logical_min;
+
+			const auto positions = (int64_t)(field.logical_max) - field.logical_min + 1;
+			const auto *table = positions == 4 ? four_way : eight_way;
+			op.num_directions = positions == 4 ? 4 : 8;
+			for (auto j = 0u; j < op.num_directions; j++)
+				op.directions[j] = table[j];
+
+			note_report_id(field);
+			hats.push_back(op);
+			continue;
+		}
+
+		if (i >= axes.size() || axes[i] == hid_axis::none)
+			continue;
+
+		if (field.logical_max <= field.logical_min)
+			continue;
+
+		if (gate.mode != hid_gate::axis) {
+			if (axes[i] == hid_axis::left_right && stick_x == nullptr) {
+				stick_x = &field;
+				continue;
+			}
+
+			if (axes[i] == hid_axis::up_down && stick_y == nullptr) {
+				stick_y = &field;
+				continue;
+			}
+		}
+
+		add_value(field, axes[i]);
+	}
+
+	// A lone axis, or axes split over reports, can only be gated alone
+	if (stick_x == nullptr
+	 || stick_y == nullptr
+	 || stick_x->report_id != stick_y->report_id) {
+		if (stick_x != nullptr)
+			add_value(*stick_x, hid_axis::left_right);
+		if (stick_y != nullptr)
+			add_value(*stick_y, hid_axis::up_down);
+
+		return;
+	}
+
+	const auto pi = 3.14159265358979;
+	const auto diagonal = gate.mode == hid_gate::radial
+		? 45.F
+		: std::min(std::max(gate.diagonal, 0.F), 90.F);
+
+	// Cardinal sectors are centered on the axes
+	const auto half_cardinal = (90. - diagonal) / 2.;
+	const auto hysteresis_angle = gate.hysteresis * 45.;
+	const auto edge = [&](const double degrees)
+	{
+		const auto clamped = std::min(std::max(degrees, 0.), 45.);
+		return (int64_t)(std::tan(clamped * pi / 180.) * 65536.);
+	};
+
+	stick_op op;
+	op.report_id = stick_x->report_id;
+
+	op.x_offset = stick_x->bit_offset;
+	op.x_size = stick_x->bit_size;
+	op.x_signed = stick_x->logical_min < 0;
+	op.x_center2 = (int64_t)(stick_x->logical_min) + stick_x->logical_max;
+	op.x_range = (int64_t)(stick_x->logical_max) - stick_x->logical_min;
+
+	op.y_offset = stick_y->bit_offset;
+	op.y_size = stick_y->bit_size;
+	op.y_signed = stick_y->logical_min < 0;
+	op.y_center2 = (int64_t)(stick_y->logical_min) + stick_y->logical_max;
+	op.y_range = (int64_t)(stick_y->logical_max) - stick_y->logical_min;
+
+	const auto enter = (int64_t)(deadzone * 32768.F);
+	const auto stay = (int64_t)(held_deadzone * 32768.F);
+	op.enter2 = enter * enter;
+	op.stay2 = stay * stay;
+
+	op.edge = edge(half_cardinal);
+	op.edge_cardinal_held = edge(half_cardinal + hysteresis_angle);
+	op.edge_diagonal_held = edge(half_cardinal - hysteresis_angle);
+
+	note_report_id(*stick_x);
+	sticks.push_back(op);
+}
+
+unsigned short hid_program::decode(
+	const uint8_t *report,
+	const size_t size,
+	const unsigned short previous
+) const {
+	if (size < report_size || size == 0)
+		return 0;
+
+	// Ops for other reports than this one match nothing
+	const auto id = report_ids ? report[0] : 0;
+
+	unsigned buttons = 0;
+
+	for (const auto &op : bits) {
+		const auto set = (report[op.byte] >> op.shift) & (op.report_id == id);
+		buttons |= op.mask & (0u - set);
+	}
+
+	for (const auto &op : values) {
+		if (op.report_id != id)
+			continue;
+
+		const auto value = extract(report, op.bit_offset, op.bit_size, op.is_signed);
+		const auto low = (previous & op.low_mask) ? op.low_held : op.low;
+		const auto high = (previous & op.high_mask) ? op.high_held : op.high;
+		buttons |= value <= low  ? op.low_mask  : 0;
+		buttons |= value >= high ? op.high_mask : 0;
+	}
+
+	const auto held_x = (previous & (dir_left | dir_right)) != 0;
+	const auto held_y = (previous & (dir_up | dir_down)) != 0;
+
+	for (const auto &op : sticks) {
+		if (op.report_id != id)
+			continue;
+
+		// Position in Q15, [-32768, 32768]
+		const auto raw_x = extract(report, op.x_offset, op.x_size, op.x_signed);
+		const auto raw_y = extract(report, op.y_offset, op.y_size, op.y_signed);
+		const auto x = (2 * (int64_t)(raw_x) - op.x_center2) * 32768 / op.x_range;
+		const auto y = (2 * (int64_t)(raw_y) - op.y_center2) * 32768 / op.y_range;
+
+		const auto deadzone2 = held_x || held_y ? op.stay2 : op.enter2;
+		if (x * x + y * y < deadzone2)
+			continue;
+
+		const auto x_edge =
+			held_x && held_y ? op.edge_diagonal_held :
+			held_x           ? op.edge_cardinal_held :
+			                   op.edge;
+		const auto y_edge =
+			held_x && held_y ? op.edge_diagonal_held :
+			held_y           ? op.edge_cardinal_held :
+			                   op.edge;
+
+		const auto abs_x = x < 0 ? -x : x;
+		const auto abs_y = y < 0 ? -y : y;
+		const auto x_only = abs_y * 65536 < abs_x * x_edge;
+		const auto y_only = abs_x * 65536 < abs_y * y_edge;
+
+		if (!y_only && x != 0)
+			buttons |= x < 0 ? dir_left : dir_right;
+		if (!x_only && y != 0)
+			buttons |= y < 0 ? dir_up : dir_down;
+	}
+
+	for (const auto &op : hats) {
+		if (op.report_id != id)
+			continue;
+
+		const auto position = (uint32_t)(
+			extract(report, op.bit_offset, op.bit_size, false) - op.logical_min);
+
+		if (position < op.num_directions)
+			buttons |= op.directions[position];
+	}
+
+	return (unsigned short)(buttons);
+}
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Where each control of a HID device lives in its input reports. Offsets are
+ * in bits from the start of the report buffer, which begins with the report
+ * ID byte (0 if the device doesn't use report IDs).
+ */
+struct hid_layout {
+	struct field {
+		uint8_t report_id;
+		uint16_t usage_page;
+		uint16_t usage;
+		uint32_t bit_offset;
+		uint32_t bit_size; // 0 if the field couldn't be located
+		int32_t logical_min;
+		int32_t logical_max;
+	};
+
+	size_t report_size = 0;
+
+	// Indexed by button number as used in the config
+	std::vector<field> buttons;
+
+	// Indexed by value number as used in the config, hat switches included
+	std::vector<field> values;
+};
+
+enum class hid_axis {
+	none,
+	up_down,
+	left_right
+};
+
+// How analog stick positions turn into directions
+enum class hid_gate {
+	axis,      // Each axis against the deadzone on its own, square gate
+	radial,    // Round deadzone, 8 equal direction sectors
+	eight_way  // Round deadzone, diagonal sectors diagonal degrees wide
+};
+
+static const char *const hid_gate_names[] = {
+	"axis",
+	"radial",
+	"8way",
+	nullptr
+};
+
+struct hid_gate_settings {
+	hid_gate mode;
+
+	// Fraction of half an axis' range to ignore
+	float deadzone;
+
+	// Width of the diagonal sectors for eight_way, in degrees
+	float diagonal;
+
+	// Once a direction is held, the deadzone shrinks by this fraction of
+	// half the range and sector edges move by this fraction of 45 degrees
+	// in its favor, so it doesn't chatter at the edge
+	float hysteresis;
+};
+
+/*
+ * A device layout combined with its button and axis settings, compiled into
+ * flat lists of bit extractions. Decoding a report touches only the fields
+ * that are mapped to something and never allocates or calls into the OS.
+ */
+class hid_program {
+	struct bit_op {
+		uint32_t byte;
+		uint8_t shift;
+		uint8_t report_id;
+		unsigned short mask;
+	};
+
+	struct value_op {
+		uint32_t bit_offset;
+		uint32_t bit_size;
+		uint8_t report_id;
+		bool is_signed;
+
+		// Raw values at or beyond these set low_mask/high_mask, the
+		// held ones apply while the mask was set by the last decode
+		int32_t low;
+		int32_t high;
+		int32_t low_held;
+		int32_t high_held;
+		unsigned short low_mask;
+		unsigned short high_mask;
+	};
+
+	// Both axes of a stick gated together
+	struct stick_op {
+		uint8_t report_id;
+
+		uint32_t x_offset;
+		uint32_t x_size;
+		bool x_signed;
+		int64_t x_center2; // logical_min + logical_max
+		int64_t x_range;   // logical_max - logical_min
+
+		uint32_t y_offset;
+		uint32_t y_size;
+		bool y_signed;
+		int64_t y_center2;
+		int64_t y_range;
+
+		// Squared radius in Q15 to leave the deadzone, and to stay out
+		// of it once a direction is held
+		int64_t enter2;
+		int64_t stay2;
+
+		// tan of the angle between a cardinal sector's middle and its
+		// edge, in Q16. The held variants apply while the last decode
+		// was a cardinal or a diagonal.
+		int64_t edge;
+		int64_t edge_cardinal_held;
+		int64_t edge_diagonal_held;
+	};
+
+	struct hat_op {
+		uint32_t bit_offset;
+		uint32_t bit_size;
+		uint8_t report_id;
+		int32_t logical_min;
+
+		// Direction masks for each hat position, past the end is centered
+		unsigned short directions[8];
+		uint32_t num_directions;
+	};
+
+	size_t report_size = 0;
+	bool report_ids = false;
+
+	std::vector<bit_op> bits;
+	std::vector<value_op> values;
+	std::vector<stick_op> sticks;
+	std::vector<hat_op> hats;
+
+	static int32_t extract(
+		const uint8_t *report,
+		uint32_t bit_offset,
+		uint32_t bit_size,
+		bool is_signed);
+
+public:
+	/**
+	 * compile - Build the decode lists for a device
+	 * @layout:		Where the device's controls are
+	 * @button_masks:	Game buttons for each entry of layout.buttons
+	 * @axes:		Axis for each entry of layout.values, hat
+	 *			switches are always decoded
+	 * @gate:		How axes turn into directions
+	 *
+	 * Thresholds are worked out here in raw units, decoding uses integer
+	 * math only.
+	 */
+	void compile(
+		const hid_layout &layout,
+		const std::vector<unsigned short> &button_masks,
+		const std::vector<hid_axis> &axes,
+		const hid_gate_settings &gate);
+
+	/**
+	 * decode - Turn an input report into game buttons
+	 * @report:	Report buffer, starting with the report ID byte
+	 * @size:	Size of report
+	 * @previous:	What the last decode for this device returned, for
+	 *		hysteresis
+	 *
+	 * Returns 0 for reports that are too short.
+	 */
+	unsigned short decode(
+		const uint8_t *report,
+		size_t size,
+		unsigned short previous) const;
+};
\ No newline at end of file
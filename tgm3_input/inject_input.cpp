@@ -0,0 +1,46 @@
+#include "inject_input.h"
+#include "button_state.h"
+#include "../config_schema.h"
+
+static const config_schema<inject_input::settings> schema("inject.", {
+	{ "name", &inject_input::settings::name, "" },
+});
+
+/**
+ * init - Map the inject ring
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * An empty name leaves injection off
+ */
+void inject_input::init(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	settings inject;
+	schema.bind(cfg, &inject, diagnostics);
+
+	if (inject.name.empty())
+		return;
+
+	mapping = map_inject_ring(inject.name);
+	if (mapping == nullptr) {
+		if (diagnostics != nullptr)
+			diagnostics->push_back("inject.name: couldn't map " + inject.name);
+
+		return;
+	}
+
+	ring = mapping->get();
+}
+
+/**
+ * poll_buttons - Apply the entries that are due
+ * @frame:	Game frame of this JVS poll
+ */
+uint32_t inject_input::poll_buttons(const uint32_t frame)
+{
+	if (ring == nullptr)
+		return 0;
+
+	apply_inject_entries(ring, frame, &buttons_1p, &buttons_2p);
+	return button_state::pack(buttons_1p, buttons_2p);
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "base_input.h"
+#include "../inject/inject_ring.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/*
+ * Buttons fed by another process through the shared memory ring in
+ * inject_ring.h, for bots and scripted tests. Enabled by setting
+ * inject.name to the ring's name.
+ *
+ * Entries are applied at JVS polls by game frame rather than through the
+ * window, so nothing is published and focus doesn't matter.
+ */
+class inject_input : public base_input {
+public:
+	// Ring name shared with the producer, empty for off
+	struct settings {
+		std::string name;
+	};
+
+private:
+	std::unique_ptr<inject_mapping> mapping;
+	inject_ring *ring = nullptr;
+
+	// Game thread only
+	unsigned short buttons_1p = 0;
+	unsigned short buttons_2p = 0;
+
+public:
+	// Nothing comes through raw input
+	std::vector<int> get_usage() override
+	{
+		return {};
+	}
+
+	// Map the ring if one is configured
+	void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	// The ring stays mapped under its original name
+	void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override
+	{
+	}
+
+	void update(const tagRAWINPUT *input) override
+	{
+	}
+
+	// Injected buttons only reach the game through poll_buttons
+	unsigned short get_buttons_1p() const override
+	{
+		return 0;
+	}
+
+	unsigned short get_buttons_2p() const override
+	{
+		return 0;
+	}
+
+	// Scripts keep control while the window is in the background
+	void clear_buttons() override
+	{
+	}
+
+	// Apply the entries due at frame
+	uint32_t poll_buttons(uint32_t frame) override;
+};
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "input_thread.h"
+#include <chrono>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Monotonic clock in microseconds, never 0 so 0 can mean unset
+static uint64_t now_us()
+{
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64_t)(std::chrono::duration_cast<std::chrono::microseconds>(now).count()) + 1;
+}
+
+// Run ahead of the game and everything else it starts
+static void raise_priority()
+{
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+	// Needs privileges most of the time, the default priority works too
+	sched_param param = {};
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+bool input_thread::start(
+	std::unique_ptr<input_source> new_source,
+	const request_handler on_request
+) {
+	if (state.load(std::memory_order_relaxed) != run_state::stopped)
+		return false;
+
+	source = std::move(new_source);
+	handler = on_request;
+	stopping.store(false, std::memory_order_relaxed);
+	state.store(run_state::opening, std::memory_order_relaxed);
+
+	thread = std::thread(&input_thread::run, this);
+
+	std::unique_lock<std::mutex> guard(state_lock);
+	state_changed.wait(guard, [this]
+	{
+		return state.load(std::memory_order_relaxed) != run_state::opening;
+	});
+
+	guard.unlock();
+
+	if (state.load(std::memory_order_acquire) == run_state::running)
+		return true;
+
+	thread.join();
+	state.store(run_state::stopped, std::memory_order_relaxed);
+	return false;
+}
+
+void input_thread::stop()
+{
+	if (!thread.joinable())
+		return;
+
+	stopping.store(true, std::memory_order_release);
+	source->wake();
+	thread.join();
+
+	// The source stays around for requests that were already on their way
+	state.store(run_state::stopped, std::memory_order_release);
+}
+
+void input_thread::request(const uint32_t bits)
+{
+	uint64_t unset = 0;
+	request_time.compare_exchange_strong(unset, now_us());
+
+	// The source only starts waking the thread once it's open, and the
+	// thread checks for requests after opening, so one of them sees this
+	requests.fetch_or(bits);
+	source->wake();
+}
+
+/**
+ * handle_requests - Pass pending request bits to the handler
+ *
+ * A request made between taking the time and the bits has its time taken
+ * without bits, that request goes untimed rather than timed wrong.
+ */
+void input_thread::handle_requests()
+{
+	const auto time = request_time.exchange(0);
+	const auto bits = requests.exchange(0);
+	if (bits == 0)
+		return;
+
+	handler(bits);
+
+	if (time != 0) {
+		const auto us = now_us() - time;
+		wake_latency.record(us > UINT32_MAX ? UINT32_MAX : (uint32_t)(us));
+	}
+}
+
+/**
+ * run - Input thread
+ *
+ * Open the source and tell start how it went, then pump until stopped.
+ */
+void input_thread::run()
+{
+	raise_priority();
+
+	const auto opened = source->open();
+	{
+		std::lock_guard<std::mutex> guard(state_lock);
+		state.store(
+			opened ? run_state::running : run_state::failed,
+			std::memory_order_release);
+	}
+
+	state_changed.notify_all();
+
+	if (!opened)
+		return;
+
+	while (!stopping.load(std::memory_order_acquire)) {
+		handle_requests();
+		source->pump();
+	}
+
+	source->close();
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "latency.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * Where an input thread gets its events from, so the thread itself doesn't
+ * depend on the OS. open, pump and close are called on the input thread.
+ */
+class input_source {
+public:
+	virtual ~input_source() = default;
+
+	// Set up before the first pump, false if input can't be read this way
+	virtual bool open() = 0;
+
+	// Wait until events arrive or wake is called, then handle the events
+	virtual void pump() = 0;
+
+	// Make the current or next pump return, safe from any thread
+	virtual void wake() = 0;
+
+	// Clean up after the last pump
+	virtual void close() = 0;
+};
+
+/*
+ * A source without any OS events of its own, pump just waits on a condition
+ * variable until woken. Runs input_thread where there's no message loop to
+ * wait on, like on Linux where evdev reads on its own thread and only asks
+ * for requests to be handled.
+ */
+class condition_source : public input_source {
+	std::mutex lock;
+	std::condition_variable woken;
+	bool awake = false;
+
+public:
+	bool open() override
+	{
+		return true;
+	}
+
+	void pump() override
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		woken.wait(guard, [this] { return awake; });
+		awake = false;
+	}
+
+	void wake() override
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			awake = true;
+		}
+
+		woken.notify_one();
+	}
+
+	void close() override
+	{
+	}
+};
+
+/*
+ * A thread of its own for reading input, so input is handled while the
+ * thread that owns the game window is busy. It runs at a high priority and
+ * spends its time in input_source::pump.
+ *
+ * Other threads hand it work by setting request bits, which are passed to
+ * the request handler together before the next pump. Requests never block
+ * or allocate, and requests made before the handler runs are merged.
+ */
+class input_thread {
+public:
+	using request_handler = void(*)(uint32_t requests);
+
+private:
+	enum class run_state {
+		stopped,
+		opening,
+		running,
+		failed
+	};
+
+	std::unique_ptr<input_source> source;
+	request_handler handler = nullptr;
+	std::thread thread;
+
+	std::atomic<run_state> state;
+	std::atomic<bool> stopping;
+	std::mutex state_lock;
+	std::condition_variable state_changed;
+
+	// Bits not handled yet, and when the first of them was requested
+	std::atomic<uint32_t> requests;
+	std::atomic<uint64_t> request_time;
+
+	// Microseconds from a request to its handler running
+	latency_histogram wake_latency;
+
+	void run();
+	void handle_requests();
+
+public:
+	input_thread() :
+		state(run_state::stopped),
+		stopping(false),
+		requests(0),
+		request_time(0)
+	{
+	}
+
+	input_thread(const input_thread&) = delete;
+	input_thread &operator=(const input_thread&) = delete;
+
+	~input_thread()
+	{
+		stop();
+	}
+
+	/**
+	 * start - Start reading input on a new thread
+	 * @new_source:	Events to read
+	 * @on_request:	Called on the input thread with request bits
+	 *
+	 * Waits for the source to open and returns whether it did. Nothing is
+	 * left running if it didn't.
+	 */
+	bool start(std::unique_ptr<input_source> new_source, request_handler on_request);
+
+	// Wait for the thread to finish, it closes its source first
+	void stop();
+
+	// Whether start succeeded and stop wasn't called since
+	bool running() const
+	{
+		return state.load(std::memory_order_acquire) == run_state::running;
+	}
+
+	// Have the handler called with bits, safe from any thread once
+	// running
+	void request(uint32_t bits);
+
+	const latency_histogram &request_latency() const
+	{
+		return wake_latency;
+	}
+};
\ No newline at end of file
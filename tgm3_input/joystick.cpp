@@ -1,338 +1,710 @@
 #define WIN32_LEAN_AND_MEAN
 #include "joystick.h"
-#include "config.h"
+#include <algorithm>
 #include <memory>
 #include <limits>
 #include <codecvt>
-#include <sstream>
+#include <string>
+#include <thread>
 #include <Windows.h>
 #include <subauth.h>
 #include <hidsdi.h>
 
+// Product names of devices seen on earlier runs
+static const char *const name_cache_path = "tgm3.devices";
+
 /**
  * init - Initialize an input device from a config
- * @cfg:	Config object
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
  *
- * Load button/axis codes and joystick settings from config
+ * Bind the settings of every configured joystick and leave opening devices
+ * to the enumeration thread, so the game doesn't wait for them. Devices
+ * come online as they're resolved.
  */
-void joystick::init(const config &cfg)
+void joystick::init(const config &cfg, std::vector<std::string> *diagnostics)
 {
-	buttons_1p = 0;
-	buttons_2p = 0;
+	clear_buttons();
 
-	old_dir_buttons_1p = 0;
-	old_dir_buttons_2p = 0;
+	{
+		std::lock_guard<std::mutex> lock(devices_lock);
+		load_configured(cfg, diagnostics);
+	}
 
-	// Get required buffer size
-	unsigned int num_devices;
-	GetRawInputDeviceList(nullptr, &num_devices, sizeof(RAWINPUTDEVICELIST));
+	enqueue(nullptr);
+	std::thread(&joystick::enumerate_thread, this).detach();
+}
 
-	auto device_list = std::make_unique<RAWINPUTDEVICELIST[]>(num_devices);
-	GetRawInputDeviceList(device_list.get(), &num_devices, sizeof(RAWINPUTDEVICELIST));
+/**
+ * load_configured - Bind every joystick namespace in a config
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * Namespaces are found from their keys, "joystick.<name>.<key>" with the
+ * name running up to the last dot. Typos are reported for every configured
+ * joystick, plugged in or not.
+ */
+void joystick::load_configured(
+	const config &cfg,
+	std::vector<std::string> *diagnostics
+) {
+	std::vector<std::string> prefixes;
+	cfg.for_each("joystick.", [&](
+		const char *name,
+		const size_t name_len,
+		const char *value)
+	{
+		auto dot = name_len;
+		while (dot > 0 && name[dot - 1] != '.')
+			dot--;
+
+		if (dot == 0)
+			return;
+
+		const auto prefix = "joystick." + std::string(name, dot);
+		if (std::find(prefixes.begin(), prefixes.end(), prefix) == prefixes.end())
+			prefixes.push_back(prefix);
+	});
+
+	configured.clear();
+	for (const auto &prefix : prefixes) {
+		settings cfg_dev;
+		settings::schema().bind(cfg, prefix, &cfg_dev, diagnostics);
+		configured.emplace_back(prefix, cfg_dev);
+	}
+}
 
-	for (auto i = 0u; i < num_devices; i++) {
-		if (device_list[i].dwType != RIM_TYPEHID)
+/**
+ * find_configured - Look up the settings a device would get
+ * @name:		Product string
+ * @prefix:		Receives the device's config namespace
+ * @duplicate_num:	Receives the number appended to it
+ *
+ * Append the lowest number not taken by another device with this name, so
+ * a replugged device gets its old number back.
+ */
+const joystick::settings *joystick::find_configured(
+	const std::string &name,
+	std::string *prefix,
+	int *duplicate_num
+) const {
+	auto num = 1;
+	for (auto taken = true; taken; ) {
+		taken = false;
+		devices.for_each([&](const device_info &check_device)
+		{
+			if (check_device.duplicate_num == num
+			 && check_device.name == name)
+				taken = true;
+		});
+
+		for (const auto &check_device : resolved) {
+			if (check_device.second->duplicate_num == num
+			 && check_device.second->name == name)
+				taken = true;
+		}
+
+		if (taken)
+			num++;
+	}
+
+	*prefix = "joystick." + name;
+	if (num > 1)
+		*prefix += " " + std::to_string(num);
+
+	*prefix += '.';
+	*duplicate_num = num;
+
+	for (const auto &entry : configured) {
+		if (entry.first != *prefix)
 			continue;
 
+		// Make sure this is actually going to be used for a player
+		const auto player = entry.second.player;
+		return player == 1 || player == 2 ? &entry.second : nullptr;
+	}
+
+	return nullptr;
+}
+
+bool joystick::is_known(const HANDLE ri_handle) const
+{
+	if (devices.find(ri_handle) != nullptr)
+		return true;
+
+	for (const auto &check_device : resolved) {
+		if (check_device.first == ri_handle)
+			return true;
+	}
+
+	return false;
+}
+
+void joystick::enqueue(const HANDLE ri_handle)
+{
+	std::lock_guard<std::mutex> lock(queue_lock);
+	queue.push_back(ri_handle);
+	queue_ready.notify_one();
+}
+
+/**
+ * enumerate_thread - Open devices handed over by the other threads
+ *
+ * The name cache is written back whenever the queue runs dry.
+ */
+void joystick::enumerate_thread()
+{
+	names.load(name_cache_path);
+
+	while (true) {
+		HANDLE ri_handle;
+		{
+			std::unique_lock<std::mutex> lock(queue_lock);
+			if (queue.empty()) {
+				lock.unlock();
+				names.save();
+				lock.lock();
+			}
+
+			queue_ready.wait(lock, [&] { return !queue.empty(); });
+			ri_handle = queue.front();
+			queue.pop_front();
+		}
+
+		if (ri_handle != nullptr) {
+			resolve(ri_handle);
+			continue;
+		}
+
 		// Get required buffer size
-		auto device_name_len = 0u;
-		GetRawInputDeviceInfo(
-			device_list[i].hDevice,
-			RIDI_DEVICENAME,
-			nullptr,
-			&device_name_len);
-
-		auto device_name = std::make_unique<char[]>(device_name_len);
-		GetRawInputDeviceInfo(
-			device_list[i].hDevice,
-			RIDI_DEVICENAME,
-			device_name.get(),
-			&device_name_len);
-
-		const auto nt_handle = CreateFile(
-			device_name.get(),
-			0,
-			FILE_SHARE_READ | FILE_SHARE_WRITE,
-			nullptr,
-			OPEN_EXISTING,
-			0,
-			nullptr);
-
-		get_device_info(cfg, nt_handle, device_list[i].hDevice);
+		unsigned int num_devices;
+		GetRawInputDeviceList(nullptr, &num_devices, sizeof(RAWINPUTDEVICELIST));
+
+		auto device_list = std::make_unique<RAWINPUTDEVICELIST[]>(num_devices);
+		GetRawInputDeviceList(device_list.get(), &num_devices, sizeof(RAWINPUTDEVICELIST));
+
+		for (auto i = 0u; i < num_devices; i++) {
+			if (device_list[i].dwType == RIM_TYPEHID)
+				resolve(device_list[i].hDevice);
+		}
 	}
 }
 
 /**
- * get_device_info - Grab the info for control devices
- * @cfg:	Config object
- * @nt_handle:	Handle to HID device
- * @ri_handle:	Handle to rawinput device
+ * device_added - Open a device that was plugged in
+ * @cfg:		Current config, unused as settings were bound already
+ * @ri_handle:		Handle to rawinput device
+ * @diagnostics:	Config errors
  *
- * Check for config info on a device based on the HID product string. Append
- * a number in the case of duplicates.
+ * Windows also sends these for every device when raw input is registered,
+ * known devices are skipped by the enumeration thread.
  */
-void joystick::get_device_info(
+void joystick::device_added(
 	const config &cfg,
-	const HANDLE nt_handle,
-	const HANDLE ri_handle
+	void *ri_handle,
+	std::vector<std::string> *diagnostics
 ) {
-	auto new_device = std::make_unique<device_info>();
+	enqueue(ri_handle);
+}
 
-	wchar_t name[128];
-	if (!HidD_GetProductString(nt_handle, name, sizeof(name)))
+/**
+ * device_removed - Close a device that was unplugged
+ * @ri_handle:	Handle to rawinput device
+ *
+ * Release its player's buttons so nothing stays held.
+ */
+void joystick::device_removed(void *ri_handle)
+{
+	std::lock_guard<std::mutex> lock(devices_lock);
+
+	resolved.erase(std::remove_if(resolved.begin(), resolved.end(),
+		[&](const std::pair<HANDLE, std::unique_ptr<device_info>> &entry)
+	{
+		return entry.first == ri_handle;
+	}), resolved.end());
+
+	const auto device = devices.remove(ri_handle);
+	if (device == nullptr)
 		return;
 
-	// Append a number if this is a duplicate
-	auto duplicate_num = 0;
-	for (const auto &check_device : devices) {
-		if (wcscmp(name, check_device->name) == 0)
-			duplicate_num++;
+	if (device->map.get()->player == 1) {
+		buttons_1p = 0;
+		directions_1p.clear();
+	} else {
+		buttons_2p = 0;
+		directions_2p.clear();
 	}
+}
 
-	std::stringstream prefix;
-	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-	prefix << "joystick." << converter.to_bytes(name);
-	if (duplicate_num > 0)
-		prefix << " " << (duplicate_num + 1);
+/**
+ * adopt_resolved - Start using devices the enumeration thread opened
+ */
+void joystick::adopt_resolved()
+{
+	std::lock_guard<std::mutex> lock(devices_lock);
 
-	new_device->player = cfg.value_int(0, prefix.str() + ".player");
+	for (auto &entry : resolved)
+		devices.insert(entry.first, std::move(entry.second));
 
-	// Make sure this is actually going to be used for a player
-	if (new_device->player != 1 && new_device->player != 2)
-		return;
+	resolved.clear();
+	has_resolved.store(false, std::memory_order_relaxed);
+}
 
-	_HIDP_PREPARSED_DATA *dev_info;
-	if (!HidD_GetPreparsedData(nt_handle, &dev_info))
-		return;
+/**
+ * find_set_bits - Locate the bits a HidP_Set* call wrote
+ * @report:	Report that was zeroed apart from the report ID
+ * @size:	Size of report
+ * @field:	Receives bit_offset and bit_size, bit_size stays 0 if
+ *		nothing was written
+ *
+ * The report ID byte is skipped.
+ */
+static void find_set_bits(
+	const uint8_t *report,
+	const size_t size,
+	hid_layout::field *field
+) {
+	field->bit_size = 0;
 
-	// Get device capabilities
-	HIDP_CAPS caps;
-	if (!NT_SUCCESS(HidP_GetCaps(dev_info, &caps))) {
-		HidD_FreePreparsedData(dev_info);
-		return;
+	for (auto bit = 8u; bit < size * 8; bit++) {
+		if (((report[bit / 8] >> (bit % 8)) & 1) == 0)
+			continue;
+
+		if (field->bit_size == 0)
+			field->bit_offset = bit;
+
+		field->bit_size = bit - field->bit_offset + 1;
 	}
+}
 
-	// Get button capabilities
+/**
+ * locate_fields - Find where buttons and values sit in input reports
+ * @dev_info:	Preparsed data
+ * @caps:	Device capabilities
+ * @layout:	Output layout
+ *
+ * Raw input doesn't expose report descriptors, so ask the HID parser to
+ * write each control into an empty report and see which bits it touched.
+ * Buttons from every button cap are numbered from the lowest usage, values
+ * keep the order of the value caps.
+ */
+static bool locate_fields(
+	_HIDP_PREPARSED_DATA *dev_info,
+	const HIDP_CAPS &caps,
+	hid_layout *layout
+) {
 	auto num_button_caps = caps.NumberInputButtonCaps;
-	auto button_caps = std::make_unique<HIDP_BUTTON_CAPS[]>(
-		num_button_caps);
-
-	if (!NT_SUCCESS(HidP_GetButtonCaps(
+	auto button_caps = std::make_unique<HIDP_BUTTON_CAPS[]>(num_button_caps);
+	if (num_button_caps != 0 && !NT_SUCCESS(HidP_GetButtonCaps(
 		HidP_Input,
 		button_caps.get(),
 		&num_button_caps,
 		dev_info))
-	) {
-		HidD_FreePreparsedData(dev_info);
-		return;
-	}
-
-	// Get value capabilities
-	new_device->num_value_caps = caps.NumberInputValueCaps;
-	new_device->value_caps = std::make_unique<HIDP_VALUE_CAPS[]>(
-		new_device->num_value_caps);
+	)
+		return false;
 
-	if (!NT_SUCCESS(HidP_GetValueCaps(
+	auto num_value_caps = caps.NumberInputValueCaps;
+	auto value_caps = std::make_unique<HIDP_VALUE_CAPS[]>(num_value_caps);
+	if (num_value_caps != 0 && !NT_SUCCESS(HidP_GetValueCaps(
 		HidP_Input,
-		new_device->value_caps.get(),
-		&new_device->num_value_caps,
+		value_caps.get(),
+		&num_value_caps,
 		dev_info))
-	) {
-		HidD_FreePreparsedData(dev_info);
-		return;
+	)
+		return false;
+
+	const auto report_size = caps.InputReportByteLength;
+	auto report = std::make_unique<uint8_t[]>(report_size);
+	layout->report_size = report_size;
+
+	// Button numbers start at the lowest button usage
+	auto lowest_button = (USAGE)(0xFFFF);
+	auto highest_button = (USAGE)(0);
+	for (auto i = 0u; i < num_button_caps; i++) {
+		const auto &cap = button_caps[i];
+		if (cap.UsagePage != HID_USAGE_PAGE_BUTTON)
+			continue;
+
+		const auto min = cap.IsRange ? cap.Range.UsageMin : cap.NotRange.Usage;
+		const auto max = cap.IsRange ? cap.Range.UsageMax : cap.NotRange.Usage;
+		lowest_button = min < lowest_button ? min : lowest_button;
+		highest_button = max > highest_button ? max : highest_button;
 	}
 
-	new_device->nt_handle = nt_handle;
-	new_device->ri_handle = ri_handle;;
-	wcscpy_s(new_device->name, name);
-	new_device->num_buttons = (ULONG)(
-		button_caps[0].Range.UsageMax -
-		button_caps[0].Range.UsageMin + 1);
-	new_device->button_usage_page = button_caps[0].UsagePage;
-	new_device->lowest_button_id = button_caps[0].Range.UsageMin;
+	if (highest_button >= lowest_button)
+		layout->buttons.resize(highest_button - lowest_button + 1, {});
 
-	new_device->deadzone  = cfg.value_float(.5F, prefix.str() + ".deadzone");
+	for (auto i = 0u; i < num_button_caps; i++) {
+		const auto &cap = button_caps[i];
+		if (cap.UsagePage != HID_USAGE_PAGE_BUTTON)
+			continue;
 
-	// Axes
-	const auto up_down    = cfg.value_int(-1, prefix.str() + ".up_down");
-	const auto left_right = cfg.value_int(-1, prefix.str() + ".left_right");
+		const auto min = cap.IsRange ? cap.Range.UsageMin : cap.NotRange.Usage;
+		const auto max = cap.IsRange ? cap.Range.UsageMax : cap.NotRange.Usage;
+		for (auto usage = (ULONG)(min); usage <= max; usage++) {
+			memset(report.get(), 0, report_size);
+			report[0] = cap.ReportID;
+
+			auto num_usages = 1ul;
+			auto usage_id = (USAGE)(usage);
+			if (!NT_SUCCESS(HidP_SetUsages(
+				HidP_Input,
+				cap.UsagePage,
+				cap.LinkCollection,
+				&usage_id,
+				&num_usages,
+				dev_info,
+				(char*)(report.get()),
+				report_size))
+			)
+				continue;
 
-	new_device->axis_map = std::make_unique<axis[]>(new_device->num_value_caps);
-	for (auto i = 0; i < new_device->num_value_caps; i++)
-		new_device->axis_map[i] = axis::none;
+			auto &field = layout->buttons[usage - lowest_button];
+			field.report_id = cap.ReportID;
+			field.usage_page = cap.UsagePage;
+			field.usage = usage_id;
+			field.logical_min = 0;
+			field.logical_max = 1;
+			find_set_bits(report.get(), report_size, &field);
+		}
+	}
 
-	const auto write_axis_checked = [&](const int idx, const axis axis)
-	{
-		if (idx >= 0 && idx < new_device->num_value_caps)
-			new_device->axis_map[idx] = axis;
-	};
+	layout->values.resize(num_value_caps, {});
+	for (auto i = 0u; i < num_value_caps; i++) {
+		const auto &cap = value_caps[i];
+		const auto usage = cap.IsRange ? cap.Range.UsageMin : cap.NotRange.Usage;
 
-	write_axis_checked(up_down, axis::up_down);
-	write_axis_checked(left_right, axis::left_right);
+		auto &field = layout->values[i];
+		field.report_id = cap.ReportID;
+		field.usage_page = cap.UsagePage;
+		field.usage = usage;
+		field.logical_min = cap.LogicalMin;
+		field.logical_max = cap.LogicalMax;
 
-	// Buttons
-	const auto up         = cfg.value_int(-1, prefix.str() + ".up");
-	const auto down       = cfg.value_int(-1, prefix.str() + ".down");
-	const auto left       = cfg.value_int(-1, prefix.str() + ".left");
-	const auto right      = cfg.value_int(-1, prefix.str() + ".right");
+		if (cap.BitSize == 0 || cap.BitSize > 32)
+			continue;
 
-	const auto A          = cfg.value_int(1, prefix.str() + ".A");
-	const auto B          = cfg.value_int(2, prefix.str() + ".B");
-	const auto C          = cfg.value_int(3, prefix.str() + ".C");
-	const auto D          = cfg.value_int(0, prefix.str() + ".D");
+		memset(report.get(), 0, report_size);
+		report[0] = cap.ReportID;
 
-	const auto start      = cfg.value_int(7, prefix.str() + ".start");
+		const auto all_ones = (ULONG)(((uint64_t)(1) << cap.BitSize) - 1);
+		if (!NT_SUCCESS(HidP_SetUsageValue(
+			HidP_Input,
+			cap.UsagePage,
+			cap.LinkCollection,
+			usage,
+			all_ones,
+			dev_info,
+			(char*)(report.get()),
+			report_size))
+		)
+			continue;
 
-	new_device->button_mask_map = std::make_unique<unsigned short[]>(
-		new_device->num_buttons);
+		find_set_bits(report.get(), report_size, &field);
+	}
 
-	for (auto i = 0; i < new_device->num_buttons; i++)
-		new_device->button_mask_map[i] = 0;
+	return true;
+}
+
+/**
+ * resolve - Open a raw input device if it's configured
+ * @ri_handle:	Handle to rawinput device
+ *
+ * Check for config info on a device based on the HID product string, which
+ * comes from the name cache if the device was seen before so devices that
+ * aren't configured aren't opened at all.
+ */
+void joystick::resolve(const HANDLE ri_handle)
+{
+	std::string prefix;
+	int duplicate_num;
 
-	const auto write_button_checked = [&](const int idx, const int mask)
 	{
-		if (idx >= 0 && idx < new_device->num_buttons)
-			new_device->button_mask_map[idx] = mask;
-	};
+		std::lock_guard<std::mutex> lock(devices_lock);
+		if (is_known(ri_handle))
+			return;
+	}
 
-	write_button_checked(up, mask_up);
-	write_button_checked(down, mask_down);
-	write_button_checked(left, mask_left);
-	write_button_checked(right, mask_right);
+	RID_DEVICE_INFO info;
+	info.cbSize = sizeof(info);
+	auto info_size = (UINT)(sizeof(info));
+	if (GetRawInputDeviceInfo(
+		ri_handle,
+		RIDI_DEVICEINFO,
+		&info,
+		&info_size) == (UINT)(-1)
+	 || info.dwType != RIM_TYPEHID)
+		return;
 
-	write_button_checked(A, mask_A);
-	write_button_checked(B, mask_B);
-	write_button_checked(C, mask_C);
-	write_button_checked(D, mask_D);
+	// Get required buffer size
+	auto device_name_len = 0u;
+	GetRawInputDeviceInfo(
+		ri_handle,
+		RIDI_DEVICENAME,
+		nullptr,
+		&device_name_len);
+
+	auto device_name = std::make_unique<char[]>(device_name_len);
+	if (GetRawInputDeviceInfo(
+		ri_handle,
+		RIDI_DEVICENAME,
+		device_name.get(),
+		&device_name_len) == (UINT)(-1))
+		return;
+
+	const std::string path(device_name.get());
 
-	write_button_checked(start, mask_start);
+	const auto *cached_name = names.find(path);
+	if (cached_name != nullptr) {
+		std::lock_guard<std::mutex> lock(devices_lock);
+		if (find_configured(*cached_name, &prefix, &duplicate_num) == nullptr)
+			return;
+	}
 
-	devices.push_back(std::move(new_device));
+	const auto nt_handle = CreateFile(
+		device_name.get(),
+		0,
+		FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr,
+		OPEN_EXISTING,
+		0,
+		nullptr);
+
+	if (nt_handle == INVALID_HANDLE_VALUE)
+		return;
+
+	// Closes nt_handle if the device doesn't get registered
+	auto new_device = std::make_unique<device_info>();
+	new_device->nt_handle = nt_handle;
+
+	wchar_t name[128];
+	if (!HidD_GetProductString(nt_handle, name, sizeof(name)))
+		return;
+
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+	new_device->name = converter.to_bytes(name);
+	names.set(path, new_device->name);
+
+	_HIDP_PREPARSED_DATA *dev_info;
+	if (!HidD_GetPreparsedData(nt_handle, &dev_info))
+		return;
+
+	// Get device capabilities
+	HIDP_CAPS caps;
+	const auto located = NT_SUCCESS(HidP_GetCaps(dev_info, &caps))
+		&& locate_fields(dev_info, caps, &new_device->layout);
 
 	HidD_FreePreparsedData(dev_info);
+
+	if (!located)
+		return;
+
+	std::lock_guard<std::mutex> lock(devices_lock);
+
+	// The window thread may have queued it again meanwhile
+	if (is_known(ri_handle))
+		return;
+
+	const auto *cfg_dev = find_configured(
+		new_device->name,
+		&prefix,
+		&duplicate_num);
+
+	if (cfg_dev == nullptr)
+		return;
+
+	new_device->ri_handle = ri_handle;
+	new_device->prefix = prefix;
+	new_device->duplicate_num = duplicate_num;
+	new_device->decoded = 0;
+	new_device->map.publish(build_mapping(*new_device, *cfg_dev));
+
+	resolved.emplace_back(ri_handle, std::move(new_device));
+	has_resolved.store(true, std::memory_order_release);
+}
+
+/**
+ * build_mapping - Turn device settings into lookup tables
+ * @device:	Device the settings are for
+ * @cfg_dev:	Settings bound from the device's config namespace
+ *
+ * Indices outside of the device's buttons and value caps are ignored
+ */
+std::unique_ptr<const joystick::mapping> joystick::build_mapping(
+	const device_info &device,
+	const settings &cfg_dev
+) {
+	std::unique_ptr<mapping> map(new mapping());
+
+	map->player = cfg_dev.player;
+	map->socd = (socd_mode)(cfg_dev.socd);
+
+	cfg_dev.compile(device.layout, &map->program);
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	map->debounce_ticks = (int64_t)(
+		std::max(cfg_dev.debounce, 0.F) / 1000. * frequency.QuadPart);
+
+	return std::move(map);
+}
+
+/**
+ * reload - Apply a modified config to the opened devices
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * Rebind each device's settings and swap in new lookup tables. Devices that
+ * weren't assigned to a player when they were plugged in stay closed until
+ * they're replugged.
+ */
+void joystick::reload(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	std::lock_guard<std::mutex> lock(devices_lock);
+
+	load_configured(cfg, diagnostics);
+
+	// Typos were reported by load_configured
+	const auto rebind = [&](device_info &device)
+	{
+		settings cfg_dev;
+		settings::schema().bind(cfg, device.prefix, &cfg_dev, nullptr);
+		device.map.publish(build_mapping(device, cfg_dev));
+	};
+
+	devices.for_each(rebind);
+	for (auto &entry : resolved)
+		rebind(*entry.second);
 }
 
 /**
  * update - Update the bits in buttons
  * @input:	Raw input data pointer
  *
- * Check device button status and update buttons accordingly, if it's an axis
- * change compare it against deadzone
+ * Decode the device's latest report with its compiled program, then
+ * debounce it
  */
 void joystick::update(const tagRAWINPUT *input)
 {
 	if (input->header.dwType != RIM_TYPEHID)
 		return;
 
+	// Devices the enumeration thread finished since the last report
+	if (has_resolved.load(std::memory_order_acquire))
+		adopt_resolved();
+
 	// See if this a device that's registered
-	const device_info *device = nullptr;
-	for (const auto &check_device : devices) {
-		if (check_device->ri_handle != input->header.hDevice)
-			continue;
+	auto *device = devices.find(input->header.hDevice);
+	if (device == nullptr)
+		return;
 
-		device = check_device.get();
-		break;
-	}
+	// Player may have been unset by a reload
+	const auto *map = device->map.get();
+	if (map->player != 1 && map->player != 2)
+		return;
 
-	if (device == nullptr)
+	// Reports are queued oldest first, the last one is the current state
+	const auto &hid = input->data.hid;
+	if (hid.dwCount == 0)
 		return;
 
-	auto *buttons = device->player == 1 ? &buttons_1p : &buttons_2p;
+	const auto *report =
+		(const uint8_t*)(hid.bRawData) + (hid.dwCount - 1) * hid.dwSizeHid;
+	device->decoded = map->program.decode(report, hid.dwSizeHid, device->decoded);
 
-	// Completely reset buttons
-	*buttons = 0;
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	const auto debounced = device->debounce.update(
+		device->decoded,
+		now.QuadPart,
+		map->debounce_ticks);
 
-	_HIDP_PREPARSED_DATA *dev_info;
-	if (!HidD_GetPreparsedData(device->nt_handle, &dev_info))
-		return;
+	set_player_buttons(device, debounced);
+	schedule_recheck(device->debounce.recheck_time(map->debounce_ticks));
+}
 
-	auto num_buttons = device->num_buttons;
-	auto usages = std::make_unique<USAGE[]>(num_buttons);
-	if (!NT_SUCCESS(HidP_GetUsages(
-		HidP_Input,
-		device->button_usage_page,
-		0,
-		usages.get(),
-		&num_buttons,
-		dev_info,
-		(char*)(input->data.hid.bRawData),
-		input->data.hid.dwSizeHid))
-	) {
-		HidD_FreePreparsedData(dev_info);
-		return;
-	}
+void joystick::set_player_buttons(device_info *device, const unsigned short debounced)
+{
+	const auto *map = device->map.get();
+	auto *buttons = map->player == 1 ? &buttons_1p : &buttons_2p;
+	auto *directions = map->player == 1 ? &directions_1p : &directions_2p;
 
-	for (auto i = 0u; i < num_buttons; i++) {
-		const auto id = usages[i] - device->lowest_button_id;
-		*buttons |= device->button_mask_map[id];
-	}
+	*buttons = (debounced & ~dir_all)
+		| directions->update(debounced & dir_all, map->socd);
+}
 
-	// Get axis positions
-	for (auto i = 0; i < device->num_value_caps; i++) {
-		const auto &val_cap = device->value_caps[i];
+// Only one joystick exists, and its timers run on the window thread
+static joystick *recheck_owner;
 
-		ULONG value;
-		if (!HidP_GetUsageValue(
-			HidP_Input,
-			val_cap.UsagePage,
-			0,
-			val_cap.Range.UsageMin,
-			&value,
-			dev_info,
-			(char*)(input->data.hid.bRawData),
-			input->data.hid.dwSizeHid)
-		)
-			continue;
+/**
+ * schedule_recheck - Have recheck_debounce run later
+ * @time:	QueryPerformanceCounter time, INT64_MAX for never
+ *
+ * A timer that's already set for an earlier time is left alone. Thread
+ * timers are dispatched by whichever message loop the window thread runs,
+ * the game's or the input thread's.
+ */
+void joystick::schedule_recheck(const int64_t time)
+{
+	if (time == INT64_MAX || (recheck_timer != 0 && recheck_at <= time))
+		return;
 
-		if (val_cap.Range.UsageMin == 0x39) { // Hat switch
-			value -= val_cap.LogicalMin;
-
-			*buttons |=
-				value == 0 ? mask_up :
-				value == 2 ? mask_right :
-				value == 4 ? mask_down :
-				value == 6 ? mask_left :
-				             0;
-		} else {
-			// Cast to signed and rescale to [-1.0, 1.0]
-			auto position = (float)((signed)(value));
-			position -= val_cap.LogicalMin;
-			position /= (val_cap.LogicalMax - val_cap.LogicalMin);
-			position = (position - .5F) * 2.F;
-
-			if (fabs(position) < device->deadzone)
-				continue;
+	LARGE_INTEGER now;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
 
-			const auto axis = device->axis_map[i];
-			if (axis == axis::up_down)
-				*buttons |= position > 0 ? mask_down : mask_up;
-			else if (axis == axis::left_right)
-				*buttons |= position > 0 ? mask_right : mask_left;
-		}
-	}
+	// Round up, a timer that fires early finds nothing to do
+	const auto ticks = time - now.QuadPart;
+	const auto ms = ticks > 0 ? (UINT)(ticks * 1000 / frequency.QuadPart + 1) : 1u;
 
-	auto *old_dir_buttons = device->player == 1 ? &old_dir_buttons_1p : &old_dir_buttons_2p;
-	auto *direction_keys =  device->player == 1 ? &direction_keys_1p  : &direction_keys_2p;
+	recheck_owner = this;
+	recheck_timer = SetTimer(nullptr, recheck_timer, ms, recheck_timer_proc);
+	recheck_at = recheck_timer != 0 ? time : INT64_MAX;
+}
 
-	const auto dir_buttons = *buttons & (mask_up | mask_down | mask_left | mask_right);
-	*buttons &= ~dir_buttons;
+void CALLBACK joystick::recheck_timer_proc(
+	const HWND wnd,
+	const UINT msg,
+	const UINT_PTR id,
+	const DWORD time
+) {
+	KillTimer(nullptr, id);
+	recheck_owner->recheck_timer = 0;
+	recheck_owner->recheck_at = INT64_MAX;
+	recheck_owner->recheck_debounce();
+}
 
-	const auto changed = dir_buttons ^ *old_dir_buttons;
-	const auto pressed = changed & dir_buttons;
-	const auto released = changed & *old_dir_buttons;
+/**
+ * recheck_debounce - Filter the last report of devices again
+ *
+ * A switch that settled the other way inside its hold-off window would
+ * otherwise stay wrong until the device happens to report again.
+ */
+void joystick::recheck_debounce()
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
 
-	for (auto i = 0; i < std::numeric_limits<decltype(dir_buttons)>::digits; i++) {
-		const auto mask = 1 << i;
-		if (pressed & mask)
-			direction_keys->push_front(mask);
-		else if (released & mask)
-			direction_keys->remove(mask);
-	}
+	auto changed = false;
+	auto next = INT64_MAX;
+	devices.for_each([&](device_info &device)
+	{
+		const auto *map = device.map.get();
+		if (map->player != 1 && map->player != 2)
+			return;
+
+		const auto holdoff = map->debounce_ticks;
+		if (device.debounce.recheck_time(holdoff) <= now.QuadPart) {
+			set_player_buttons(&device, device.debounce.expire(now.QuadPart, holdoff));
+			changed = true;
+		}
 
-	if (direction_keys->size() != 0)
-		*buttons |= direction_keys->front();
+		next = std::min(next, device.debounce.recheck_time(holdoff));
+	});
 
-	*old_dir_buttons = dir_buttons;
+	schedule_recheck(next);
 
-	HidD_FreePreparsedData(dev_info);
+	if (changed)
+		notify_buttons_changed();
 }
\ No newline at end of file
@@ -1,50 +1,75 @@
 #pragma once
 
 #include "base_input.h"
+#include "snapshot.h"
+#include "socd.h"
+#include "hid_program.h"
+#include "joystick_settings.h"
+#include "device_registry.h"
+#include "debounce.h"
+#include "name_cache.h"
 #include <Windows.h>
 #include <hidsdi.h>
-#include <list>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <utility>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class joystick : public base_input {
+public:
+	using settings = joystick_settings;
+
+private:
 	float deadzone; // Deadzone for axis to register
 
 	// TGM3 buttons
 	unsigned short buttons_1p;
 	unsigned short buttons_2p;
 
-	// Directional buttons from the previous update
-	unsigned short old_dir_buttons_1p;
-	unsigned short old_dir_buttons_2p;
+	// Order the held directions were pressed in
+	direction_priority directions_1p;
+	direction_priority directions_2p;
+
+	// Config dependent part of device_info, swapped out on config reload
+	struct mapping {
+		int player;
+
+		// Report decoder for the device's buttons and axes
+		hid_program program;
 
-	// List containing which direction keys are pressed
-	std::list<unsigned short> direction_keys_1p;
-	std::list<unsigned short> direction_keys_2p;
+		// Debounce hold-off in QueryPerformanceCounter ticks
+		int64_t debounce_ticks;
 
-	enum class axis {
-		none,
-		up_down,
-		left_right
+		socd_mode socd;
 	};
 
 	// Stored info for devices that are in use
 	struct device_info {
 		HANDLE nt_handle;
 		HANDLE ri_handle;
-		wchar_t name[128];
 
-		int player;
+		// HID product string in UTF-8
+		std::string name;
+
+		// Config namespace, "joystick.<name>." or "joystick.<name> <n>."
+		std::string prefix;
+
+		// n above, 1 for the first device with a name
+		int duplicate_num;
+
+		// Located once when the device is opened
+		hid_layout layout;
+
+		// Last decoded report, before direction priority
+		unsigned short decoded;
+
+		eager_debounce debounce;
 
-		ULONG num_buttons;
-		USAGE button_usage_page;
-		USAGE lowest_button_id;
-		std::unique_ptr<unsigned short[]> button_mask_map;
-		
-		USHORT num_value_caps;
-		std::unique_ptr<struct _HIDP_VALUE_CAPS[]> value_caps;
-		float deadzone;
-		std::unique_ptr<axis[]> axis_map;
+		snapshot<mapping> map;
 
 		~device_info()
 		{
@@ -52,34 +77,120 @@ class joystick : public base_input {
 		}
 	};
 
-	std::vector<std::unique_ptr<device_info>> devices;
-
-	// Grab the info for a HID device
-	void get_device_info(
+	// Devices assigned to a player, keyed by raw input handle. Only
+	// changed on the window thread, which holds devices_lock while it
+	// does so the reload thread can iterate under the lock.
+	device_registry<device_info> devices;
+	std::mutex devices_lock;
+
+	// Opened by the enumeration thread and waiting for the window thread
+	// to move them into devices, under devices_lock
+	std::vector<std::pair<HANDLE, std::unique_ptr<device_info>>> resolved;
+	std::atomic<bool> has_resolved;
+
+	// Settings for every joystick.<name>. namespace in the config, bound
+	// up front so the enumeration thread never needs the config itself.
+	// Under devices_lock.
+	std::vector<std::pair<std::string, settings>> configured;
+
+	// Raw input handles for the enumeration thread, null for every
+	// device in the system
+	std::deque<HANDLE> queue;
+	std::mutex queue_lock;
+	std::condition_variable queue_ready;
+
+	// Enumeration thread only
+	name_cache names;
+
+	// Thread timer that runs recheck_debounce, 0 if none is set, and the
+	// QueryPerformanceCounter time it's for. Window thread only.
+	UINT_PTR recheck_timer = 0;
+	int64_t recheck_at = INT64_MAX;
+
+	// Bind every joystick namespace, devices_lock must be held
+	void load_configured(
 		const config &cfg,
-		const HANDLE nt_handle,
-		const HANDLE ri_handle);
+		std::vector<std::string> *diagnostics);
+
+	// Config namespace and settings a device with this name would get,
+	// null if it isn't assigned a player. devices_lock must be held.
+	const settings *find_configured(
+		const std::string &name,
+		std::string *prefix,
+		int *duplicate_num) const;
+
+	// Whether a raw input handle is in devices or resolved, devices_lock
+	// must be held
+	bool is_known(const HANDLE ri_handle) const;
+
+	// Hand a raw input handle to the enumeration thread
+	void enqueue(const HANDLE ri_handle);
+
+	// Enumeration thread
+	void enumerate_thread();
+	void resolve(const HANDLE ri_handle);
+
+	// Window thread, move resolved devices into devices
+	void adopt_resolved();
+
+	// Window thread, apply SOCD to debounced buttons and store them as the
+	// device's player's
+	void set_player_buttons(device_info *device, unsigned short debounced);
+
+	// Window thread, filter reports that had edges held off again once
+	// their hold-off ends
+	void schedule_recheck(int64_t time);
+	void recheck_debounce();
+	static void CALLBACK recheck_timer_proc(
+		HWND wnd,
+		UINT msg,
+		UINT_PTR id,
+		DWORD time);
+
+	// Build button and axis tables for a device
+	static std::unique_ptr<const mapping> build_mapping(
+		const device_info &device,
+		const settings &cfg_dev);
 
 public:
+	joystick() : has_resolved(false)
+	{
+	}
+
 	// Raw input usage
 	std::vector<int> get_usage() override
 	{
 		return { { 4, 5 } };
 	}
 
-	// Load button and axis codes from config
-	void init(const config &cfg) override;
+	// Bind settings and start opening devices in the background
+	void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	// Publish new button and axis tables for each device
+	void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
 
 	// Update buttons
 	void update(const tagRAWINPUT *input) override;
 
-	// Clear direction keys list too
+	// Hot plugging
+	void device_added(
+		const config &cfg,
+		void *ri_handle,
+		std::vector<std::string> *diagnostics) override;
+
+	void device_removed(void *ri_handle) override;
+
+	// Clear direction order too
 	void clear_buttons() override
 	{
 		buttons_1p = 0;
 		buttons_2p = 0;
-		direction_keys_1p.clear();
-		direction_keys_2p.clear();
+		directions_1p.clear();
+		directions_2p.clear();
 	}
 
 	// buttons accessors
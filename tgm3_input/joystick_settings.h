@@ -0,0 +1,129 @@
+#pragma once
+
+#include "../config_schema.h"
+#include "base_input.h"
+#include "hid_program.h"
+#include "socd.h"
+#include <vector>
+
+// Per device config under joystick.<name>., shared by every joystick
+// backend. -1 for unused axes and buttons.
+struct joystick_settings {
+	int player;
+	float deadzone;
+
+	// hid_gate, with its diagonal width and hysteresis
+	int gate;
+	float diagonal;
+	float hysteresis;
+
+	// Eager debounce hold-off in milliseconds, 0 for none
+	float debounce;
+
+	int up_down;
+	int left_right;
+
+	int up;
+	int down;
+	int left;
+	int right;
+
+	int A;
+	int B;
+	int C;
+	int D;
+
+	int start;
+
+	// socd_mode
+	int socd;
+
+	// Bound relative to "joystick.<product string>."
+	static const config_schema<joystick_settings> &schema()
+	{
+		static const config_schema<joystick_settings> schema("joystick.", {
+			{ "player",     &joystick_settings::player,     0    },
+			{ "deadzone",   &joystick_settings::deadzone,   .5F  },
+
+			{ "gate",       &joystick_settings::gate,
+				(int)(hid_gate::axis), hid_gate_names },
+			{ "diagonal",   &joystick_settings::diagonal,   45.F },
+			{ "hysteresis", &joystick_settings::hysteresis, 0.F  },
+
+			{ "debounce",   &joystick_settings::debounce,   0.F  },
+
+			{ "up_down",    &joystick_settings::up_down,    -1   },
+			{ "left_right", &joystick_settings::left_right, -1   },
+
+			{ "up",         &joystick_settings::up,         -1   },
+			{ "down",       &joystick_settings::down,       -1   },
+			{ "left",       &joystick_settings::left,       -1   },
+			{ "right",      &joystick_settings::right,      -1   },
+
+			{ "A",          &joystick_settings::A,          1    },
+			{ "B",          &joystick_settings::B,          2    },
+			{ "C",          &joystick_settings::C,          3    },
+			{ "D",          &joystick_settings::D,          0    },
+
+			{ "start",      &joystick_settings::start,      7    },
+
+			{ "socd",       &joystick_settings::socd,
+				(int)(socd_mode::last_wins), socd_mode_names },
+		});
+
+		return schema;
+	}
+
+	/**
+	 * compile - Build a report decoder for a device
+	 * @layout:	Where the device's controls are
+	 * @program:	Output
+	 *
+	 * Indices outside of the layout's buttons and values are ignored
+	 */
+	void compile(const hid_layout &layout, hid_program *program) const
+	{
+		// Axes
+		const auto num_values = layout.values.size();
+		std::vector<hid_axis> axes(num_values, hid_axis::none);
+
+		const auto write_axis_checked = [&](const int idx, const hid_axis axis)
+		{
+			if (idx >= 0 && idx < (int)(num_values))
+				axes[idx] = axis;
+		};
+
+		write_axis_checked(up_down, hid_axis::up_down);
+		write_axis_checked(left_right, hid_axis::left_right);
+
+		// Buttons
+		const auto num_buttons = layout.buttons.size();
+		std::vector<unsigned short> button_masks(num_buttons, 0);
+
+		const auto write_button_checked = [&](const int idx, const int mask)
+		{
+			if (idx >= 0 && idx < (int)(num_buttons))
+				button_masks[idx] = mask;
+		};
+
+		write_button_checked(up,    base_input::mask_up);
+		write_button_checked(down,  base_input::mask_down);
+		write_button_checked(left,  base_input::mask_left);
+		write_button_checked(right, base_input::mask_right);
+
+		write_button_checked(A,     base_input::mask_A);
+		write_button_checked(B,     base_input::mask_B);
+		write_button_checked(C,     base_input::mask_C);
+		write_button_checked(D,     base_input::mask_D);
+
+		write_button_checked(start, base_input::mask_start);
+
+		hid_gate_settings gate_settings;
+		gate_settings.mode = (hid_gate)(gate);
+		gate_settings.deadzone = deadzone;
+		gate_settings.diagonal = diagonal;
+		gate_settings.hysteresis = hysteresis;
+
+		program->compile(layout, button_masks, axes, gate_settings);
+	}
+};
\ No newline at end of file
@@ -1,83 +1,208 @@
 #define WIN32_LEAN_AND_MEAN
 #include "keyboard.h"
-#include "../config.h"
+#include "../config_schema.h"
+#include <emmintrin.h>
 #include <Windows.h>
 
+// Virtual key codes as in the docs, the defaults are WASD HJKL and enter
+static const config_schema<keyboard::settings> schema("keyboard.", {
+	{ "up",    &keyboard::settings::up,    "0x57" },
+	{ "down",  &keyboard::settings::down,  "0x53" },
+	{ "left",  &keyboard::settings::left,  "0x41" },
+	{ "right", &keyboard::settings::right, "0x44" },
+
+	{ "A",     &keyboard::settings::A,     "0x48" },
+	{ "B",     &keyboard::settings::B,     "0x4A" },
+	{ "C",     &keyboard::settings::C,     "0x4B" },
+	{ "D",     &keyboard::settings::D,     "0x4C" },
+
+	{ "start", &keyboard::settings::start, "0x0D" },
+
+	{ "socd",  &keyboard::settings::socd,
+		(int)(socd_mode::last_wins), socd_mode_names },
+});
+
+// Bit index of a scan code in a key_bitmap
+static int scan_code_bit(const int make_code, const bool e0)
+{
+	return 256 + ((make_code & 0x7F) | (e0 ? 0x80 : 0));
+}
+
+/**
+ * parse_keys - Parse a list of keys
+ * @value:	Keys separated by commas or spaces
+ * @bits:	Output bitmap words
+ *
+ * Each key is a virtual key code like 0x41, or a scan code like sc:0x1E.
+ * Scan codes of E0 prefixed keys are written with the prefix, e.g.
+ * sc:0xE01C for keypad enter. Returns false on the first bad key.
+ */
+static bool parse_keys(const std::string &value, uint64_t *bits)
+{
+	const auto set = [&](const int bit)
+	{
+		bits[bit / 64] |= (uint64_t)(1) << (bit % 64);
+	};
+
+	size_t pos = 0;
+	while (true) {
+		pos = value.find_first_not_of(", \t", pos);
+		if (pos == std::string::npos)
+			return true;
+
+		const auto end = value.find_first_of(", \t", pos);
+		auto key = value.substr(pos, end - pos);
+		pos = end;
+
+		const auto scan = key.compare(0, 3, "sc:") == 0;
+		if (scan)
+			key.erase(0, 3);
+
+		int code;
+		if (!config::parse_int(key.c_str(), &code))
+			return false;
+
+		if (!scan) {
+			if (code < 0 || code > 0xFF)
+				return false;
+
+			set(code);
+		} else {
+			const auto e0 = (code & 0xFF00) == 0xE000;
+			if ((code & 0xFF00) != 0 && !e0)
+				return false;
+			if ((code & 0xFF) > 0x7F)
+				return false;
+
+			set(scan_code_bit(code, e0));
+		}
+
+		if (pos == std::string::npos)
+			return true;
+	}
+}
+
 /**
  * init - Initialize an input device from a config
- * @cfg:	Config object
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
  *
  * Load all the keycodes from the config
  */
-void keyboard::init(const config &cfg)
+void keyboard::init(const config &cfg, std::vector<std::string> *diagnostics)
 {
-	const auto up    = cfg.value_int('W', "keyboard.up");
-	const auto down  = cfg.value_int('S', "keyboard.down");
-	const auto left  = cfg.value_int('A', "keyboard.left");
-	const auto right = cfg.value_int('D', "keyboard.right");
-
-	const auto A     = cfg.value_int('H', "keyboard.A");
-	const auto B     = cfg.value_int('J', "keyboard.B");
-	const auto C     = cfg.value_int('K', "keyboard.C");
-	const auto D     = cfg.value_int('L', "keyboard.D");
+	reload(cfg, diagnostics);
 
-	const auto start = cfg.value_int(VK_RETURN, "keyboard.start");
-
-	for (auto &association : key_mask_map)
-		association = 0;
-
-	key_mask_map[up]    = mask_up;
-	key_mask_map[down]  = mask_down;
-	key_mask_map[left]  = mask_left;
-	key_mask_map[right] = mask_right;
+	clear_buttons();
+}
 
-	key_mask_map[A]     = mask_A;
-	key_mask_map[B]     = mask_B;
-	key_mask_map[C]     = mask_C;
-	key_mask_map[D]     = mask_D;
+/**
+ * reload - Load keycodes from a config
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * Build a new keymap and swap it in for update to pick up. Any number of
+ * keys can be bound to a button.
+ */
+void keyboard::reload(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	settings codes;
+	schema.bind(cfg, &codes, diagnostics);
+
+	std::unique_ptr<keymap> map(new keymap());
+
+	const struct {
+		const char *name;
+		const std::string &keys;
+		unsigned short mask;
+	} buttons[num_buttons] = {
+		{ "up",    codes.up,    mask_up    },
+		{ "down",  codes.down,  mask_down  },
+		{ "left",  codes.left,  mask_left  },
+		{ "right", codes.right, mask_right },
+
+		{ "A",     codes.A,     mask_A     },
+		{ "B",     codes.B,     mask_B     },
+		{ "C",     codes.C,     mask_C     },
+		{ "D",     codes.D,     mask_D     },
+
+		{ "start", codes.start, mask_start },
+	};
+
+	for (auto i = 0; i < num_buttons; i++) {
+		auto *bits = map->button_keys[i].words;
+		map->button_masks[i] = buttons[i].mask;
+
+		if (parse_keys(buttons[i].keys, bits))
+			continue;
+
+		// Bind nothing rather than half the list
+		for (auto j = 0; j < 8; j++)
+			bits[j] = 0;
+
+		if (diagnostics != nullptr) {
+			diagnostics->push_back(
+				std::string("keyboard.") + buttons[i].name + ": \"" +
+				buttons[i].keys + "\" is not a list of keys");
+		}
+	}
 
-	key_mask_map[start] = mask_start;
+	map->socd = (socd_mode)(codes.socd);
 
-	buttons = 0;
+	keys.publish(std::move(map));
 }
 
 /**
  * update - Update the bits in buttons
  * @input:	Raw input data pointer
  *
- * Make the most recently pressed directional key take priority
+ * Flip the key's bits in pressed, then OR-reduce pressed against each
+ * button's keys. Resolve opposing directions with the configured socd
+ * policy.
  */
 void keyboard::update(const tagRAWINPUT *input)
 {
 	if (input->header.dwType != RIM_TYPEKEYBOARD)
 		return;
 
-	const auto vkey = input->data.keyboard.VKey % 0xFF;
-	const auto down = (input->data.keyboard.Flags & RI_KEY_BREAK) == 0;
-	const auto mask = key_mask_map[vkey];
-
-	buttons |= old_dir_buttons;
-	buttons = down ? (buttons | mask) : (buttons & ~mask);
-
-	const auto dir_buttons = buttons & (mask_up | mask_down | mask_left | mask_right);
-	buttons &= ~dir_buttons;
-
-	const auto changed = dir_buttons ^ old_dir_buttons;
-	const auto pressed = changed & dir_buttons;
-	const auto released = changed & old_dir_buttons;
-
-	for (auto i = 0; i < std::numeric_limits<decltype(dir_buttons)>::digits; i++) {
-		const auto mask = 1 << i;
-		if (pressed & mask)
-			direction_keys.push_front(mask);
-		else if (released & mask)
-			direction_keys.remove(mask);
+	const auto &key = input->data.keyboard;
+	const auto down = (key.Flags & RI_KEY_BREAK) == 0;
+	const auto e0 = (key.Flags & RI_KEY_E0) != 0;
+
+	const auto set_bit = [&](const int bit)
+	{
+		const auto mask = (uint64_t)(1) << (bit % 64);
+		auto &word = pressed.words[bit / 64];
+		word = down ? (word | mask) : (word & ~mask);
+	};
+
+	set_bit(key.VKey & 0xFF);
+	set_bit(scan_code_bit(key.MakeCode, e0));
+
+	const auto *map = keys.get();
+
+	const auto *held = (const __m128i*)(pressed.words);
+	const auto held0 = _mm_loadu_si128(held + 0);
+	const auto held1 = _mm_loadu_si128(held + 1);
+	const auto held2 = _mm_loadu_si128(held + 2);
+	const auto held3 = _mm_loadu_si128(held + 3);
+	const auto zero = _mm_setzero_si128();
+
+	unsigned short held_buttons = 0;
+	for (auto i = 0; i < num_buttons; i++) {
+		const auto *bound = (const __m128i*)(map->button_keys[i].words);
+		const auto any = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128(held0, _mm_loadu_si128(bound + 0)),
+				_mm_and_si128(held1, _mm_loadu_si128(bound + 1))),
+			_mm_or_si128(
+				_mm_and_si128(held2, _mm_loadu_si128(bound + 2)),
+				_mm_and_si128(held3, _mm_loadu_si128(bound + 3))));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+			held_buttons |= map->button_masks[i];
 	}
 
-	if (direction_keys.size() != 0)
-		buttons |= direction_keys.front();
-
-	old_dir_buttons = dir_buttons;
-
-	return;
+	buttons = (held_buttons & ~dir_all)
+		| directions.update(held_buttons & dir_all, map->socd);
 }
\ No newline at end of file
@@ -1,21 +1,57 @@
 #pragma once
 
 #include "base_input.h"
-#include <list>
-#include <map>
+#include "snapshot.h"
+#include "socd.h"
+#include <cstdint>
+#include <string>
 
 class keyboard : public base_input {
+public:
+	// Keys for each button, see parse_keys
+	struct settings {
+		std::string up;
+		std::string down;
+		std::string left;
+		std::string right;
+
+		std::string A;
+		std::string B;
+		std::string C;
+		std::string D;
+
+		std::string start;
+
+		// socd_mode
+		int socd;
+	};
+
+private:
 	// TGM3 buttons
 	unsigned short buttons;
 
-	// Directional buttons from the previous update
-	unsigned short old_dir_buttons;
+	// Order the held directions were pressed in
+	direction_priority directions;
 
-	// List containing which direction keys are pressed
-	std::list<unsigned short> direction_keys;
+	// One bit per virtual key in the first 256 bits, one per scan code in
+	// the last 256 with 0x80 set for E0 prefixed keys
+	struct key_bitmap {
+		uint64_t words[8];
+	};
 
-	// Virtual key -> Button mask table
-	unsigned short key_mask_map[0xFF];
+	// Keys currently held, exact under any rollover
+	key_bitmap pressed;
+
+	static const int num_buttons = 9;
+
+	// Keys bound to each button
+	struct keymap {
+		key_bitmap button_keys[num_buttons];
+		unsigned short button_masks[num_buttons];
+		socd_mode socd;
+	};
+
+	snapshot<keymap> keys;
 
 public:
 	// Raw input usage
@@ -25,16 +61,24 @@ public:
 	}
 
 	// Load keycodes from config
-	void init(const config &cfg) override;
+	void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	// Publish a new keymap
+	void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
 
-	// Update direction_keys and buttons
+	// Update pressed and buttons
 	void update(const tagRAWINPUT *input) override;
 
-	// Clear direction keys list too
+	// Clear held keys and direction order too
 	void clear_buttons() override
 	{
 		buttons = 0;
-		direction_keys.clear();
+		pressed = key_bitmap();
+		directions.clear();
 	}
 
 	// buttons accessors
@@ -0,0 +1,95 @@
+#include "latch.h"
+#include "../config_schema.h"
+#include <atomic>
+
+struct latch_settings {
+	int up;
+	int down;
+	int left;
+	int right;
+
+	int A;
+	int B;
+	int C;
+	int D;
+
+	int start;
+};
+
+static const config_schema<latch_settings> schema("latch.", {
+	{ "up",    &latch_settings::up,    (int)(latch_mode::press), latch_mode_names },
+	{ "down",  &latch_settings::down,  (int)(latch_mode::press), latch_mode_names },
+	{ "left",  &latch_settings::left,  (int)(latch_mode::press), latch_mode_names },
+	{ "right", &latch_settings::right, (int)(latch_mode::press), latch_mode_names },
+
+	{ "A",     &latch_settings::A,     (int)(latch_mode::press), latch_mode_names },
+	{ "B",     &latch_settings::B,     (int)(latch_mode::press), latch_mode_names },
+	{ "C",     &latch_settings::C,     (int)(latch_mode::press), latch_mode_names },
+	{ "D",     &latch_settings::D,     (int)(latch_mode::press), latch_mode_names },
+
+	{ "start", &latch_settings::start, (int)(latch_mode::press), latch_mode_names },
+});
+
+// Press latched bits in the low 32 bits, release latched in the high 32
+static std::atomic<uint64_t> latch_masks(0);
+
+// Level handed to the game on the previous poll
+static uint32_t last_level;
+
+/**
+ * load_latch - Read latch settings from a config
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * Build the masks for both players and publish them in one store.
+ */
+void load_latch(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	latch_settings latch;
+	schema.bind(cfg, &latch, diagnostics);
+
+	const struct {
+		int mode;
+		uint32_t mask;
+	} buttons[] = {
+		{ latch.up,    32    },
+		{ latch.down,  16    },
+		{ latch.left,  8     },
+		{ latch.right, 4     },
+		{ latch.A,     2     },
+		{ latch.B,     1     },
+		{ latch.C,     32768 },
+		{ latch.D,     16384 },
+		{ latch.start, 128   },
+	};
+
+	uint32_t press = 0;
+	uint32_t release = 0;
+	for (const auto &button : buttons) {
+		const auto both = button.mask | (button.mask << 16);
+		if (button.mode == (int)(latch_mode::press))
+			press |= both;
+		else if (button.mode == (int)(latch_mode::release))
+			release |= both;
+	}
+
+	latch_masks.store(
+		press | ((uint64_t)(release) << 32),
+		std::memory_order_relaxed);
+}
+
+uint32_t latch_buttons(const uint32_t level, const uint32_t toggled)
+{
+	const auto masks = latch_masks.load(std::memory_order_relaxed);
+	const auto press = (uint32_t)(masks);
+	const auto release = (uint32_t)(masks >> 32);
+
+	// Up at both polls but changed in between means it was pressed, down
+	// at both means it was released
+	const auto taps = toggled & ~level & ~last_level;
+	const auto gaps = toggled & level & last_level;
+
+	last_level = level;
+
+	return (level | (taps & press)) & ~(gaps & release);
+}
\ No newline at end of file
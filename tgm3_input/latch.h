@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+/*
+ * Per button policy for changes that happen between two JVS polls:
+ *
+ * level:	Only the state at the poll counts, quick taps can vanish
+ * press:	A press that was released again before the poll still shows
+ *		as pressed for one poll
+ * release:	A release that was pressed again before the poll still shows
+ *		as released for one poll
+ */
+enum class latch_mode {
+	level,
+	press,
+	release
+};
+
+static const char *const latch_mode_names[] = {
+	"level",
+	"press",
+	"release",
+	nullptr
+};
+
+// Read the latch. namespace, safe to call again from the reload thread
+void load_latch(
+	const class config &cfg,
+	std::vector<std::string> *diagnostics);
+
+/**
+ * latch_buttons - Apply the latch policies to a button sample
+ * @level:	Packed button word at the poll
+ * @toggled:	Bits that changed since the last poll
+ *
+ * Game thread only, keeps the level from the previous call.
+ */
+uint32_t latch_buttons(uint32_t level, uint32_t toggled);
\ No newline at end of file
@@ -0,0 +1,171 @@
+#define WIN32_LEAN_AND_MEAN
+#include "latency.h"
+#include <cstdio>
+#include <cstdlib>
+#include <Windows.h>
+
+static uint64_t qpc_now()
+{
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	return (uint64_t)(count.QuadPart);
+}
+
+static uint64_t qpc_frequency()
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)(frequency.QuadPart);
+}
+
+static latency_clock clock_source = { qpc_now, 0 };
+
+// Set once latency_start was called
+static std::atomic<bool> enabled(false);
+static std::string out_filename;
+
+// Press time for each bit of the packed button word, 0 if not pressed since
+// it was last consumed
+static std::atomic<uint64_t> press_time[32];
+
+// Press to consume time for each bit of the packed button word
+static latency_histogram histograms[32];
+
+// Last word handed to the game, only touched by the game thread
+static uint32_t last_consumed;
+
+void set_latency_clock(const latency_clock &clock)
+{
+	clock_source = clock;
+}
+
+/**
+ * bit_name - Describe a bit of the packed button word
+ * @bit:	Bit index
+ * @buf:	Output buffer
+ * @size:	Size of buf
+ */
+static void bit_name(const int bit, char *buf, const size_t size)
+{
+	static const struct {
+		unsigned short mask;
+		const char *name;
+	} names[] = {
+		{ 32,    "up"    },
+		{ 16,    "down"  },
+		{ 8,     "left"  },
+		{ 4,     "right" },
+		{ 2,     "A"     },
+		{ 1,     "B"     },
+		{ 32768, "C"     },
+		{ 16384, "D"     },
+		{ 128,   "start" },
+	};
+
+	const auto mask = (unsigned short)(1u << (bit % 16));
+	const auto *player = bit < 16 ? "1p" : "2p";
+
+	for (const auto &entry : names) {
+		if (entry.mask == mask) {
+			sprintf_s(buf, size, "%s %s", player, entry.name);
+			return;
+		}
+	}
+
+	sprintf_s(buf, size, "%s bit %d", player, bit % 16);
+}
+
+/**
+ * write_report - Write percentiles for every button that was pressed
+ *
+ * Registered with atexit by latency_start.
+ */
+static void write_report()
+{
+	FILE *file;
+	if (fopen_s(&file, out_filename.c_str(), "w") != 0)
+		return;
+
+	fprintf(file, "# press to consume latency in microseconds\n");
+	fprintf(file, "%-10s %8s %8s %8s %8s %8s %8s\n",
+		"button", "count", "p50", "p90", "p99", "p99.9", "max");
+
+	for (auto bit = 0; bit < 32; bit++) {
+		const auto &histogram = histograms[bit];
+		if (histogram.count() == 0)
+			continue;
+
+		char name[16];
+		bit_name(bit, name, sizeof(name));
+
+		fprintf(file, "%-10s %8u %8u %8u %8u %8u %8u\n",
+			name,
+			histogram.count(),
+			histogram.percentile(50.0),
+			histogram.percentile(90.0),
+			histogram.percentile(99.0),
+			histogram.percentile(99.9),
+			histogram.maximum());
+	}
+
+	fclose(file);
+}
+
+/**
+ * latency_start - Start timing presses
+ * @filename:	Report to write when the process exits
+ */
+void latency_start(const std::string &filename)
+{
+	if (clock_source.frequency == 0)
+		clock_source.frequency = qpc_frequency();
+
+	out_filename = filename;
+	atexit(write_report);
+	enabled.store(true, std::memory_order_release);
+}
+
+/**
+ * latency_press - Stamp newly pressed buttons
+ * @pressed:	Bits that went from released to pressed
+ *
+ * Must be called before the new word is published so the game thread sees
+ * the stamps once it sees the bits.
+ */
+void latency_press(const uint32_t pressed)
+{
+	if (pressed == 0 || !enabled.load(std::memory_order_relaxed))
+		return;
+
+	const auto now = clock_source.now();
+	for (auto bit = 0; bit < 32; bit++) {
+		if (pressed & (1u << bit))
+			press_time[bit].store(now, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * latency_consume - Record how long new presses waited for the game
+ * @state:	Packed button word just given to the game
+ */
+void latency_consume(const uint32_t state)
+{
+	const auto pressed = state & ~last_consumed;
+	last_consumed = state;
+
+	if (pressed == 0 || !enabled.load(std::memory_order_relaxed))
+		return;
+
+	const auto now = clock_source.now();
+	for (auto bit = 0; bit < 32; bit++) {
+		if ((pressed & (1u << bit)) == 0)
+			continue;
+
+		const auto stamp = press_time[bit].exchange(0, std::memory_order_relaxed);
+		if (stamp == 0 || stamp > now)
+			continue;
+
+		const auto us = (now - stamp) * 1000000 / clock_source.frequency;
+		histograms[bit].record(us > UINT32_MAX ? UINT32_MAX : (uint32_t)(us));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timestamp source, QueryPerformanceCounter unless replaced
+struct latency_clock {
+	uint64_t (*now)();
+	uint64_t frequency; // Ticks per second
+};
+
+// Swap the clock used for stamps, must be called before latency_start
+void set_latency_clock(const latency_clock &clock);
+
+/*
+ * Log-linear histogram of durations, in whatever unit the caller records:
+ * microseconds for press latency, nanoseconds for the demo recorder. Values
+ * below 32 get a bucket each, above that every power of two up to 2^31 is
+ * split into 16 buckets, so any recorded value is off by at most 1/16.
+ * Recording is a single relaxed increment and never blocks.
+ */
+class latency_histogram {
+public:
+	static const int sub_bits = 4;
+	static const int sub_count = 1 << sub_bits;
+
+	// Values below 2^sub_bits share the first power of two's buckets, so
+	// UINT32_MAX lands in the last of 33 - sub_bits powers
+	static const int bucket_count = (33 - sub_bits) * sub_count;
+
+	// Bucket a value is counted in
+	static int bucket_index(const uint32_t value)
+	{
+		if (value < 2 * sub_count)
+			return (int)(value);
+
+		auto msb = 0;
+		while ((value >> msb) > 1)
+			msb++;
+
+		const auto shift = msb - sub_bits;
+		return (shift + 1) * sub_count
+			+ (int)((value >> shift) - sub_count);
+	}
+
+	// Highest value that lands in a bucket
+	static uint32_t bucket_limit(const int index)
+	{
+		if (index < 2 * sub_count)
+			return (uint32_t)(index);
+
+		// The last bucket ends at 2^32, past uint32_t
+		const auto shift = index / sub_count - 1;
+		const auto base = (uint64_t)(index % sub_count + sub_count);
+		return (uint32_t)(std::min<uint64_t>(((base + 1) << shift) - 1, UINT32_MAX));
+	}
+
+private:
+	std::atomic<uint32_t> buckets[bucket_count];
+	std::atomic<uint32_t> total;
+	std::atomic<uint32_t> max;
+
+public:
+	latency_histogram() : total(0), max(0)
+	{
+		for (auto &bucket : buckets)
+			bucket.store(0, std::memory_order_relaxed);
+	}
+
+	latency_histogram(const latency_histogram&) = delete;
+	latency_histogram &operator=(const latency_histogram&) = delete;
+
+	void record(const uint32_t value)
+	{
+		buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+		total.fetch_add(1, std::memory_order_relaxed);
+
+		auto old_max = max.load(std::memory_order_relaxed);
+		while (value > old_max
+		    && !max.compare_exchange_weak(old_max, value, std::memory_order_relaxed))
+			;
+	}
+
+	uint32_t count() const
+	{
+		return total.load(std::memory_order_relaxed);
+	}
+
+	uint32_t maximum() const
+	{
+		return max.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * percentile - Approximate value at a percentile
+	 * @p:		Percentile in [0, 100]
+	 *
+	 * Return the upper bound of the bucket the percentile falls in.
+	 */
+	uint32_t percentile(const double p) const
+	{
+		const auto n = count();
+		if (n == 0)
+			return 0;
+
+		auto rank = (uint64_t)(p / 100.0 * n + .5);
+		if (rank < 1)
+			rank = 1;
+
+		uint64_t seen = 0;
+		for (auto i = 0; i < bucket_count; i++) {
+			seen += buckets[i].load(std::memory_order_relaxed);
+			if (seen >= rank)
+				return std::min(bucket_limit(i), maximum());
+		}
+
+		return maximum();
+	}
+};
+
+// Start timing presses, percentiles get written to filename on exit
+void latency_start(const std::string &filename);
+
+// Window thread, newly pressed bits of the packed button word
+void latency_press(uint32_t pressed);
+
+// Game thread, the packed button word it just handed to the game
+void latency_consume(uint32_t state);
\ No newline at end of file
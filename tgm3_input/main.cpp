@@ -1,24 +1,463 @@
 // i dont tas okay
 #define WIN32_LEAN_AND_MEAN
 #include "../config.h"
+#include "../patches.h"
 #include "demo.h"
 #include "practice.h"
 #include "keyboard.h"
 #include "joystick.h"
+#include "evdev.h"
+#include "inject_input.h"
+#include "relay_input.h"
+#include "file_watcher.h"
+#include "button_state.h"
+#include "latency.h"
+#include "latch.h"
+#include "alloc_counter.h"
+#include "input_thread.h"
+#include "../config_schema.h"
 #include <memory>
+#include <atomic>
 #include <Windows.h>
 #include <detours.h>
 #include <intrin.h>
 
 keyboard keyboard_device;
 joystick joystick_device;
+#ifdef __linux__
+evdev_input evdev_device;
+#endif
+inject_input inject_device;
+relay_input relay_device;
 base_input *devices[] = {
 	&keyboard_device,
-	&joystick_device
+	&joystick_device,
+#ifdef __linux__
+	&evdev_device,
+#endif
+	&inject_device,
+	&relay_device,
 };
 
 const config cfg("tgm3.cfg");
 
+struct input_settings {
+	bool thread;
+};
+
+static const config_schema<input_settings> input_schema("input.", {
+	{ "thread", &input_settings::thread, false },
+});
+
+// Reads raw input instead of the window thread if input.thread is set
+static input_thread input_worker;
+
+// Request bits for input_worker
+static constexpr uint32_t request_publish = 1;
+static constexpr uint32_t request_clear = 2;
+
+// Game window focus, input_worker drops keys and buttons without it
+static std::atomic<bool> game_focused(true);
+
+// Latest config from the reload thread, null until the first reload
+static snapshot<config> live_cfg;
+
+// Written by the window thread, read by the game thread
+static button_state published_buttons;
+static uint32_t last_published;
+
+/**
+ * publish_buttons - Combine every device's buttons for the game thread
+ *
+ * Must be called from the window thread after any device state changes.
+ */
+static void publish_buttons()
+{
+	unsigned short buttons_1p = 0;
+	unsigned short buttons_2p = 0;
+	for (const auto &device : devices) {
+		buttons_1p |= device->get_buttons_1p();
+		buttons_2p |= device->get_buttons_2p();
+	}
+
+	const auto state = button_state::pack(buttons_1p, buttons_2p);
+	latency_press(state & ~last_published);
+	last_published = state;
+
+	published_buttons.publish(state);
+}
+
+// Window raw input is registered with, null until the first WM_PAINT
+static std::atomic<HWND> input_window(nullptr);
+
+// Posted to input_window when a device thread's buttons change, registered
+// before input_window is set
+static UINT buttons_changed_msg;
+
+// Whether a buttons_changed_msg is waiting to be handled
+static std::atomic<bool> publish_pending(false);
+
+/**
+ * notify_buttons_changed - Have the window thread publish buttons
+ *
+ * Safe to call from any thread. Changes made before the message is handled
+ * are published together, so at most one message is queued at a time.
+ */
+void notify_buttons_changed()
+{
+	if (input_worker.running()) {
+		input_worker.request(request_publish);
+		return;
+	}
+
+	const auto wnd = input_window.load(std::memory_order_acquire);
+	if (wnd == nullptr)
+		return;
+
+	if (!publish_pending.exchange(true, std::memory_order_acq_rel))
+		PostMessage(wnd, buttons_changed_msg, 0, 0);
+}
+
+static std::unique_ptr<file_watcher> cfg_watcher;
+/**
+ * reload_thread - Apply tgm3.cfg changes while the game is running
+ * @param:	Unused
+ *
+ * Parse the config off the game thread whenever it's modified and let the
+ * devices publish their new settings. Errors go to the debugger output
+ * rather than a message box in front of the game.
+ */
+static DWORD WINAPI reload_thread(void *param)
+{
+	while (cfg_watcher->wait()) {
+		// Editors may write the file in several steps
+		Sleep(100);
+
+		std::unique_ptr<const config> new_cfg(new config("tgm3.cfg"));
+
+		std::vector<std::string> diagnostics;
+		for (auto &device : devices)
+			device->reload(*new_cfg, &diagnostics);
+
+		load_latch(*new_cfg, &diagnostics);
+
+		for (const auto &message : diagnostics)
+			OutputDebugString(("tgm3.cfg: " + message + "\n").c_str());
+
+		// Devices plugged in later are set up from this
+		live_cfg.publish(std::move(new_cfg));
+	}
+
+	return 0;
+}
+
+// Raw input records, reused for every WM_INPUT so reading input doesn't
+// allocate
+static uint64_t input_buffer[2048];
+
+// Heap allocations made while handling WM_INPUT, should stay at 0
+static unsigned input_messages;
+static unsigned input_allocations;
+
+/**
+ * report_input_allocations - Print the allocation counter on exit
+ *
+ * Allocations are only counted in builds with ALLOC_COUNTER.
+ */
+static void report_input_allocations()
+{
+#ifdef ALLOC_COUNTER
+	char message[128];
+	sprintf_s(message, sizeof(message),
+		"tgm3_input: %u heap allocations in %u WM_INPUT messages\n",
+		input_allocations, input_messages);
+
+	OutputDebugString(message);
+#endif
+}
+
+/**
+ * report_request_latency - Print how fast input_worker handled requests
+ */
+static void report_request_latency()
+{
+	const auto &latency = input_worker.request_latency();
+
+	char message[128];
+	sprintf_s(message, sizeof(message),
+		"tgm3_input: input thread requests took p50 %uus p99 %uus max %uus\n",
+		latency.percentile(50), latency.percentile(99), latency.maximum());
+
+	OutputDebugString(message);
+}
+
+/**
+ * next_raw_input - Step to the next record from GetRawInputBuffer
+ * @input:	Current record
+ * @wow64:	Whether this is a 32 bit process on 64 bit Windows
+ *
+ * Records are QWORD aligned under WOW64, NEXTRAWINPUTBLOCK assumes DWORD.
+ */
+static RAWINPUT *next_raw_input(RAWINPUT *input, const bool wow64)
+{
+	const auto align = wow64 ? 8u : sizeof(DWORD);
+	const auto next = (uintptr_t)(input) + input->header.dwSize;
+	return (RAWINPUT*)((next + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+/**
+ * dispatch_raw_input - Pass a record to every device
+ * @input:	Raw input record
+ */
+static void dispatch_raw_input(const RAWINPUT *input)
+{
+	for (auto &device : devices)
+		device->update(input);
+}
+
+/**
+ * read_raw_input - Handle a WM_INPUT and everything queued behind it
+ * @handle:	Raw input handle from the message's lparam
+ *
+ * Read the message's own record, then drain the rest of the queue with
+ * GetRawInputBuffer so a burst of reports from a fast stick is handled in
+ * one go. Everything lands in input_buffer.
+ */
+static void read_raw_input(const HRAWINPUT handle)
+{
+	auto *input = (RAWINPUT*)(input_buffer);
+
+	UINT size = sizeof(input_buffer);
+	if (GetRawInputData(
+		handle,
+		RID_INPUT,
+		input,
+		&size,
+		sizeof(RAWINPUTHEADER)) != (UINT)(-1)
+	) {
+		dispatch_raw_input(input);
+	} else if (size > sizeof(input_buffer)) {
+		// Too big for the buffer, shouldn't happen with game controllers
+		auto big_buf = std::make_unique<uint64_t[]>((size + 7) / 8);
+		auto *big_input = (RAWINPUT*)(big_buf.get());
+		if (GetRawInputData(
+			handle,
+			RID_INPUT,
+			big_input,
+			&size,
+			sizeof(RAWINPUTHEADER)) != (UINT)(-1)
+		)
+			dispatch_raw_input(big_input);
+	}
+
+	static const auto wow64 = []
+	{
+		BOOL result = FALSE;
+		IsWow64Process(GetCurrentProcess(), &result);
+		return result != FALSE;
+	}();
+
+	while (true) {
+		size = sizeof(input_buffer);
+		const auto count = GetRawInputBuffer(
+			input,
+			&size,
+			sizeof(RAWINPUTHEADER));
+
+		if (count == 0 || count == (UINT)(-1))
+			break;
+
+		auto *record = input;
+		for (auto i = 0u; i < count; i++) {
+			// WOW64 headers have 64 bit handles, move the data up
+			// to where the 32 bit RAWINPUT expects it
+			if (wow64 && record->header.dwSize >= sizeof(RAWINPUTHEADER) + 8) {
+				memmove(
+					&record->data,
+					(char*)(&record->data) + 8,
+					record->header.dwSize - sizeof(RAWINPUTHEADER) - 8);
+			}
+
+			dispatch_raw_input(record);
+			record = next_raw_input(record, wow64);
+		}
+	}
+}
+
+/**
+ * handle_raw_input - Pass a WM_INPUT to the devices and publish the result
+ * @handle:	Raw input handle from the message's lparam
+ */
+static void handle_raw_input(const HRAWINPUT handle)
+{
+	const auto allocations = counted_allocations();
+
+	read_raw_input(handle);
+	publish_buttons();
+
+	input_messages++;
+	input_allocations += counted_allocations() - allocations;
+
+	// Input settings may be freed by the reload thread after this
+	snapshot_quiescent();
+}
+
+/**
+ * handle_device_change - Pass a WM_INPUT_DEVICE_CHANGE to the devices
+ * @wparam:	GIDC_ARRIVAL or GIDC_REMOVAL
+ * @lparam:	Raw input handle of the device
+ */
+static void handle_device_change(const WPARAM wparam, const LPARAM lparam)
+{
+	const auto *current_cfg = live_cfg.get();
+	std::vector<std::string> diagnostics;
+
+	for (auto &device : devices) {
+		if (wparam == GIDC_ARRIVAL) {
+			device->device_added(
+				current_cfg != nullptr ? *current_cfg : cfg,
+				(HANDLE)(lparam),
+				&diagnostics);
+		} else if (wparam == GIDC_REMOVAL) {
+			device->device_removed((HANDLE)(lparam));
+		}
+	}
+
+	for (const auto &message : diagnostics)
+		OutputDebugString(("tgm3.cfg: " + message + "\n").c_str());
+
+	publish_buttons();
+	snapshot_quiescent();
+}
+
+// Make sure buttons don't get stuck
+static void clear_all_buttons()
+{
+	for (auto &device : devices)
+		device->clear_buttons();
+
+	publish_buttons();
+}
+
+/**
+ * register_raw_input - Send every device's raw input to a window
+ * @wnd:	Window to receive WM_INPUT
+ * @flags:	RIDEV_ flags
+ */
+static void register_raw_input(const HWND wnd, const DWORD flags)
+{
+	for (auto &device : devices) {
+		for (auto &usage : device->get_usage()) {
+			RAWINPUTDEVICE rid;
+			rid.usUsagePage = 1;
+			rid.usUsage = usage;
+			rid.dwFlags = flags;
+			rid.hwndTarget = wnd;
+			RegisterRawInputDevices(&rid, 1, sizeof(rid));
+		}
+	}
+}
+
+/**
+ * input_window_proc - Window proc for input_worker's window
+ * @wnd:	Window handle
+ * @msg:	Window message type
+ * @wparam:	Additional message info
+ * @lparam:	Additional message info
+ *
+ * Input arrives here whether the game is focused or not, it's only passed
+ * on while the game is.
+ */
+static LRESULT CALLBACK input_window_proc(
+	HWND wnd,
+	UINT msg,
+	WPARAM wparam,
+	LPARAM lparam
+) {
+	if (msg == WM_INPUT && game_focused.load(std::memory_order_acquire)) {
+		handle_raw_input((HRAWINPUT)(lparam));
+		return 0;
+	} else if (msg == WM_INPUT_DEVICE_CHANGE) {
+		handle_device_change(wparam, lparam);
+		return 0;
+	}
+
+	return DefWindowProc(wnd, msg, wparam, lparam);
+}
+
+/**
+ * handle_input_requests - Requests made to input_worker
+ * @requests:	request_ bits
+ */
+static void handle_input_requests(const uint32_t requests)
+{
+	if (requests & request_clear)
+		clear_all_buttons();
+	else
+		publish_buttons();
+
+	snapshot_quiescent();
+}
+
+/*
+ * Raw input through a message only window, so input_worker gets WM_INPUT
+ * without going through the game's message loop.
+ */
+class raw_input_window : public input_source {
+	std::atomic<HWND> wnd;
+
+public:
+	raw_input_window() : wnd(nullptr)
+	{
+	}
+
+	bool open() override
+	{
+		WNDCLASS wc = {};
+		wc.lpfnWndProc = input_window_proc;
+		wc.hInstance = GetModuleHandle(nullptr);
+		wc.lpszClassName = "tgm3_input";
+		RegisterClass(&wc);
+
+		const auto new_wnd = CreateWindow(
+			"tgm3_input", "tgm3_input", 0, 0, 0, 0, 0,
+			HWND_MESSAGE, nullptr, wc.hInstance, nullptr);
+
+		if (new_wnd == nullptr)
+			return false;
+
+		// Background input is needed because this window is never in
+		// the foreground
+		register_raw_input(new_wnd, RIDEV_INPUTSINK | RIDEV_DEVNOTIFY);
+
+		count_allocations_on_this_thread();
+		wnd.store(new_wnd);
+		return true;
+	}
+
+	void pump() override
+	{
+		MsgWaitForMultipleObjectsEx(
+			0, nullptr, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+			DispatchMessage(&msg);
+	}
+
+	void wake() override
+	{
+		const auto current = wnd.load();
+		if (current != nullptr)
+			PostMessage(current, WM_NULL, 0, 0);
+	}
+
+	void close() override
+	{
+		DestroyWindow(wnd.exchange(nullptr));
+	}
+};
+
 using window_proc_t = LRESULT(CALLBACK*)(HWND, UINT, WPARAM, LPARAM);
 static window_proc_t orig_window_proc;
 /**
@@ -30,6 +469,10 @@ static window_proc_t orig_window_proc;
  *
  * Initialize and register raw input device on the first WM_PAINT. If msg is
  * WM_INPUT, grab the raw input data and pass it to the input device handlers.
+ * Devices plugged in or out while running are passed on too, and buttons
+ * read on device threads are published when they ask for it.
+ *
+ * With input_worker running only focus changes are handled here.
  */
 static LRESULT hook_window_proc(
 	HWND wnd,
@@ -37,50 +480,39 @@ static LRESULT hook_window_proc(
 	WPARAM wparam,
 	LPARAM lparam
 ) {
+	if (input_worker.running()) {
+		if (msg == WM_SETFOCUS) {
+			game_focused.store(true, std::memory_order_release);
+		} else if (msg == WM_KILLFOCUS) {
+			game_focused.store(false, std::memory_order_release);
+			input_worker.request(request_clear);
+		}
+
+		return orig_window_proc(wnd, msg, wparam, lparam);
+	}
+
 	static auto once = false;
 	if (msg == WM_PAINT && !once) {
-		for (auto &device : devices) {
-			for (auto &usage : device->get_usage()) {
-				RAWINPUTDEVICE rid;
-				rid.usUsagePage = 1;
-				rid.usUsage = usage;
-				rid.dwFlags = 0;
-				rid.hwndTarget = wnd;
-				RegisterRawInputDevices(&rid, 1, sizeof(rid));
-			}
-		}
+		register_raw_input(wnd, RIDEV_DEVNOTIFY);
+
+		buttons_changed_msg = RegisterWindowMessage("tgm3_input buttons");
+		input_window.store(wnd, std::memory_order_release);
 		once = true;
 	} else if (msg == WM_KILLFOCUS) {
-		// Make sure buttons don't get stuck
-		for (auto &device : devices)
-			device->clear_buttons();
+		clear_all_buttons();
+	} else if (msg == WM_INPUT_DEVICE_CHANGE) {
+		handle_device_change(wparam, lparam);
+		return 0;
+	} else if (msg == buttons_changed_msg && once) {
+		publish_pending.store(false, std::memory_order_release);
+		publish_buttons();
+		return 0;
 	}
 	
 	if (msg != WM_INPUT)
 		return orig_window_proc(wnd, msg, wparam, lparam);
 
-	// Get required buffer size
-	unsigned int buf_size;
-	GetRawInputData(
-		(HRAWINPUT)(lparam),
-		RID_INPUT,
-		nullptr,
-		&buf_size,
-		sizeof(RAWINPUTHEADER));
-
-	// Never access input_buf directly or you'll violate strict aliasing
-	auto input_buf = std::make_unique<char[]>(buf_size);
-	auto *input = (RAWINPUT*)(input_buf.get());
-
-	GetRawInputData(
-		(HRAWINPUT)(lparam),
-		RID_INPUT, 
-		input,
-		&buf_size,
-		sizeof(RAWINPUTHEADER));
-
-	for (auto &device : devices)
-		device->update(input);
+	handle_raw_input((HRAWINPUT)(lparam));
 
 	return 0;
 }
@@ -91,7 +523,9 @@ static get_jvs_data_t orig_get_jvs_data;
  * hook_get_jvs_data - TGM3 input hook
  * @unknown:	Always 1
  *
- * Pass the data acquired from raw input to TGM3.
+ * Pass the data acquired from raw input to TGM3. Both players come from
+ * the same published word, with taps since the last poll latched. Sources
+ * stepped by game frames are added on top.
  */
 static char *hook_get_jvs_data(const int unknown)
 {
@@ -99,12 +533,17 @@ static char *hook_get_jvs_data(const int unknown)
 	auto *buttons_1p = (unsigned short*)(data + 0x184);
 	auto *buttons_2p = (unsigned short*)(data + 0x186);
 
-	*buttons_1p = 0;
-	*buttons_2p = 0;
-	for (const auto &device : devices) {
-		*buttons_1p |= device->get_buttons_1p();
-		*buttons_2p |= device->get_buttons_2p();
-	}
+	const auto sample = published_buttons.consume();
+	auto state = latch_buttons(sample.level, sample.toggled);
+
+	const auto frame = *(uint32_t*)(0x4AE114); // frames since startup
+	for (const auto &device : devices)
+		state |= device->poll_buttons(frame);
+
+	*buttons_1p = button_state::buttons_1p(state);
+	*buttons_2p = button_state::buttons_2p(state);
+
+	latency_consume(state);
 
 	return data;
 }
@@ -163,12 +602,16 @@ void hook_position_window(const char fullscreen)
 		return m1.r.left < m2.r.left;
 	});
 
-	auto idx = cfg.value_int(0, "patches.monitor");
-	if (idx >= monitors.size())
+	// The launcher already reported any patches typos
+	patch_settings patches;
+	patch_settings::schema().bind(cfg, &patches, nullptr);
+
+	auto idx = patches.monitor;
+	if (idx < 0 || idx >= monitors.size())
 		idx = 0;
 
-	const auto res_x = cfg.value_int(640, "patches.resolution_x");
-	const auto res_y = cfg.value_int(480, "patches.resolution_y");
+	const auto res_x = patches.resolution_x;
+	const auto res_y = patches.resolution_y;
 	auto *already_fullscreen = (int*)(0x486A68);
 
 	if (!fullscreen && *already_fullscreen != 1)
@@ -231,8 +674,9 @@ int CALLBACK hook_WinMain(
 	const char *cmdline,
 	int show_cmd
 ) {
+	std::vector<std::string> diagnostics;
 	for (auto &device : devices)
-		device->init(cfg);
+		device->init(cfg, &diagnostics);
 
 	DetourFunction((BYTE*)(0x452CE0), (BYTE*)(hook_set_play_mode));
 	DetourFunction((BYTE*)(0x434E00), (BYTE*)(hook_set_sprite_scale));
@@ -245,11 +689,45 @@ int CALLBACK hook_WinMain(
 
 	// Demo playback
 	if (cmdline != nullptr && *cmdline != '\0')
-		setup_playback(cmdline);
+		setup_playback(cmdline, cfg, &diagnostics);
 	else
-		setup_recording();
+		latency_start(setup_recording(cfg, &diagnostics) + ".lat");
+
+	init_practice(cfg, &diagnostics);
+	load_latch(cfg, &diagnostics);
+
+	input_settings input;
+	input_schema.bind(cfg, &input, &diagnostics);
+
+	// hook_window_proc runs on this thread, input_worker counts its own
+	// allocations instead if it takes over
+	count_allocations_on_this_thread();
+	atexit(report_input_allocations);
+
+	if (input.thread) {
+		if (input_worker.start(
+			std::make_unique<raw_input_window>(),
+			handle_input_requests)
+		) {
+			atexit(report_request_latency);
+		} else {
+			diagnostics.push_back(
+				"input.thread: couldn't create an input window, "
+				"reading input on the game window");
+		}
+	}
+
+	if (!diagnostics.empty()) {
+		std::string message;
+		for (const auto &line : diagnostics)
+			message += line + "\n";
+
+		MessageBox(nullptr, message.c_str(), "tgm3.cfg", MB_OK);
+	}
 
-	init_practice(cfg);
+	cfg_watcher = make_file_watcher("tgm3.cfg");
+	if (cfg_watcher != nullptr)
+		CreateThread(nullptr, 0, reload_thread, nullptr, 0, nullptr);
 
 	// Call the original startup function
 	((void(*)())(0x42ED30))();
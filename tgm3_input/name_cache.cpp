@@ -0,0 +1,35 @@
+#include "name_cache.h"
+#include <fstream>
+
+void name_cache::load(const std::string &filename)
+{
+	this->filename = filename;
+	names.clear();
+	dirty = false;
+
+	std::ifstream file(filename, std::ios::binary);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		const auto tab = line.find('\t');
+		if (tab == std::string::npos || tab == 0)
+			continue;
+
+		names[line.substr(0, tab)] = line.substr(tab + 1);
+	}
+}
+
+void name_cache::save()
+{
+	if (!dirty || filename.empty())
+		return;
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	for (const auto &entry : names)
+		file << entry.first << '\t' << entry.second << '\n';
+
+	// Try again next time if the write failed
+	dirty = !file;
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+/*
+ * Product names of HID devices by device path, kept in a file between runs
+ * so devices that aren't configured never need to be opened. Lines are
+ * "<path>\t<name>" with names in UTF-8. Not thread safe.
+ */
+class name_cache {
+	std::string filename;
+	std::unordered_map<std::string, std::string> names;
+	bool dirty = false;
+
+public:
+	// Read the file, a missing or garbled one leaves the cache empty
+	void load(const std::string &filename);
+
+	// Write the file back if anything changed since it was loaded
+	void save();
+
+	// Name for a device path, null if it isn't cached
+	const std::string *find(const std::string &path) const
+	{
+		const auto it = names.find(path);
+		return it != names.end() ? &it->second : nullptr;
+	}
+
+	void set(const std::string &path, const std::string &name)
+	{
+		auto &entry = names[path];
+		if (entry == name)
+			return;
+
+		entry = name;
+		dirty = true;
+	}
+};
\ No newline at end of file
@@ -1,5 +1,5 @@
 #define WIN32_LEAN_AND_MEAN
-#include "config.h"
+#include "config_schema.h"
 #include <random>
 #include <ctime>
 #include <vector>
@@ -8,6 +8,24 @@
 #include <Windows.h>
 #include <detours.h>
 
+static struct settings {
+	int speed_lock;
+	bool invisible;
+	bool fuck_this_game;
+
+	int dig_quota;
+	int dig_block_size;
+} practice;
+
+static const config_schema<settings> schema("practice.", {
+	{ "speed_lock",     &settings::speed_lock,     -1    },
+	{ "invisible",      &settings::invisible,      false },
+	{ "fuck_this_game", &settings::fuck_this_game, false },
+
+	{ "dig.quota",      &settings::dig_quota,      0     },
+	{ "dig.block_size", &settings::dig_block_size, 1     },
+});
+
 // Use a bag to keep things consistent
 static class garbage_bag {
 	std::vector<int> bag;
@@ -120,8 +138,6 @@ __declspec(naked) static void hook_are_frame()
 	}
 }
 
-static int speed_lock;
-
 using get_timing_t = short(*)(const int table, const int level);
 static get_timing_t orig_get_timing;
 /**
@@ -133,7 +149,7 @@ static get_timing_t orig_get_timing;
  */
 static short hook_get_timing(const int table, const int level)
 {
-	return orig_get_timing(table, speed_lock);
+	return orig_get_timing(table, practice.speed_lock);
 }
 
 using get_gravity_t = int(*)(const int mode, const int level);
@@ -147,26 +163,28 @@ static get_gravity_t orig_get_gravity;
  */
 static int hook_get_gravity(const int mode, const int level)
 {
-	return orig_get_gravity(mode, speed_lock);
+	return orig_get_gravity(mode, practice.speed_lock);
 }
 
 /**
  * init_practice - Set up practice hooks
- * @cfg:	tgm3.cfg
+ * @cfg:		tgm3.cfg
+ * @diagnostics:	Config errors
  *
  * Apply hooks for dig mode
  */
-void init_practice(const config &cfg)
+void init_practice(const config &cfg, std::vector<std::string> *diagnostics)
 {
-	speed_lock = cfg.value_int(-1, "practice.speed_lock");
-	if (speed_lock >= 0) {
+	schema.bind(cfg, &practice, diagnostics);
+
+	if (practice.speed_lock >= 0) {
 		orig_get_timing = (get_timing_t)(DetourFunction(
 				(BYTE*)(0x425610), (BYTE*)(hook_get_timing)));
 		orig_get_gravity = (get_gravity_t)(DetourFunction(
 				(BYTE*)(0x40CBA0), (BYTE*)(hook_get_gravity)));
 	}
 
-	if (cfg.value_bool(false, "practice.invisible")) {
+	if (practice.invisible) {
 		// patch the invisible field flag test to a JMP instead of JZ
 		DWORD old_protect;
 		VirtualProtect((void*)(0x41D429), 2, PAGE_READWRITE, &old_protect);
@@ -175,7 +193,7 @@ void init_practice(const config &cfg)
 		VirtualProtect((void*)(0x41D429), 2, old_protect, &old_protect);
 	}
 
-	if (cfg.value_bool(false, "practice.fuck_this_game")) {
+	if (practice.fuck_this_game) {
 		// force [] blocks
 		DWORD old_protect;
 		VirtualProtect((void*)(0x402B50), 2, PAGE_READWRITE, &old_protect);
@@ -184,9 +202,9 @@ void init_practice(const config &cfg)
 		VirtualProtect((void*)(0x402B50), 2, old_protect, &old_protect);
 	}
 
-	dig.quota = cfg.value_int(0, "practice.dig.quota");
+	dig.quota = practice.dig_quota;
 	if (dig.quota > 0) {
-		dig.block_size = cfg.value_int(1, "practice.dig.block_size");
+		dig.block_size = practice.dig_block_size;
 		orig_are_frame = DetourFunction(
 			(BYTE*)(0x4107F0), (BYTE*)(hook_are_frame));
 	}
@@ -1,3 +1,8 @@
 #pragma once
 
-void init_practice(const class config &cfg);
\ No newline at end of file
+#include <vector>
+#include <string>
+
+void init_practice(
+	const class config &cfg,
+	std::vector<std::string> *diagnostics);
\ No newline at end of file
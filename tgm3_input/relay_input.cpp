@@ -0,0 +1,114 @@
+#define WIN32_LEAN_AND_MEAN
+#include "relay_input.h"
+#include "../config_schema.h"
+#include <cstdio>
+#include <thread>
+#include <Windows.h>
+
+static const config_schema<relay_input::settings> schema("relay.", {
+	{ "port",   &relay_input::settings::port,   0 },
+	{ "player", &relay_input::settings::player, 2 },
+});
+
+// Counters to print on exit
+static const relay_input *report_device;
+
+/**
+ * report_relay_stats - Print packet loss on exit
+ */
+static void report_relay_stats()
+{
+	const auto &stats = report_device->stats();
+
+	char message[192];
+	sprintf_s(message, sizeof(message),
+		"tgm3_input: relay received %u packets, %u stale, %u lost, "
+		"%u frames lost\n",
+		stats.packets, stats.stale, stats.lost_packets, stats.lost_frames);
+
+	OutputDebugString(message);
+}
+
+/**
+ * init - Start receiving relayed buttons
+ * @cfg:		Config object
+ * @diagnostics:	Config errors
+ *
+ * A port of 0 leaves the relay off
+ */
+void relay_input::init(const config &cfg, std::vector<std::string> *diagnostics)
+{
+	settings relay;
+	schema.bind(cfg, &relay, diagnostics);
+
+	if (relay.port == 0)
+		return;
+
+	if (relay.player != 1 && relay.player != 2) {
+		if (diagnostics != nullptr)
+			diagnostics->push_back("relay.player: must be 1 or 2");
+
+		return;
+	}
+
+	player = relay.player;
+	socket = relay_socket::listen((uint16_t)(relay.port));
+	if (socket == nullptr) {
+		if (diagnostics != nullptr) {
+			diagnostics->push_back(
+				"relay.port: couldn't listen on "
+				+ std::to_string(relay.port));
+		}
+
+		return;
+	}
+
+	report_device = this;
+	atexit(report_relay_stats);
+
+	// Blocks in receive until the process exits
+	std::thread(&relay_input::receive_thread, this).detach();
+}
+
+/**
+ * receive_thread - Turn packets into frames until the socket breaks
+ */
+void relay_input::receive_thread()
+{
+	relay_packet packet;
+	uint16_t frames[relay_history];
+
+	while (true) {
+		const auto size = socket->receive(&packet, sizeof(packet), -1);
+		if (size < 0)
+			return;
+
+		if (size != sizeof(packet) || packet.magic != relay_magic)
+			continue;
+
+		// Ack first so the round trip doesn't include publishing
+		relay_ack ack;
+		ack.magic = relay_ack_magic;
+		ack.frame = packet.frame;
+		ack.send_time = packet.send_time;
+		socket->reply(&ack, sizeof(ack));
+
+		const auto count = decoder.decode(packet, frames);
+		for (auto i = 0; i < count; i++) {
+			received.publish(player == 1
+				? button_state::pack(frames[i], 0)
+				: button_state::pack(0, frames[i]));
+		}
+	}
+}
+
+uint32_t relay_input::poll_buttons(const uint32_t frame)
+{
+	const auto sample = received.consume();
+
+	// Up at both polls but changed in between was a tap
+	const auto taps = sample.toggled & ~sample.level & ~last_level;
+	last_level = sample.level;
+
+	return sample.level | taps;
+}
\ No newline at end of file
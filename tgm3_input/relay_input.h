@@ -0,0 +1,87 @@
+#pragma once
+
+#include "base_input.h"
+#include "button_state.h"
+#include "../relay/relay.h"
+#include <cstdint>
+#include <memory>
+
+/*
+ * Buttons for a player at another machine, sent by the relay tool over
+ * UDP. Enabled by setting relay.port, the buttons go to relay.player.
+ *
+ * A thread of its own receives packets, acks them and publishes every
+ * frame it didn't have yet in order, so taps that only lived for a frame
+ * still reach the game. Frames are applied at JVS polls like injected
+ * buttons, so nothing goes through the window.
+ */
+class relay_input : public base_input {
+public:
+	struct settings {
+		int port;
+		int player;
+	};
+
+private:
+	std::unique_ptr<relay_socket> socket;
+	int player = 2;
+
+	// Receive thread only
+	relay_decoder decoder;
+
+	// Frames as they arrive, in the player's half of the word
+	button_state received;
+
+	// Game thread only, level handed over on the previous poll
+	uint32_t last_level = 0;
+
+	void receive_thread();
+
+public:
+	// Nothing comes through raw input
+	std::vector<int> get_usage() override
+	{
+		return {};
+	}
+
+	// Open the socket and start receiving if a port is configured
+	void init(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override;
+
+	// The socket stays open on its original port
+	void reload(
+		const config &cfg,
+		std::vector<std::string> *diagnostics) override
+	{
+	}
+
+	void update(const tagRAWINPUT *input) override
+	{
+	}
+
+	// Relayed buttons only reach the game through poll_buttons
+	unsigned short get_buttons_1p() const override
+	{
+		return 0;
+	}
+
+	unsigned short get_buttons_2p() const override
+	{
+		return 0;
+	}
+
+	// The remote player isn't affected by this window losing focus
+	void clear_buttons() override
+	{
+	}
+
+	// Latest frame, with taps since the last poll held for this one
+	uint32_t poll_buttons(uint32_t frame) override;
+
+	// Packet and loss counters, written by the receive thread
+	const relay_stats &stats() const
+	{
+		return decoder.stats;
+	}
+};
\ No newline at end of file
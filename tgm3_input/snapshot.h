@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <utility>
+
+/*
+ * Settings that can be replaced while input is being processed. The input
+ * thread reads the current version with get() and never blocks. A new
+ * version is published from another thread with a single pointer swap, so
+ * the input thread sees either the old settings or the new ones in full.
+ *
+ * Old versions are freed once the input thread has called
+ * snapshot_quiescent(), which it must do at points where it holds no
+ * pointers returned by get().
+ *
+ * There is one epoch for every snapshot, so only one thread may call get()
+ * and snapshot_quiescent(). A second reader going quiescent would let the
+ * first one's versions be freed while it still holds them.
+ */
+inline std::atomic<unsigned> &snapshot_epoch()
+{
+	static std::atomic<unsigned> epoch(0);
+	return epoch;
+}
+
+// Called by the input thread between uses of snapshot pointers. Sequentially
+// consistent along with get() and publish(), see publish().
+inline void snapshot_quiescent()
+{
+	auto &epoch = snapshot_epoch();
+	epoch.store(epoch.load(std::memory_order_relaxed) + 1);
+}
+
+template<typename T>
+class snapshot {
+	std::atomic<const T*> current;
+
+	// Replaced versions and the epoch they were replaced in, only touched
+	// by the publishing thread
+	std::vector<std::pair<unsigned, const T*>> retired;
+
+public:
+	snapshot() : current(nullptr)
+	{
+	}
+
+	snapshot(const snapshot&) = delete;
+	snapshot &operator=(const snapshot&) = delete;
+
+	~snapshot()
+	{
+		delete current.load();
+		for (const auto &old : retired)
+			delete old.second;
+	}
+
+	// Current version, may be null if nothing was published yet
+	const T *get() const
+	{
+		return current.load();
+	}
+
+	/**
+	 * publish - Replace the current version
+	 * @next:	New version
+	 *
+	 * Swap in the new one, then free versions retired before the input
+	 * thread last went quiescent. Only one thread may publish at a time.
+	 *
+	 * The epoch is read after the swap, so if the reader still holds the
+	 * old version it hasn't gone quiescent since and the old version is
+	 * kept until it has. The swap and the reader's epoch store each come
+	 * before a load of what the other thread writes, which only works
+	 * with sequentially consistent ordering on both sides.
+	 */
+	void publish(std::unique_ptr<const T> next)
+	{
+		const auto *replaced = current.exchange(next.release());
+		const auto epoch = snapshot_epoch().load();
+
+		auto keep = retired.begin();
+		for (auto &old : retired) {
+			if (old.first != epoch)
+				delete old.second;
+			else
+				*keep++ = old;
+		}
+		retired.erase(keep, retired.end());
+
+		if (replaced != nullptr)
+			retired.emplace_back(epoch, replaced);
+	}
+};
\ No newline at end of file
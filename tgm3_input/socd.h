@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Resolves which directions to send when several are held at once. The
+ * order directions were pressed in is kept as a packed word of 2 bit
+ * direction indices, so updating it never allocates and resolving is a few
+ * shifts.
+ */
+
+// Direction bits, the same values as base_input's masks
+enum : unsigned short {
+	dir_right = 4,
+	dir_left  = 8,
+	dir_down  = 16,
+	dir_up    = 32,
+	dir_all   = dir_right | dir_left | dir_down | dir_up
+};
+
+// Order held directions were pressed in
+class direction_order {
+	// Direction indices (mask = 4 << index), most recent in the low bits
+	uint8_t order = 0;
+	uint8_t count = 0;
+	uint8_t held = 0;
+
+	static unsigned short mask(const unsigned index)
+	{
+		return (unsigned short)(dir_right << index);
+	}
+
+	void remove(const unsigned index)
+	{
+		for (auto i = 0u; i < count; i++) {
+			if (((order >> (i * 2)) & 3) != index)
+				continue;
+
+			const auto below = order & ((1u << (i * 2)) - 1);
+			order = (uint8_t)(((order >> (i * 2 + 2)) << (i * 2)) | below);
+			count--;
+			return;
+		}
+	}
+
+public:
+	/**
+	 * update - Track presses and releases
+	 * @dir_buttons:	Currently held direction bits
+	 *
+	 * Directions pressed in the same update count as pressed in order
+	 * of their bit, matching the old list based code.
+	 */
+	void update(const unsigned short dir_buttons)
+	{
+		const auto now = (uint8_t)((dir_buttons & dir_all) >> 2);
+		const auto changed = now ^ held;
+
+		for (auto i = 0u; i < 4; i++) {
+			const auto bit = 1u << i;
+			if ((changed & bit) == 0)
+				continue;
+
+			if (now & bit) {
+				order = (uint8_t)((order << 2) | i);
+				count++;
+			} else {
+				remove(i);
+			}
+		}
+
+		held = now;
+	}
+
+	void clear()
+	{
+		order = 0;
+		count = 0;
+		held = 0;
+	}
+
+	// Held direction bits
+	unsigned short held_mask() const
+	{
+		return (unsigned short)(held << 2);
+	}
+
+	// Most recently pressed held direction, 0 if none
+	unsigned short newest() const
+	{
+		return count != 0 ? mask(order & 3) : 0;
+	}
+
+	// Earliest pressed held direction, 0 if none
+	unsigned short oldest() const
+	{
+		return count != 0 ? mask((order >> ((count - 1) * 2)) & 3) : 0;
+	}
+
+	// Whichever of two held directions was pressed last
+	unsigned short newer(const unsigned short a, const unsigned short b) const
+	{
+		for (auto i = 0u; i < count; i++) {
+			const auto dir = mask((order >> (i * 2)) & 3);
+			if (dir == a || dir == b)
+				return dir;
+		}
+
+		return 0;
+	}
+};
+
+/*
+ * Resolution policies. Each has a resolve function that turns the held
+ * directions into the directions the game gets.
+ */
+
+// Only the most recently pressed direction
+struct socd_last_wins {
+	static unsigned short resolve(const direction_order &dirs)
+	{
+		return dirs.newest();
+	}
+};
+
+// Only the first pressed direction until it's released
+struct socd_first_wins {
+	static unsigned short resolve(const direction_order &dirs)
+	{
+		return dirs.oldest();
+	}
+};
+
+// Opposite directions cancel out
+struct socd_neutral {
+	static unsigned short resolve(const direction_order &dirs)
+	{
+		auto held = dirs.held_mask();
+		if ((held & (dir_left | dir_right)) == (dir_left | dir_right))
+			held &= ~(dir_left | dir_right);
+		if ((held & (dir_up | dir_down)) == (dir_up | dir_down))
+			held &= ~(dir_up | dir_down);
+
+		return held;
+	}
+};
+
+// Up beats down, left/right is last wins
+struct socd_up_priority {
+	static unsigned short resolve(const direction_order &dirs)
+	{
+		auto held = dirs.held_mask();
+		if ((held & (dir_left | dir_right)) == (dir_left | dir_right)) {
+			held &= ~(dir_left | dir_right);
+			held |= dirs.newer(dir_left, dir_right);
+		}
+		if (held & dir_up)
+			held &= ~dir_down;
+
+		return held;
+	}
+};
+
+// Up beats down, left and right cancel out
+struct socd_hitbox {
+	static unsigned short resolve(const direction_order &dirs)
+	{
+		auto held = dirs.held_mask();
+		if ((held & (dir_left | dir_right)) == (dir_left | dir_right))
+			held &= ~(dir_left | dir_right);
+		if (held & dir_up)
+			held &= ~dir_down;
+
+		return held;
+	}
+};
+
+// Policy selectable from config, in the same order as socd_mode_names
+enum class socd_mode {
+	last_wins,
+	first_wins,
+	neutral,
+	up_priority,
+	hitbox
+};
+
+static const char *const socd_mode_names[] = {
+	"last",
+	"first",
+	"neutral",
+	"up",
+	"hitbox",
+	nullptr
+};
+
+// Direction order plus the resolved output for one player
+class direction_priority {
+	direction_order dirs;
+
+public:
+	/**
+	 * update - Resolve directions with a compile time policy
+	 * @dir_buttons:	Currently held direction bits
+	 */
+	template<typename Policy>
+	unsigned short update(const unsigned short dir_buttons)
+	{
+		dirs.update(dir_buttons);
+		return Policy::resolve(dirs);
+	}
+
+	/**
+	 * update - Resolve directions with the configured policy
+	 * @dir_buttons:	Currently held direction bits
+	 * @mode:		Policy
+	 */
+	unsigned short update(const unsigned short dir_buttons, const socd_mode mode)
+	{
+		switch (mode) {
+		case socd_mode::first_wins:  return update<socd_first_wins>(dir_buttons);
+		case socd_mode::neutral:     return update<socd_neutral>(dir_buttons);
+		case socd_mode::up_priority: return update<socd_up_priority>(dir_buttons);
+		case socd_mode::hitbox:      return update<socd_hitbox>(dir_buttons);
+		default:                     return update<socd_last_wins>(dir_buttons);
+		}
+	}
+
+	void clear()
+	{
+		dirs.clear();
+	}
+};
\ No newline at end of file
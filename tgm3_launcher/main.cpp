@@ -1,5 +1,5 @@
 #define WIN32_LEAN_AND_MEAN
-#include "../config.h"
+#include "../patches.h"
 #include <Windows.h>
 #include <sstream>
 #include <iostream>
@@ -37,10 +37,19 @@ static void apply_patches(const HANDLE process)
 
 
 	const config cfg("tgm3.cfg");
-	const auto resolution_x = cfg.value_int(640, "patches.resolution_x");
-	const auto resolution_y = cfg.value_int(480, "patches.resolution_y");
 
-	const auto fullscreen = (char)(cfg.value_bool(true, "patches.fullscreen"));
+	// Report typos here, the DLL only binds the patches it needs
+	std::vector<std::string> diagnostics;
+	patch_settings patches;
+	patch_settings::schema().bind(cfg, &patches, &diagnostics);
+
+	for (const auto &message : diagnostics)
+		std::cerr << "tgm3.cfg: " << message << std::endl;
+
+	const auto resolution_x = patches.resolution_x;
+	const auto resolution_y = patches.resolution_y;
+
+	const auto fullscreen = (char)(patches.fullscreen);
 	patch_extern(0x44DCC9, &fullscreen, sizeof(fullscreen));
 	patch_extern(0x40D160, &resolution_y, sizeof(resolution_y));
 	patch_extern(0x40D165, &resolution_x, sizeof(resolution_x));
@@ -102,13 +111,13 @@ static void apply_patches(const HANDLE process)
 	patch_extern(0x4686E4, &new_zoom, sizeof(new_zoom));*/
 
 	// texture filtering patch
-	if (cfg.value_bool(true, "patches.gl_nearest")) {
+	if (patches.gl_nearest) {
 		const auto GL_NEAREST = 0x2600;
 		patch_extern(0x43DC95, &GL_NEAREST, sizeof(GL_NEAREST));
 	}
 
 	// patch the value passed to sub_450E50
-	if (cfg.value_bool(false, "patches.windowed")) {
+	if (patches.windowed) {
 		const auto zero = '\0';
 		patch_extern(0x44DCC9, &zero, sizeof(zero));
 	}
@@ -118,7 +127,7 @@ static void apply_patches(const HANDLE process)
 	patch_extern(0x46A0B0, &null_terminator, sizeof(null_terminator));
 
 	// patch in a reference to the new directory for sramdata
-	const auto sram_path = cfg.value_str("./", "patches.sram_path");
+	const auto &sram_path = patches.sram_path;
 	const auto buf_len = sram_path.length() + 1;
 	auto *buf = VirtualAllocEx(
 		process,